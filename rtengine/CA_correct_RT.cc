@@ -22,6 +22,9 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <vector>
+
 #include "rtengine.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
@@ -124,7 +127,7 @@ float* RawImageSource::CA_correct_RT(
     double cablue,
     bool avoidColourshift,
     const array2D<float> &rawData,
-    double* fitParamsTransfer,
+    std::vector<double>* fitParamsTransfer,
     bool fitParamsIn,
     bool fitParamsOut,
     float* buffer,
@@ -208,24 +211,21 @@ float* RawImageSource::CA_correct_RT(
 
     // Because we can't break parallel processing, we need a switch do handle the errors
     bool processpasstwo = true;
-    double fitparams[2][2][16];
+    double fitparams[2][2][16] = {};
+
+    // the transferred fit has one record per iteration: the order of the polynomial, 0 if the fit failed, and the coefficients
+    constexpr size_t fitRecordSize = 1 + 2 * 2 * 16;
+    const bool fitParamsSet = autoCA && fitParamsTransfer && fitParamsIn;
 
     const size_t iterations =
-        autoCA
-            ? std::max<size_t>(autoIterations, 1)
-            : 1;
-
-    const bool fitParamsSet = fitParamsTransfer && fitParamsIn && iterations < 2;
-    if (autoCA && fitParamsSet) {
-        // use stored parameters
-        int index = 0;
-        for (int c = 0; c < 2; ++c) {
-            for (int d = 0; d < 2; ++d) {
-                for (int e = 0; e < 16; ++e) {
-                    fitparams[c][d][e] = fitParamsTransfer[index++];
-                }
-            }
-        }
+        fitParamsSet
+            ? fitParamsTransfer->size() / fitRecordSize
+            : autoCA
+                ? std::max<size_t>(autoIterations, 1)
+                : 1;
+
+    if (autoCA && fitParamsTransfer && fitParamsOut && !fitParamsIn) {
+        fitParamsTransfer->clear();
     }
 
     for (size_t it = 0; it < iterations && processpasstwo; ++it) {
@@ -237,6 +237,15 @@ float* RawImageSource::CA_correct_RT(
         //order of 2d polynomial fit (polyord), and numpar=polyord^2
         int polyord = 4, numpar = 16;
 
+        if (fitParamsSet) {
+            // use stored parameters
+            const double* const record = fitParamsTransfer->data() + it * fitRecordSize;
+            polyord = LIM(static_cast<int>(record[0]), 0, 4); // fitparams holds at most 4^2 coefficients
+            numpar = SQR(polyord);
+            processpasstwo = polyord > 0;
+            std::copy(record + 1, record + fitRecordSize, &fitparams[0][0][0]);
+        }
+
         constexpr float eps = 1e-5f, eps2 = 1e-10f; //tolerance to avoid dividing by zero
 
 #ifdef _OPENMP
@@ -1271,6 +1280,13 @@ float* RawImageSource::CA_correct_RT(
             // clean up
             free(bufferThr);
         }
+
+        if (autoCA && !fitParamsSet && fitParamsTransfer && fitParamsOut) {
+            // store calculated parameters
+            fitParamsTransfer->push_back(processpasstwo ? polyord : 0);
+            fitParamsTransfer->insert(fitParamsTransfer->end(), &fitparams[0][0][0], &fitparams[0][0][0] + 2 * 2 * 16);
+        }
+
         if (avoidColourshift) {
             // to avoid or at least reduce the colour shift caused by raw ca correction we compute the per pixel difference factors
             // of red and blue channel and apply a gaussian blur to them.
@@ -1352,18 +1368,6 @@ float* RawImageSource::CA_correct_RT(
         }
     }
 
-    if (autoCA && fitParamsTransfer && fitParamsOut) {
-        // store calculated parameters
-        int index = 0;
-        for (int c = 0; c < 2; ++c) {
-            for (int d = 0; d < 2; ++d) {
-                for (int e = 0; e < 16; ++e) {
-                    fitParamsTransfer[index++] = fitparams[c][d][e];
-                }
-            }
-        }
-    }
-
     if (freeBuffer) {
         free(buffer);
         buffer = nullptr;
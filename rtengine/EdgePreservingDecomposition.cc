@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include "rt_math.h"
 #include "EdgePreservingDecomposition.h"
@@ -646,7 +647,454 @@ void MultiDiagonalSymmetricMatrix::CholeskyBackSolve(float* RESTRICT x, float* R
     }
 }
 
-EdgePreservingDecomposition::EdgePreservingDecomposition(int width, int height) : a0(nullptr) , a_1(nullptr), a_w(nullptr), a_w_1(nullptr), a_w1(nullptr)
+namespace
+{
+
+//Iterates of multigrid preconditioned conjugate gradient. Being nearly independent of image size and edge stopping, a few do.
+constexpr int MaximumMultigridIterates = 8;
+//Smoothing sweeps before and after the coarse grid correction, and on the coarsest level which is solved by sweeps alone.
+constexpr int MultigridSmoothings = 1;
+constexpr int MultigridCoarsestSmoothings = 16;
+//Levels with fewer points than this aren't worth starting threads for.
+constexpr int MultigridParallelSize = 16384;
+
+}
+
+void MultigridPreconditioner::Stencil(const Level &l, int i, int x, int y, float a[3][3])
+{
+    const int w = l.w;
+    a[1][1] = l.d[i];
+
+    if(x > 0 && x < w - 1 && y > 0 && y < l.h - 1) {
+        a[0][0] = l.se[i - w - 1];
+        a[0][1] = l.s[i - w];
+        a[0][2] = l.sw[i - w + 1];
+        a[1][0] = l.e[i - 1];
+        a[1][2] = l.e[i];
+        a[2][0] = l.sw[i];
+        a[2][1] = l.s[i];
+        a[2][2] = l.se[i];
+        return;
+    }
+
+    const bool West = x > 0, East = x < w - 1, North = y > 0, South = y < l.h - 1;
+    a[0][0] = North && West ? l.se[i - w - 1] : 0.f;
+    a[0][1] = North ? l.s[i - w] : 0.f;
+    a[0][2] = North && East ? l.sw[i - w + 1] : 0.f;
+    a[1][0] = West ? l.e[i - 1] : 0.f;
+    a[1][2] = East ? l.e[i] : 0.f;
+    a[2][0] = South && West ? l.sw[i] : 0.f;
+    a[2][1] = South ? l.s[i] : 0.f;
+    a[2][2] = South && East ? l.se[i] : 0.f;
+}
+
+float MultigridPreconditioner::OffDiagonalProduct(const Level &l, const float *v, int i, int x, int y)
+{
+    float a[3][3];
+    Stencil(l, i, x, y, a);
+    float sum = 0.f;
+
+    for(int dy = -1; dy <= 1; dy++)
+        for(int dx = -1; dx <= 1; dx++)
+            if((dx != 0 || dy != 0) && a[dy + 1][dx + 1] != 0.f) {
+                sum += a[dy + 1][dx + 1] * v[i + dy * l.w + dx];
+            }
+
+    return sum;
+}
+
+void MultigridPreconditioner::CreateInterpolation(Level &Fine)
+{
+    //Weights are stored as p[4 i + 2 ky + kx]. Points between two coarse points come first, the ones in the middle of four need theirs.
+#ifdef _OPENMP
+    #pragma omp parallel if(Fine.n >= MultigridParallelSize)
+#endif
+    {
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int y = 0; y < Fine.h; y++) {
+            for(int x = 0, i = y * Fine.w; x < Fine.w; x++, i++) {
+                float *W = Fine.p + 4 * i;
+                W[0] = W[1] = W[2] = W[3] = 0.f;
+
+                if(!(x & 1) && !(y & 1)) {
+                    //On a coarse point.
+                    W[0] = 1.f;
+                } else if(!(x & 1) || !(y & 1)) {
+                    //Between two coarse points. Collapse the stencil onto the line through them and solve for the center.
+                    float a[3][3];
+                    Stencil(Fine, i, x, y, a);
+                    const bool Horizontal = !(y & 1);
+                    float Sum[3];
+
+                    for(int k = 0; k < 3; k++) {
+                        Sum[k] = Horizontal ? a[0][k] + a[1][k] + a[2][k] : a[k][0] + a[k][1] + a[k][2];
+                    }
+
+                    W[0] = -Sum[0] / Sum[1];
+                    W[Horizontal ? 1 : 2] = -Sum[2] / Sum[1];
+                }
+            }
+        }
+
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int y = 1; y < Fine.h; y += 2) {
+            for(int x = 1, i = y * Fine.w + 1; x < Fine.w; x += 2, i += 2) {
+                //In the middle of four coarse points. Solve the full stencil, with the neighbours between coarse points interpolated.
+                float a[3][3];
+                Stencil(Fine, i, x, y, a);
+                float *W = Fine.p + 4 * i;
+                const float *West = Fine.p + 4 * (i - 1), *North = Fine.p + 4 * (i - Fine.w);
+                W[0] = -a[0][0] - a[1][0] * West[0] - a[0][1] * North[0];
+                W[1] = -a[0][2] - a[0][1] * North[1];
+                W[2] = -a[2][0] - a[1][0] * West[2];
+                W[3] = -a[2][2];
+
+                if(x < Fine.w - 1) {
+                    const float *East = Fine.p + 4 * (i + 1);
+                    W[1] -= a[1][2] * East[0];
+                    W[3] -= a[1][2] * East[2];
+                }
+
+                if(y < Fine.h - 1) {
+                    const float *South = Fine.p + 4 * (i + Fine.w);
+                    W[2] -= a[2][1] * South[0];
+                    W[3] -= a[2][1] * South[1];
+                }
+
+                const float d = 1.f / a[1][1];
+                W[0] *= d;
+                W[1] *= d;
+                W[2] *= d;
+                W[3] *= d;
+            }
+        }
+    }
+}
+
+MultigridPreconditioner::MultigridPreconditioner(MultiDiagonalSymmetricMatrix *Matrix, int width, int height) : A(Matrix)
+{
+    //The finest level works directly on the matrix, its solution and right hand side are handed in by VCycle.
+    Level l;
+    l.w = width;
+    l.h = height;
+    l.n = width * height;
+    l.d  = A->Diagonals[0];
+    l.e  = A->Diagonals[1];
+    l.sw = A->Diagonals[2];
+    l.s  = A->Diagonals[3];
+    l.se = A->Diagonals[4];
+    l.x = l.b = nullptr;
+    l.r = (float*)malloc(l.n * sizeof(float));
+    l.p = nullptr;
+
+    if(l.r == nullptr) {
+        return;
+    }
+
+    Buffers.push_back(l.r);
+    Levels.push_back(l);
+
+    //Halve until a handful of points remain, a 1 pixel wide dimension just stays 1 pixel wide.
+    while(std::max(l.w, l.h) > 4) {
+        Level &Fine = Levels.back();
+        Fine.p = (float*)malloc(4 * Fine.n * sizeof(float));
+
+        if(Fine.p == nullptr) {
+            break;
+        }
+
+        Buffers.push_back(Fine.p);
+
+        l.w = (l.w + 1) / 2;
+        l.h = (l.h + 1) / 2;
+        l.n = l.w * l.h;
+
+        float *buffer = (float*)calloc(8 * l.n, sizeof(float));
+
+        if(buffer == nullptr) {
+            break;
+        }
+
+        Buffers.push_back(buffer);
+        l.d  = buffer;
+        l.e  = buffer + l.n;
+        l.sw = buffer + 2 * l.n;
+        l.s  = buffer + 3 * l.n;
+        l.se = buffer + 4 * l.n;
+        l.x  = buffer + 5 * l.n;
+        l.b  = buffer + 6 * l.n;
+        l.r  = buffer + 7 * l.n;
+        l.p  = nullptr;
+        Levels.push_back(l);
+    }
+
+    if(Levels.back().p != nullptr) {
+        //Out of memory on the way down. Too few levels are useless, so give up and let the caller fall back.
+        for(auto b : Buffers) {
+            free(b);
+        }
+
+        Buffers.clear();
+        Levels.clear();
+    }
+}
+
+MultigridPreconditioner::~MultigridPreconditioner()
+{
+    for(auto b : Buffers) {
+        free(b);
+    }
+}
+
+void MultigridPreconditioner::Setup()
+{
+    for(size_t i = 1; i < Levels.size(); i++) {
+        CreateInterpolation(Levels[i - 1]);
+        Coarsen(Levels[i - 1], Levels[i]);
+    }
+}
+
+void MultigridPreconditioner::VCycle(float *Product, float *x)
+{
+    Levels[0].x = Product;
+    Levels[0].b = x;
+    Cycle(0);
+}
+
+void MultigridPreconditioner::Cycle(size_t Index)
+{
+    Level &l = Levels[Index];
+    memset(l.x, 0, l.n * sizeof(float));
+
+    const bool Coarsest = Index + 1 == Levels.size();
+    const int Smoothings = Coarsest ? MultigridCoarsestSmoothings : MultigridSmoothings;
+
+    for(int k = 0; k < Smoothings; k++) {
+        Smooth(l, false);
+    }
+
+    if(!Coarsest) {
+        Residual(l);
+        Restrict(l, Levels[Index + 1]);
+        Cycle(Index + 1);
+        Prolong(Levels[Index + 1], l);
+    }
+
+    for(int k = 0; k < Smoothings; k++) {
+        Smooth(l, true);
+    }
+}
+
+void MultigridPreconditioner::Smooth(Level &l, bool Reverse)
+{
+    //Rows only couple to their direct neighbours, so all even rows can be relaxed at once, then all odd ones.
+    const int w = l.w;
+
+#ifdef _OPENMP
+    #pragma omp parallel if(l.n >= MultigridParallelSize)
+#endif
+
+    for(int Colour = 0; Colour < 2; Colour++) {
+        const int y0 = Reverse ? 1 - Colour : Colour;
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int y = y0; y < l.h; y += 2) {
+            const int i0 = y * w;
+            float* RESTRICT v = l.x;
+            const float* RESTRICT b = l.b;
+            const float* RESTRICT d = l.d;
+            const float* RESTRICT e = l.e;
+            const float* RESTRICT sw = l.sw;
+            const float* RESTRICT s = l.s;
+            const float* RESTRICT se = l.se;
+
+            if(y == 0 || y == l.h - 1 || w < 3) {
+                for(int k = 0; k < w; k++) {
+                    const int x = Reverse ? w - 1 - k : k;
+                    v[i0 + x] = (b[i0 + x] - OffDiagonalProduct(l, v, i0 + x, x, y)) / d[i0 + x];
+                }
+
+                continue;
+            }
+
+            //Inner rows. The neighbour along the row is the only dependency between consecutive points, keep it out of the division.
+            int i = Reverse ? i0 + w - 1 : i0;
+            v[i] = (b[i] - OffDiagonalProduct(l, v, i, Reverse ? w - 1 : 0, y)) / d[i];
+
+            if(Reverse) {
+                for(i = i0 + w - 2; i > i0; i--) {
+                    const float q = 1.f / d[i];
+                    const float rest = b[i] - e[i - 1] * v[i - 1] - se[i - w - 1] * v[i - w - 1] - s[i - w] * v[i - w] - sw[i - w + 1] * v[i - w + 1]
+                                       - sw[i] * v[i + w - 1] - s[i] * v[i + w] - se[i] * v[i + w + 1];
+                    v[i] = (rest - e[i] * v[i + 1]) * q;
+                }
+            } else {
+                for(i = i0 + 1; i < i0 + w - 1; i++) {
+                    const float q = 1.f / d[i];
+                    const float rest = b[i] - e[i] * v[i + 1] - se[i - w - 1] * v[i - w - 1] - s[i - w] * v[i - w] - sw[i - w + 1] * v[i - w + 1]
+                                       - sw[i] * v[i + w - 1] - s[i] * v[i + w] - se[i] * v[i + w + 1];
+                    v[i] = (rest - e[i - 1] * v[i - 1]) * q;
+                }
+            }
+
+            i = Reverse ? i0 : i0 + w - 1;
+            v[i] = (b[i] - OffDiagonalProduct(l, v, i, Reverse ? 0 : w - 1, y)) / d[i];
+        }
+    }
+}
+
+void MultigridPreconditioner::Residual(Level &l)
+{
+    const int w = l.w;
+
+#ifdef _OPENMP
+    #pragma omp parallel for if(l.n >= MultigridParallelSize)
+#endif
+
+    for(int y = 0; y < l.h; y++) {
+        const int i0 = y * w;
+
+        if(y == 0 || y == l.h - 1 || w < 3) {
+            for(int x = 0, i = i0; x < w; x++, i++) {
+                l.r[i] = l.b[i] - l.d[i] * l.x[i] - OffDiagonalProduct(l, l.x, i, x, y);
+            }
+
+            continue;
+        }
+
+        const float* RESTRICT v = l.x;
+        const float* RESTRICT e = l.e;
+        const float* RESTRICT sw = l.sw;
+        const float* RESTRICT s = l.s;
+        const float* RESTRICT se = l.se;
+        l.r[i0] = l.b[i0] - l.d[i0] * v[i0] - OffDiagonalProduct(l, v, i0, 0, y);
+
+        for(int i = i0 + 1; i < i0 + w - 1; i++) {
+            l.r[i] = l.b[i] - l.d[i] * v[i] - e[i - 1] * v[i - 1] - e[i] * v[i + 1] - se[i - w - 1] * v[i - w - 1] - s[i - w] * v[i - w] - sw[i - w + 1] * v[i - w + 1]
+                     - sw[i] * v[i + w - 1] - s[i] * v[i + w] - se[i] * v[i + w + 1];
+        }
+
+        l.r[i0 + w - 1] = l.b[i0 + w - 1] - l.d[i0 + w - 1] * v[i0 + w - 1] - OffDiagonalProduct(l, v, i0 + w - 1, w - 1, y);
+    }
+}
+
+void MultigridPreconditioner::Restrict(const Level &Fine, Level &Coarse)
+{
+    //Transpose of the interpolation, which keeps the V-cycle symmetric. Each coarse row gathers from the up to three fine rows
+    //interpolating from it, so the coarse rows can be done in parallel.
+#ifdef _OPENMP
+    #pragma omp parallel for if(Fine.n >= MultigridParallelSize)
+#endif
+
+    for(int Y = 0; Y < Coarse.h; Y++) {
+        float *b = Coarse.b + Y * Coarse.w;
+        memset(b, 0, Coarse.w * sizeof(float));
+
+        for(int y = std::max(2 * Y - 1, 0); y <= std::min(2 * Y + 1, Fine.h - 1); y++) {
+            const int ky = Y - (y >> 1);
+
+            for(int x = 0, i = y * Fine.w; x < Fine.w; x++, i++) {
+                const float *W = Fine.p + 4 * i + 2 * ky;
+                b[x >> 1] += W[0] * Fine.r[i];
+
+                if(W[1] != 0.f) {
+                    b[(x >> 1) + 1] += W[1] * Fine.r[i];
+                }
+            }
+        }
+    }
+}
+
+void MultigridPreconditioner::Prolong(const Level &Coarse, Level &Fine)
+{
+#ifdef _OPENMP
+    #pragma omp parallel for if(Fine.n >= MultigridParallelSize)
+#endif
+
+    for(int y = 0; y < Fine.h; y++) {
+        const float *x0 = Coarse.x + (y >> 1) * Coarse.w;
+        const float *x1 = (y >> 1) + 1 < Coarse.h ? x0 + Coarse.w : x0;
+
+        for(int x = 0, i = y * Fine.w; x < Fine.w; x++, i++) {
+            const float *W = Fine.p + 4 * i;
+            const int X = x >> 1, X1 = X + 1 < Coarse.w ? X + 1 : X;
+            Fine.x[i] += W[0] * x0[X] + W[1] * x0[X1] + W[2] * x1[X] + W[3] * x1[X1];
+        }
+    }
+}
+
+void MultigridPreconditioner::Coarsen(const Level &Fine, Level &Coarse)
+{
+    //Galerkin product P^T A P. Like Restrict each coarse row gathers from its fine rows, and only the five lower triangle
+    //couplings of its points are kept, the others belong to the neighbours.
+#ifdef _OPENMP
+    #pragma omp parallel for if(Fine.n >= MultigridParallelSize)
+#endif
+
+    for(int Y = 0; Y < Coarse.h; Y++) {
+        const int I0 = Y * Coarse.w;
+        memset(Coarse.d + I0, 0, Coarse.w * sizeof(float));
+        memset(Coarse.e + I0, 0, Coarse.w * sizeof(float));
+        memset(Coarse.sw + I0, 0, Coarse.w * sizeof(float));
+        memset(Coarse.s + I0, 0, Coarse.w * sizeof(float));
+        memset(Coarse.se + I0, 0, Coarse.w * sizeof(float));
+
+        for(int y = std::max(2 * Y - 1, 0); y <= std::min(2 * Y + 1, Fine.h - 1); y++) {
+            const int ky = Y - (y >> 1);
+
+            for(int x = 0, i = y * Fine.w; x < Fine.w; x++, i++) {
+                const float *Wi = Fine.p + 4 * i + 2 * ky;
+
+                if(Wi[0] == 0.f && Wi[1] == 0.f) {
+                    continue;
+                }
+
+                //Row i of A P, on the coarse points (x / 2 - 1 + ox, y / 2 - 1 + oy) as T[oy][ox].
+                float a[3][3];
+                Stencil(Fine, i, x, y, a);
+                float T[4][4] = {};
+
+                for(int dy = -1; dy <= 1; dy++)
+                    for(int dx = -1; dx <= 1; dx++) {
+                        const float c = a[dy + 1][dx + 1];
+
+                        if(c == 0.f) {
+                            continue;
+                        }
+
+                        const float *Wj = Fine.p + 4 * (i + dy * Fine.w + dx);
+                        const int oy = ((y + dy) >> 1) - (y >> 1) + 1;
+                        const int ox = ((x + dx) >> 1) - (x >> 1) + 1;
+                        T[oy][ox] += c * Wj[0];
+                        T[oy][ox + 1] += c * Wj[1];
+                        T[oy + 1][ox] += c * Wj[2];
+                        T[oy + 1][ox + 1] += c * Wj[3];
+                    }
+
+                for(int kx = 0; kx < 2; kx++) {
+                    if(Wi[kx] != 0.f) {
+                        const int I = I0 + (x >> 1) + kx;
+                        Coarse.d[I]  += Wi[kx] * T[ky + 1][kx + 1];
+                        Coarse.e[I]  += Wi[kx] * T[ky + 1][kx + 2];
+                        Coarse.sw[I] += Wi[kx] * T[ky + 2][kx];
+                        Coarse.s[I]  += Wi[kx] * T[ky + 2][kx + 1];
+                        Coarse.se[I] += Wi[kx] * T[ky + 2][kx + 2];
+                    }
+                }
+            }
+        }
+    }
+}
+
+EdgePreservingDecomposition::EdgePreservingDecomposition(int width, int height) : MG(nullptr), a0(nullptr) , a_1(nullptr), a_w(nullptr), a_w_1(nullptr), a_w1(nullptr)
 {
     w = width;
     h = height;
@@ -670,11 +1118,19 @@ EdgePreservingDecomposition::EdgePreservingDecomposition(int width, int height)
         a_w1  = A->Diagonals[2];
         a_w   = A->Diagonals[3];
         a_w_1 = A->Diagonals[4];
+
+        MG = new MultigridPreconditioner(A, w, h);
+
+        if(!MG->IsValid()) {
+            delete MG;
+            MG = nullptr;
+        }
     }
 }
 
 EdgePreservingDecomposition::~EdgePreservingDecomposition()
 {
+    delete MG;
     delete A;
 }
 
@@ -827,7 +1283,18 @@ float *EdgePreservingDecomposition::CreateBlur(float *Source, float Scale, float
         delete[] a;
     }
 
-    //Solve & return.
+    //Solve & return. Multigrid preconditioning parallelizes where the Cholesky back solve can't, and converges in a few iterates.
+    if(MG != nullptr) {
+        if(!UseBlurForEdgeStop) {
+            memcpy(Blur, Source, n * sizeof(float));
+        }
+
+        MG->Setup();
+        SparseConjugateGradient(MG->PassThroughVectorProduct, Source, n, false, Blur, 0.0f, (void *)MG,
+                                Iterates > 0 ? std::min(Iterates, MaximumMultigridIterates) : MaximumMultigridIterates, MG->PassThroughVCycle);
+        return Blur;
+    }
+
     bool success = A->CreateIncompleteCholeskyFactorization(1); //Fill-in of 1 seems to work really good. More doesn't really help and less hurts (slightly).
 
     if(!success) {
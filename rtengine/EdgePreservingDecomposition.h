@@ -67,6 +67,7 @@ ben_s or nonbasketless. Enjoy!
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #include "opthelper.h"
 #include "noncopyable.h"
@@ -134,6 +135,70 @@ public:
 
 };
 
+/* Geometric multigrid for the nine point stencil matrices EdgePreservingDecomposition makes on a w x h grid, an alternative to the
+incomplete Cholesky factorization as preconditioner. Coarse operators are Galerkin products under operator dependent interpolation
+(Dendy's black box multigrid) and the smoother is a Gauss-Seidel over first the even, then the odd rows, so all rows of a colour are
+done in parallel, unlike the Cholesky back solve. Post smoothing runs in exactly the opposite order of pre smoothing, which makes
+one V-cycle a symmetric positive definite operator usable by SparseConjugateGradient. */
+class MultigridPreconditioner :
+    public rtengine::NonCopyable
+{
+public:
+    //Matrix needs the diagonals with start rows 0, 1, w - 1, w and w + 1 in that order. Check IsValid() afterwards, false if out of memory.
+    MultigridPreconditioner(MultiDiagonalSymmetricMatrix *Matrix, int width, int height);
+    ~MultigridPreconditioner();
+
+    bool IsValid() const
+    {
+        return !Levels.empty();
+    };
+
+    //(Re)builds the coarse operators from the current contents of the matrix. Call whenever the matrix changed.
+    void Setup();
+
+    //One V-cycle from a zero initial guess, so Product approximates the solution of A Product = x.
+    void VCycle(float *Product, float *x);
+    static void PassThroughVCycle(float *Product, float *x, void *Pass)
+    {
+        (static_cast<MultigridPreconditioner *>(Pass))->VCycle(Product, x);
+    };
+    //Product of the matrix, so that the same pass through variable serves SparseConjugateGradient for both.
+    static void PassThroughVectorProduct(float *Product, float *x, void *Pass)
+    {
+        (static_cast<MultigridPreconditioner *>(Pass))->A->VectorProduct(Product, x);
+    };
+
+private:
+    struct Level {
+        int w, h, n;
+        //Coupling of each point with itself and with its east, south west, south and south east neighbours. The other four are symmetric.
+        float *d, *e, *sw, *s, *se;
+        //Solution, right hand side and residual on this level.
+        float *x, *b, *r;
+        //Interpolation weights from the next coarser level, four per point, see CreateInterpolation.
+        float *p;
+    };
+
+    //Couplings of point i = (x, y) with its neighbours as a[dy + 1][dx + 1], zero outside the grid.
+    static void Stencil(const Level &l, int i, int x, int y, float a[3][3]);
+    //Off diagonal part of row i = (x, y) of the matrix times v.
+    static float OffDiagonalProduct(const Level &l, const float *v, int i, int x, int y);
+
+    //Interpolation weights of each fine point on the coarse points (x / 2 + kx, y / 2 + ky), derived from the stencil so
+    //interpolation doesn't cross edges. Such operator dependent interpolation keeps multigrid effective with strongly varying coefficients.
+    void CreateInterpolation(Level &Fine);
+    void Smooth(Level &l, bool Reverse);
+    void Residual(Level &l);
+    void Restrict(const Level &Fine, Level &Coarse);
+    void Prolong(const Level &Coarse, Level &Fine);
+    void Coarsen(const Level &Fine, Level &Coarse);
+    void Cycle(size_t Index);
+
+    MultiDiagonalSymmetricMatrix *A;
+    std::vector<Level> Levels;
+    std::vector<float *> Buffers;
+};
+
 class EdgePreservingDecomposition :
     public rtengine::NonCopyable
 {
@@ -156,6 +221,7 @@ public:
 
 private:
     MultiDiagonalSymmetricMatrix *A;    //The equations are simple enough to not mandate a matrix class, but fast solution NEEDS a complicated preconditioner.
+    MultigridPreconditioner *MG;        //That preconditioner. nullptr if there wasn't memory for it, then incomplete Cholesky is used.
     int w, h, n;
 
     //Convenient access to the data in A.
@@ -31,6 +31,8 @@
 #include "cplx_wavelet_dec.h"
 #include "color.h"
 #include "curves.h"
+#include "fftwplancache.h"
+#include "histmedian.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "imagefloat.h"
@@ -120,6 +122,12 @@ void do_median_denoise(float **src, float **dst, float upperBound, int width, in
             border = 4;
             break;
         }
+
+        case Median::TYPE_15X15:
+        case Median::TYPE_21X21: {
+            border = 0; // the histogram median clips its windows at the borders
+            break;
+        }
     }
 
     float **allocBuffer = nullptr;
@@ -150,6 +158,28 @@ void do_median_denoise(float **src, float **dst, float upperBound, int width, in
         medianIn = medBuffer[BufferIndex];
         medianOut = medBuffer[BufferIndex ^ 1];
 
+        if (medianType == Median::TYPE_15X15 || medianType == Median::TYPE_21X21) {
+            // too large for the sorting networks, the histogram median takes about the same time for any window size
+            histogramMedian(medianIn, medianOut, width, height, medianType == Median::TYPE_15X15 ? 7 : 10, numThreads);
+
+            if (useUpperBound) {
+#ifdef _OPENMP
+                #pragma omp parallel for num_threads(numThreads) if (numThreads>1)
+#endif
+
+                for (int i = 0; i < height; ++i) {
+                    for (int j = 0; j < width; ++j) {
+                        if (medianIn[i][j] > upperBound) {
+                            medianOut[i][j] = medianIn[i][j];
+                        }
+                    }
+                }
+            }
+
+            BufferIndex ^= 1; // swap buffers
+            continue;
+        }
+
         if (iteration == 1) { // upper border
             for (int i = 0; i < border; ++i) {
                 for (int j = 0; j < width; ++j) {
@@ -384,6 +414,11 @@ void do_median_denoise(float **src, float **dst, float upperBound, int width, in
 
                     break;
                 }
+
+                case Median::TYPE_15X15:
+                case Median::TYPE_21X21: {
+                    break; // handled above
+                }
             }
 
             for (; j < width; ++j) {
@@ -758,14 +793,11 @@ BENCHFUN
             // calculate min size of numblox_W.
             int min_numblox_W = ceil((static_cast<float>((MIN(imwidth, ((numtiles_W - 1) * tileWskip) + tilewidth)) - ((numtiles_W - 1) * tileWskip))) / (offset)) + 2 * blkrad;
 
-            // these are needed only for creation of the plans and will be freed before entering the parallel loop
-            fftwf_plan plan_forward_blox[2];
-            fftwf_plan plan_backward_blox[2];
+            // The plans come from the process wide cache, so repeated jobs with the same tile geometry don't plan again.
+            FFTWPlanCache::Plan plan_forward_blox[2];
+            FFTWPlanCache::Plan plan_backward_blox[2];
 
             if (denoiseLuminance) {
-                float *Lbloxtmp  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-                float *fLbloxtmp = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-
                 int nfwd[2] = {TS, TS};
 
                 //for DCT:
@@ -773,12 +805,12 @@ BENCHFUN
                 fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
 
                 // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
-                plan_forward_blox[0]  = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_backward_blox[0] = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_forward_blox[1]  = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_backward_blox[1] = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                fftwf_free(Lbloxtmp);
-                fftwf_free(fLbloxtmp);
+                // The arrays are allocated with fftwf_malloc, which is the alignment the cache assumes for nullptr
+                FFTWPlanCache* const planCache = FFTWPlanCache::getInstance();
+                plan_forward_blox[0]  = planCache->getManyR2R(2, nfwd, max_numblox_W, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT, nullptr, nullptr);
+                plan_backward_blox[0] = planCache->getManyR2R(2, nfwd, max_numblox_W, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT, nullptr, nullptr);
+                plan_forward_blox[1]  = planCache->getManyR2R(2, nfwd, min_numblox_W, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT, nullptr, nullptr);
+                plan_backward_blox[1] = planCache->getManyR2R(2, nfwd, min_numblox_W, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT, nullptr, nullptr);
             }
 
 #ifndef _OPENMP
@@ -1422,9 +1454,9 @@ BENCHFUN
                                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
                                         //fftwf_print_plan (plan_forward_blox);
                                         if (numblox_W == max_numblox_W) {
-                                            fftwf_execute_r2r(plan_forward_blox[0], Lblox, fLblox);    // DCT an entire row of tiles
+                                            fftwf_execute_r2r(plan_forward_blox[0].get(), Lblox, fLblox);    // DCT an entire row of tiles
                                         } else {
-                                            fftwf_execute_r2r(plan_forward_blox[1], Lblox, fLblox);    // DCT an entire row of tiles
+                                            fftwf_execute_r2r(plan_forward_blox[1].get(), Lblox, fLblox);    // DCT an entire row of tiles
                                         }
 
                                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -1439,9 +1471,9 @@ BENCHFUN
 
                                         //now perform inverse FT of an entire row of blocks
                                         if (numblox_W == max_numblox_W) {
-                                            fftwf_execute_r2r(plan_backward_blox[0], fLblox, Lblox);    //for DCT
+                                            fftwf_execute_r2r(plan_backward_blox[0].get(), fLblox, Lblox);    //for DCT
                                         } else {
-                                            fftwf_execute_r2r(plan_backward_blox[1], fLblox, Lblox);    //for DCT
+                                            fftwf_execute_r2r(plan_backward_blox[1].get(), fLblox, Lblox);    //for DCT
                                         }
 
                                         int topproc = (vblk - blkrad) * offset;
@@ -1519,6 +1551,20 @@ BENCHFUN
                                         medianTypeL = Median::TYPE_5X5_SOFT;
                                         medianTypeAB = Median::TYPE_9X9;
                                     }
+                                } else if (dnparams.medmethod == "1515") {
+                                    if (metchoice != 4) {
+                                        medianTypeL = medianTypeAB = Median::TYPE_15X15;
+                                    } else {
+                                        medianTypeL = Median::TYPE_5X5_STRONG;
+                                        medianTypeAB = Median::TYPE_15X15;
+                                    }
+                                } else if (dnparams.medmethod == "2121") {
+                                    if (metchoice != 4) {
+                                        medianTypeL = medianTypeAB = Median::TYPE_21X21;
+                                    } else {
+                                        medianTypeL = Median::TYPE_7X7;
+                                        medianTypeAB = Median::TYPE_21X21;
+                                    }
                                 }
 
                                 if (metchoice == 1 || metchoice == 2 || metchoice == 4) {
@@ -1762,14 +1808,6 @@ BENCHFUN
                     }
                 }
             }
-
-            if (denoiseLuminance) {
-                // destroy the plans
-                fftwf_destroy_plan(plan_forward_blox[0]);
-                fftwf_destroy_plan(plan_backward_blox[0]);
-                fftwf_destroy_plan(plan_forward_blox[1]);
-                fftwf_destroy_plan(plan_backward_blox[1]);
-            }
         } while (memoryAllocationFailed && numTries < 2 && (options.rgbDenoiseThreadLimit == 0) && !ponder);
 
         if (memoryAllocationFailed) {
@@ -578,7 +578,7 @@ int RawImageSource::findZeroPixels(PixelsMap &bpMap) const
 
     for (int i = 0; i < H; ++i) {
         for (int j = 0; j < W; ++j) {
-            if (ri->data[i][j] == 0.f) {
+            if (ri->get_data(i, j) == 0.f) {
                 bpMap.set(j, i);
                 counter++;
             }
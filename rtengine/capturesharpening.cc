@@ -25,6 +25,7 @@
 #include "rt_math.h"
 #include "procparams.h"
 #include "color.h"
+#include "deconvolution.h"
 #include "rt_algo.h"
 //#define BENCHMARK
 #include "StopWatch.h"
@@ -510,6 +511,21 @@ float calcRadiusXtrans(const float * const *rawData, int W, int H, float lowerLi
     return std::sqrt((1.f / (std::log(1.f / maxRatio))) / -2.f);
 }
 
+// See deconvConvergenceLimit. Only the part of the tile which is written back is checked, black pixels are skipped
+// as their ratio stays 0.
+bool deconvConverged(const float* const* ratio, const float* const* luminance, int size, int border)
+{
+    for (int i = border; i < size - border; ++i) {
+        for (int j = border; j < size - border; ++j) {
+            if (luminance[i][j] > 0.f && std::fabs(ratio[i][j] - 1.f) > rtengine::deconvConvergenceLimit) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 void CaptureDeconvSharpening (float** luminance, float** oldLuminance, const float * const * blend, int W, int H, double sigma, double sigmaCornerOffset, int iterations, rtengine::ProgressListener* plistener, double startVal, double endVal)
 {
 BENCHFUN
@@ -569,12 +585,18 @@ BENCHFUN
                     for (int k = 0; k < iterations; ++k) {
                         // apply 3x3 gaussian blur and divide luminance by result of gaussian blur
                         gauss3x3div(tmpIThr, tmpThr, lumThr, fullTileSize, fullTileSize, kernel3);
+                        if (k % rtengine::deconvConvergenceInterval == rtengine::deconvConvergenceInterval - 1 && deconvConverged(tmpThr, lumThr, fullTileSize, border)) {
+                            break;
+                        }
                         gauss3x3mult(tmpThr, tmpIThr, fullTileSize, fullTileSize, kernel3);
                     }
                 } else if (is5x5) {
                     for (int k = 0; k < iterations; ++k) {
                         // apply 5x5 gaussian blur and divide luminance by result of gaussian blur
                         gauss5x5div(tmpIThr, tmpThr, lumThr, fullTileSize, fullTileSize, kernel5);
+                        if (k % rtengine::deconvConvergenceInterval == rtengine::deconvConvergenceInterval - 1 && deconvConverged(tmpThr, lumThr, fullTileSize, border)) {
+                            break;
+                        }
                         gauss5x5mult(tmpThr, tmpIThr, fullTileSize, fullTileSize, kernel5);
                     }
                 } else {
@@ -587,6 +609,9 @@ BENCHFUN
                             for (int k = 0; k < iterations - 1; ++k) {
                                 // apply 7x7 gaussian blur and divide luminance by result of gaussian blur
                                 gauss7x7div(tmpIThr, tmpThr, lumThr, fullTileSize, fullTileSize, lkernel7);
+                                if (k % rtengine::deconvConvergenceInterval == rtengine::deconvConvergenceInterval - 1 && deconvConverged(tmpThr, lumThr, fullTileSize, border)) {
+                                    break;
+                                }
                                 gauss7x7mult(tmpThr, tmpIThr, fullTileSize, fullTileSize, lkernel7);
                             }
                         }
@@ -594,6 +619,9 @@ BENCHFUN
                         for (int k = 0; k < iterations; ++k) {
                             // apply 7x7 gaussian blur and divide luminance by result of gaussian blur
                             gauss7x7div(tmpIThr, tmpThr, lumThr, fullTileSize, fullTileSize, kernel7);
+                            if (k % rtengine::deconvConvergenceInterval == rtengine::deconvConvergenceInterval - 1 && deconvConverged(tmpThr, lumThr, fullTileSize, border)) {
+                                break;
+                            }
                             gauss7x7mult(tmpThr, tmpIThr, fullTileSize, fullTileSize, kernel7);
                         }
                     }
@@ -37,6 +37,8 @@ wavelet_decomposition::~wavelet_decomposition()
     if(coeff0) {
         delete [] coeff0;
     }
+
+    delete[] arena;
 }
 
 }
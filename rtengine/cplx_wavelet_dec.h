@@ -21,6 +21,7 @@
 
 #include <cstddef>
 #include <cmath>
+#include <utility>
 
 #include "cplx_wavelet_level.h"
 #include "cplx_wavelet_filter_coeffs.h"
@@ -49,6 +50,7 @@ private:
     float *wavfilt_anal;
     float *wavfilt_synth;
 
+    internal_type *arena; // subbands of all levels, nullptr if the levels had to allocate their own memory
 
     wavelet_level<internal_type> * wavelet_decomp[maxlevels];
 
@@ -94,7 +96,7 @@ public:
 
 template<typename E>
 wavelet_decomposition::wavelet_decomposition(E * src, int width, int height, int maxlvl, int subsampling, int skipcrop, int numThreads, int Daub4Len)
-    : coeff0(nullptr), memoryAllocationFailed(false), lvltot(0), subsamp(subsampling), m_w(width), m_h(height)
+    : coeff0(nullptr), memoryAllocationFailed(false), lvltot(0), subsamp(subsampling), m_w(width), m_h(height), arena(nullptr)
 {
 
     //initialize wavelet filters
@@ -148,6 +150,22 @@ wavelet_decomposition::wavelet_decomposition(E * src, int width, int height, int
     // after coefficient rotation, data structure is:
     // wavelet_decomp[scale][channel={lo,hi1,hi2,hi3}][pixel_array]
 
+    // one block for the subbands of all levels
+    std::size_t arenaSize = 0;
+    std::size_t levelOffset[maxlevels];
+
+    for (int level = 0, levelW = m_w, levelH = m_h; level < maxlvl; ++level) {
+        if ((subsamp >> level) & 1) {
+            levelW = (levelW + 1) / 2;
+            levelH = (levelH + 1) / 2;
+        }
+
+        levelOffset[level] = arenaSize;
+        arenaSize += 3 * static_cast<std::size_t>(levelW) * levelH;
+    }
+
+    arena = new (std::nothrow) internal_type[arenaSize];
+
     lvltot = 0;
     E *buffer[2];
     buffer[0] = new (std::nothrow) E[(m_w / 2 + 1) * (m_h / 2 + 1)];
@@ -169,7 +187,7 @@ wavelet_decomposition::wavelet_decomposition(E * src, int width, int height, int
     int bufferindex = 0;
 
     wavelet_decomp[lvltot] = new wavelet_level<internal_type>(src, buffer[bufferindex ^ 1], lvltot/*level*/, subsamp, m_w, m_h, \
-            wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads);
+            wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads, arena ? arena + levelOffset[lvltot] : nullptr);
 
     if(wavelet_decomp[lvltot]->memoryAllocationFailed) {
         memoryAllocationFailed = true;
@@ -180,7 +198,7 @@ wavelet_decomposition::wavelet_decomposition(E * src, int width, int height, int
         bufferindex ^= 1;
         wavelet_decomp[lvltot] = new wavelet_level<internal_type>(buffer[bufferindex], buffer[bufferindex ^ 1]/*lopass*/, lvltot/*level*/, subsamp, \
                 wavelet_decomp[lvltot - 1]->width(), wavelet_decomp[lvltot - 1]->height(), \
-                wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads);
+                wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads, arena ? arena + levelOffset[lvltot] : nullptr);
 
         if(wavelet_decomp[lvltot]->memoryAllocationFailed) {
             memoryAllocationFailed = true;
@@ -205,21 +223,29 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
         int width = wavelet_decomp[1]->m_w;
         int height = wavelet_decomp[1]->m_h;
 
-        E *tmpHi = new (std::nothrow) E[width * height];
+        // levels which are not subsampled can't be reconstructed in place, they alternate between coeff0 and buffer.
+        // Subsampled levels are reconstructed in place and use the unused one as temporary buffer.
+        E *buffer = new (std::nothrow) E[width * height];
 
-        if(tmpHi == nullptr) {
+        if(buffer == nullptr) {
             memoryAllocationFailed = true;
             return;
         }
 
         for (int lvl = lvltot; lvl > 0; lvl--) {
-            E *tmpLo = wavelet_decomp[lvl]->wavcoeffs[2]; // we can use this as buffer
-            wavelet_decomp[lvl]->reconstruct_level(tmpLo, tmpHi, coeff0, coeff0, wavfilt_synth, wavfilt_synth, wavfilt_len, wavfilt_offset);
+            if (wavelet_decomp[lvl]->subsampled()) {
+                E *tmpLo = wavelet_decomp[lvl]->wavcoeffs[2]; // we can use this as buffer
+                wavelet_decomp[lvl]->reconstruct_level(tmpLo, buffer, coeff0, coeff0, wavfilt_synth, wavfilt_synth, wavfilt_len, wavfilt_offset);
+            } else {
+                wavelet_decomp[lvl]->reconstruct_level<E>(nullptr, nullptr, coeff0, buffer, wavfilt_synth, wavfilt_synth, wavfilt_len, wavfilt_offset);
+                std::swap(coeff0, buffer);
+            }
+
             delete wavelet_decomp[lvl];
             wavelet_decomp[lvl] = nullptr;
         }
 
-        delete[] tmpHi;
+        delete[] buffer;
     }
 
     int width = wavelet_decomp[0]->m_w;
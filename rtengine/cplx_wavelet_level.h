@@ -43,16 +43,17 @@ class wavelet_level
     int skip;
 
     bool bigBlockOfMemory;
+    // whether the subbands are part of a block owned by the caller
+    bool externalMemory;
     // allocation and destruction of data storage
-    T ** create(int n);
+    T ** create(int n, T * storage);
     void destroy(T ** subbands);
 
     // load a row/column of input data, possibly with padding
 
     void AnalysisFilterHaarVertical (const T * const srcbuffer, T * dstLo, T * dstHi, const int width, const int height, const int row);
     void AnalysisFilterHaarHorizontal (const T * const srcbuffer, T * dstLo, T * dstHi, const int width, const int row);
-    void SynthesisFilterHaarHorizontal (const T * const srcLo, const T * const srcHi, T * dst, const int width, const int height);
-    void SynthesisFilterHaarVertical (const T * const srcLo, const T * const srcHi, T * dst, const int width, const int height);
+    void SynthesisFilterHaar (const T * const srcLoLo, const T * const srcLoHi, const T * const srcHiLo, const T * const srcHiHi, T * dst, const int width, const int height);
 
     void AnalysisFilterSubsampHorizontal (T * srcbuffer, T * dstLo, T * dstHi, float *filterLo, float *filterHi,
                                           const int taps, const int offset, const int srcwidth, const int dstwidth, const int row);
@@ -80,9 +81,10 @@ public:
     // size of low frequency part
     int m_w2, m_h2;
 
+    // storage, if not nullptr, has to hold 3 * width() * height() values and has to outlive the level
     template<typename E>
-    wavelet_level(E * src, E * dst, int level, int subsamp, int w, int h, float *filterV, float *filterH, int len, int offset, int skipcrop, int numThreads)
-        : lvl(level), subsamp_out((subsamp >> level) & 1), numThreads(numThreads), skip(1 << level), bigBlockOfMemory(true), memoryAllocationFailed(false), wavcoeffs(nullptr), m_w(w), m_h(h), m_w2(w), m_h2(h)
+    wavelet_level(E * src, E * dst, int level, int subsamp, int w, int h, float *filterV, float *filterH, int len, int offset, int skipcrop, int numThreads, T * storage = nullptr)
+        : lvl(level), subsamp_out((subsamp >> level) & 1), numThreads(numThreads), skip(1 << level), bigBlockOfMemory(true), externalMemory(storage != nullptr), memoryAllocationFailed(false), wavcoeffs(nullptr), m_w(w), m_h(h), m_w2(w), m_h2(h)
     {
         if (subsamp) {
             skip = 1;
@@ -102,7 +104,7 @@ public:
         m_w2 = (subsamp_out ? (w + 1) / 2 : w);
         m_h2 = (subsamp_out ? (h + 1) / 2 : h);
 
-        wavcoeffs = create((m_w2) * (m_h2));
+        wavcoeffs = create((m_w2) * (m_h2), storage);
 
         if(!memoryAllocationFailed) {
             decompose_level(src, dst, filterV, filterH, len, offset);
@@ -140,6 +142,11 @@ public:
         return skip;
     }
 
+    bool subsampled() const
+    {
+        return subsamp_out;
+    }
+
     bool bigBlockOfMemoryUsed() const
     {
         return bigBlockOfMemory;
@@ -148,14 +155,15 @@ public:
     template<typename E>
     void decompose_level(E *src, E *dst, float *filterV, float *filterH, int len, int offset);
 
+    // src and dst may only be the same buffer for subsampled levels
     template<typename E>
     void reconstruct_level(E* tmpLo, E* tmpHi, E *src, E *dst, float *filterV, float *filterH, int taps, int offset, const float blend = 1.f);
 };
 
 template<typename T>
-T ** wavelet_level<T>::create(int n)
+T ** wavelet_level<T>::create(int n, T * storage)
 {
-    T * data = new (std::nothrow) T[3 * n];
+    T * data = storage ? storage : new (std::nothrow) T[3 * n];
 
     if(data == nullptr) {
         bigBlockOfMemory = false;
@@ -184,7 +192,9 @@ void wavelet_level<T>::destroy(T ** subbands)
 {
     if(subbands) {
         if(bigBlockOfMemory) {
-            delete[] subbands[1];
+            if(!externalMemory) {
+                delete[] subbands[1];
+            }
         } else {
             for(int j = 1; j < 4; j++) {
                 if(subbands[j] != nullptr) {
@@ -235,58 +245,78 @@ template<typename T> void wavelet_level<T>::AnalysisFilterHaarVertical (const T
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-template<typename T> void wavelet_level<T>::SynthesisFilterHaarHorizontal (const T * const RESTRICT srcLo, const T * const RESTRICT srcHi, T * RESTRICT dst, const int width, const int height)
+template<typename T> void wavelet_level<T>::SynthesisFilterHaar (const T * const RESTRICT srcLoLo, const T * const RESTRICT srcLoHi, const T * const RESTRICT srcHiLo, const T * const RESTRICT srcHiHi, T * RESTRICT dst, const int width, const int height)
 {
 
-    /* Basic convolution code
-     * Applies a Haar filter
-     *
+    /* Applies the horizontal and the vertical Haar filter in one pass.
+     * The horizontal results of row i - skip are computed again instead of being
+     * kept in two temporary planes, so dst must not be one of the sources.
      */
+    const auto horizontal =
+        [this](const T * const RESTRICT srcLo, const T * const RESTRICT srcHi, int i) -> T
+        {
+            return i < skip ? srcLo[i] + srcHi[i] : 0.5f * (srcLo[i] + srcHi[i] + srcLo[i - skip] - srcHi[i - skip]);
+        };
+#ifdef __SSE2__
+    const auto horizontalv =
+        [this](const T * const RESTRICT srcLo, const T * const RESTRICT srcHi, int i) -> vfloat
+        {
+            // i >= skip
+            return F2V(0.5f) * (LVFU(srcLo[i]) + LVFU(srcHi[i]) + LVFU(srcLo[i - skip]) - LVFU(srcHi[i - skip]));
+        };
+#endif
+    const int border = min(skip, width);
+
 #ifdef _OPENMP
     #pragma omp parallel for num_threads(numThreads) if(numThreads>1)
 #endif
 
     for (int k = 0; k < height; k++) {
-        for(int i = 0; i < skip; i++) {
-            dst[k * width + i] = (srcLo[k * width + i] + srcHi[k * width + i]);
-        }
+        const T * const ll = srcLoLo + k * width;
+        const T * const lh = srcLoHi + k * width;
+        const T * const hl = srcHiLo + k * width;
+        const T * const hh = srcHiHi + k * width;
+        T * const d = dst + k * width;
 
-        for(int i = skip; i < width; i++) {
-            dst[k * width + i] = 0.5f * (srcLo[k * width + i] + srcHi[k * width + i] + srcLo[k * width + i - skip] - srcHi[k * width + i - skip]);
-        }
-    }
-}
+        if (k < skip) {
+            int i;
 
-template<typename T> void wavelet_level<T>::SynthesisFilterHaarVertical (const T * const RESTRICT srcLo, const T * const RESTRICT srcHi, T * RESTRICT dst, const int width, const int height)
-{
+            for (i = 0; i < border; i++) {
+                d[i] = horizontal(ll, lh, i) + horizontal(hl, hh, i);
+            }
+
+#ifdef __SSE2__
+
+            for (; i < width - 3; i += 4) {
+                STVFU(d[i], horizontalv(ll, lh, i) + horizontalv(hl, hh, i));
+            }
 
-    /* Basic convolution code
-     * Applies a Haar filter
-     *
-     */
-#ifdef _OPENMP
-    #pragma omp parallel num_threads(numThreads) if(numThreads>1)
-#endif
-    {
-#ifdef _OPENMP
-        #pragma omp for nowait
 #endif
 
-        for(int i = 0; i < skip; i++)
-        {
-            for(int j = 0; j < width; j++) {
-                dst[width * i + j] = (srcLo[i * width + j] + srcHi[i * width + j]);
+            for (; i < width; i++) {
+                d[i] = horizontal(ll, lh, i) + horizontal(hl, hh, i);
+            }
+        } else {
+            const T * const ll2 = ll - skip * width;
+            const T * const lh2 = lh - skip * width;
+            const T * const hl2 = hl - skip * width;
+            const T * const hh2 = hh - skip * width;
+            int i;
+
+            for (i = 0; i < border; i++) {
+                d[i] = 0.5f * (horizontal(ll, lh, i) + horizontal(hl, hh, i) + horizontal(ll2, lh2, i) - horizontal(hl2, hh2, i));
+            }
+
+#ifdef __SSE2__
+
+            for (; i < width - 3; i += 4) {
+                STVFU(d[i], F2V(0.5f) * (horizontalv(ll, lh, i) + horizontalv(hl, hh, i) + horizontalv(ll2, lh2, i) - horizontalv(hl2, hh2, i)));
             }
-        }
 
-#ifdef _OPENMP
-        #pragma omp for
 #endif
 
-        for(int i = skip; i < height; i++)
-        {
-            for(int j = 0; j < width; j++) {
-                dst[width * i + j] = 0.5f * (srcLo[i * width + j] + srcHi[i * width + j] + srcLo[(i - skip) * width + j] - srcHi[(i - skip) * width + j]);
+            for (; i < width; i++) {
+                d[i] = 0.5f * (horizontal(ll, lh, i) + horizontal(hl, hh, i) + horizontal(ll2, lh2, i) - horizontal(hl2, hh2, i));
             }
         }
     }
@@ -301,27 +331,57 @@ void wavelet_level<T>::AnalysisFilterSubsampHorizontal (T * RESTRICT srcbuffer,
      * aligning the 'offset' element of the filter with
      * the input pixel, and skipping 'skip' pixels between taps
      * Output is subsampled by two
+     * The input is split into its even and odd samples (with clamped borders),
+     * so that each tap reads consecutive samples for consecutive outputs
      */
-    // calculate coefficients
-    for(int i = 0; i < srcwidth; i += 2) {
+    const int pad = (skip * taps + 1) / 2 * 2; // has to be even to keep the parity of the samples
+    const int n = dstwidth + (skip * offset + pad) / 2 + 1;
+    T evens[n] ALIGNED16;
+    T odds[n] ALIGNED16;
+
+    for (int i = 0; i < n; i++) {
+        evens[i] = srcbuffer[max(0, min(2 * i - pad, srcwidth - 1))];
+        odds[i] = srcbuffer[max(0, min(2 * i + 1 - pad, srcwidth - 1))];
+    }
+
+    const T *src[taps];
+
+    for (int j = 0; j < taps; j++) {
+        const int shift = skip * (offset - j) + pad;
+        src[j] = (shift % 2 ? odds : evens) + shift / 2;
+    }
+
+    dstLo += row * dstwidth;
+    dstHi += row * dstwidth;
+    int i = 0;
+#ifdef __SSE2__
+
+    for (; i < dstwidth - 3; i += 4) {
+        vfloat lov = ZEROV;
+        vfloat hiv = ZEROV;
+
+        for (int j = 0; j < taps; j++) {
+            const vfloat srcv = LVFU(src[j][i]);
+            lov += F2V(filterLo[j]) * srcv;//lopass channel
+            hiv += F2V(filterHi[j]) * srcv;//hipass channel
+        }
+
+        STVFU(dstLo[i], lov);
+        STVFU(dstHi[i], hiv);
+    }
+
+#endif
+
+    for (; i < dstwidth; i++) {
         float lo = 0.f, hi = 0.f;
 
-        if (LIKELY(i > skip * taps && i < srcwidth - skip * taps)) { //bulk
-            for (int j = 0, l = -skip * offset; j < taps; j++, l += skip) {
-                float src = srcbuffer[i - l];
-                lo += filterLo[j] * src;//lopass channel
-                hi += filterHi[j] * src;//hipass channel
-            }
-        } else {
-            for (int j = 0; j < taps; j++) {
-                int arg = max(0, min(i + skip * (offset - j), srcwidth - 1)); //clamped BC's
-                lo += filterLo[j] * srcbuffer[arg];//lopass channel
-                hi += filterHi[j] * srcbuffer[arg];//hipass channel
-            }
+        for (int j = 0; j < taps; j++) {
+            lo += filterLo[j] * src[j][i];//lopass channel
+            hi += filterHi[j] * src[j][i];//hipass channel
         }
 
-        dstLo[row * dstwidth + ((i / 2))] = lo;
-        dstHi[row * dstwidth + ((i / 2))] = hi;
+        dstLo[i] = lo;
+        dstHi[i] = hi;
     }
 }
 
@@ -448,57 +508,66 @@ template<typename T> void wavelet_level<T>::SynthesisFilterSubsampHorizontal (T
      * Applies an FIR filter 'filter' with filter length 'taps',
      * aligning the 'offset' element of the filter with
      * the input pixel, and skipping 'skip' pixels between taps
-     * Output is subsampled by two
+     * Output is upsampled by two
+     * Even and odd outputs are computed separately, each of them reads
+     * consecutive samples of the (padded) input for consecutive outputs
      */
 
     // calculate coefficients
-    int shift = skip * (taps - offset - 1); //align filter with data
+    const int shift = skip * (taps - offset - 1); //align filter with data
+    const int pad = skip * taps;
+    const int n = (dstwidth + 1) / 2 + (shift + 1) / 2 + pad + 1;
+#ifdef __SSE2__
+    const int beginEven = shift % 2;
+    const int beginOdd = (shift + 1) % 2;
+    const int startEven = shift / 2 + pad;
+    const int startOdd = (shift + 1) / 2 + pad;
+#endif
 #ifdef _OPENMP
     #pragma omp parallel for num_threads(numThreads) if(numThreads>1)
 #endif
 
     for (int k = 0; k < height; k++) {
-        int i;
+        T lo[n] ALIGNED16;
+        T hi[n] ALIGNED16;
 
-        for(i = 0; i <= min(skip * taps, dstwidth); i++) {
-            float tot = 0.f;
-            //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
-            int i_src = (i + shift) / 2;
-            int begin = (i + shift) % 2;
+        for (int i = 0; i < n; i++) {
+            const int arg = max(0, min(i - pad, srcwidth - 1)); //clamped BC's
+            lo[i] = srcLo[k * srcwidth + arg];
+            hi[i] = srcHi[k * srcwidth + arg];
+        }
 
-            for (int j = begin, l = 0; j < taps; j += 2, l += skip) {
-                int arg = max(0, min((i_src - l), srcwidth - 1)); //clamped BC's
-                tot += ((filterLo[j] * srcLo[k * srcwidth + arg] + filterHi[j] * srcHi[k * srcwidth + arg]));
-            }
+        T * const RESTRICT d = dst + k * dstwidth;
+        int i = 0;
+#ifdef __SSE2__
 
-            dst[k * dstwidth + i] = tot;
-        }
+        for (; i < dstwidth - 7; i += 8) {
+            const int p = i / 2;
+            vfloat evenv = ZEROV;
+            vfloat oddv = ZEROV;
 
-        for(; i < min(dstwidth - skip * taps, dstwidth); i++) {
-            float tot = 0.f;
-            //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
-            int i_src = (i + shift) / 2;
-            int begin = (i + shift) % 2;
+            for (int j = beginEven, l = startEven; j < taps; j += 2, l -= skip) {
+                evenv += F2V(filterLo[j]) * LVFU(lo[p + l]) + F2V(filterHi[j]) * LVFU(hi[p + l]);
+            }
 
-            for (int j = begin, l = 0; j < taps; j += 2, l += skip) {
-                tot += ((filterLo[j] * srcLo[k * srcwidth + i_src - l] + filterHi[j] * srcHi[k * srcwidth + i_src - l]));
+            for (int j = beginOdd, l = startOdd; j < taps; j += 2, l -= skip) {
+                oddv += F2V(filterLo[j]) * LVFU(lo[p + l]) + F2V(filterHi[j]) * LVFU(hi[p + l]);
             }
 
-            dst[k * dstwidth + i] = tot;
+            STVFU(d[i], _mm_unpacklo_ps(evenv, oddv));
+            STVFU(d[i + 4], _mm_unpackhi_ps(evenv, oddv));
         }
 
-        for(; i < dstwidth; i++) {
+#endif
+
+        for (; i < dstwidth; i++) {
             float tot = 0.f;
-            //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
-            int i_src = (i + shift) / 2;
-            int begin = (i + shift) % 2;
 
-            for (int j = begin, l = 0; j < taps; j += 2, l += skip) {
-                int arg = max(0, min((i_src - l), srcwidth - 1)); //clamped BC's
-                tot += ((filterLo[j] * srcLo[k * srcwidth + arg] + filterHi[j] * srcHi[k * srcwidth + arg]));
+            for (int j = (i + shift) % 2, l = (i + shift) / 2 + pad; j < taps; j += 2, l -= skip) {
+                tot += filterLo[j] * lo[l] + filterHi[j] * hi[l];
             }
 
-            dst[k * dstwidth + i] = tot;
+            d[i] = tot;
         }
     }
 }
@@ -732,9 +801,7 @@ template<typename T> template<typename E> void wavelet_level<T>::reconstruct_lev
         SynthesisFilterSubsampHorizontal (src, wavcoeffs[1], tmpLo, filterH, filterH + taps, taps, offset, m_w2, m_w, m_h2);
         SynthesisFilterSubsampVertical (tmpLo, tmpHi, dst, filterVarray, filterVarray + taps, taps, offset, m_w, m_h2, m_h, blend);
     } else {
-        SynthesisFilterHaarHorizontal (wavcoeffs[2], wavcoeffs[3], tmpHi, m_w, m_h2);
-        SynthesisFilterHaarHorizontal (src, wavcoeffs[1], tmpLo, m_w, m_h2);
-        SynthesisFilterHaarVertical (tmpLo, tmpHi, dst, m_w, m_h);
+        SynthesisFilterHaar (src, wavcoeffs[1], wavcoeffs[2], wavcoeffs[3], dst, m_w, m_h);
     }
 }
 #else
@@ -750,9 +817,7 @@ template<typename T> template<typename E> void wavelet_level<T>::reconstruct_lev
         SynthesisFilterSubsampHorizontal (src, wavcoeffs[1], tmpLo, filterH, filterH + taps, taps, offset, m_w2, m_w, m_h2);
         SynthesisFilterSubsampVertical (tmpLo, tmpHi, dst, filterV, filterV + taps, taps, offset, m_w, m_h2, m_h, blend);
     } else {
-        SynthesisFilterHaarHorizontal (wavcoeffs[2], wavcoeffs[3], tmpHi, m_w, m_h2);
-        SynthesisFilterHaarHorizontal (src, wavcoeffs[1], tmpLo, m_w, m_h2);
-        SynthesisFilterHaarVertical (tmpLo, tmpHi, dst, m_w, m_h);
+        SynthesisFilterHaar (src, wavcoeffs[1], wavcoeffs[2], wavcoeffs[3], dst, m_w, m_h);
     }
 }
 #endif
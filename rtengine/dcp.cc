@@ -32,6 +32,7 @@
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "imagefloat.h"
+#include "myfile.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
 #include "utils.h"
@@ -741,7 +742,7 @@ DCPProfile::DCPProfile(const Glib::ustring& filename) :
         1.00000f
     };
 
-    FILE* const file = g_fopen(filename.c_str(), "rb");
+    IMFILE* const file = gfopen(filename.c_str());
 
     if (file == nullptr) {
         printf ("Unable to load DCP profile '%s' !", filename.c_str());
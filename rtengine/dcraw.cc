@@ -3132,7 +3132,7 @@ void CLASS lossy_dng_load_raw()
     if (tile_length < INT_MAX)
       fseek (ifp, get4(), SEEK_SET);
     /*RT jpeg_stdio_src (&cinfo, ifp); */
-    /*RT*/jpeg_memory_src(&cinfo, fdata(ftell(ifp), ifp), ifp->size - ftell(ifp));
+    /*RT*/jpeg_memory_src(&cinfo, fdata(ftell(ifp), ifp), std::max<int>(ifp->size - ftell(ifp), 0));
     jpeg_read_header (&cinfo, TRUE);
     jpeg_start_decompress (&cinfo);
     buf = (*cinfo.mem->alloc_sarray)
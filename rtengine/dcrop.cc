@@ -801,13 +801,18 @@ void Crop::update(int todo)
         transCrop = nullptr;
     }
 
+    if (!params.dirpyrequalizer.enabled) {
+        cbdlCache.clear();
+    }
+
     if ((todo & (M_TRANSFORM | M_RGBCURVE))  && params.dirpyrequalizer.cbdlMethod == "bef" && params.dirpyrequalizer.enabled && !params.colorappearance.enabled) {
 
         const int W = baseCrop->getWidth();
         const int H = baseCrop->getHeight();
         LabImage labcbdl(W, H);
         parent->ipf.rgb2lab(*baseCrop, labcbdl, params.icm.workingProfile);
-        parent->ipf.dirpyrequalizer(&labcbdl, skip);
+        cbdlCache.update(params, {cropx, cropy, cropw, croph, skip, parent->rawGeneration});
+        parent->ipf.dirpyrequalizer(&labcbdl, skip, &cbdlCache);
         parent->ipf.lab2rgb(labcbdl, *baseCrop, params.icm.workingProfile);
 
     }
@@ -902,7 +907,8 @@ void Crop::update(int todo)
 
         if (params.dirpyrequalizer.cbdlMethod == "aft") {
             if (((params.colorappearance.enabled && !settings->autocielab)  || (!params.colorappearance.enabled))) {
-                parent->ipf.dirpyrequalizer(labnCrop, skip);
+                cbdlCache.update(params, {cropx, cropy, cropw, croph, skip, parent->rawGeneration});
+                parent->ipf.dirpyrequalizer(labnCrop, skip, &cbdlCache);
                 //  parent->ipf.Lanczoslab (labnCrop,labnCrop , 1.f/skip);
             }
         }
@@ -18,6 +18,7 @@
  */
 #pragma once
 
+#include "dirpyrcache.h"
 #include "improccoordinator.h"
 #include "rtengine.h"
 #include "improcfun.h"
@@ -48,6 +49,7 @@ protected:
     // --- automatically allocated and deleted when necessary, and only renewed on size changes
     Imagefloat*  transCrop;    // "one chunk" allocation, allocated if necessary
     CieImage*    cieCrop;      // allocating 6 images, each in "one chunk" allocation
+    DirPyrCache  cbdlCache;    // contrast by detail levels decomposition, reused while only its settings change
     // -----------------------------------------------------------------
 
     bool updating;         /// Flag telling if an updater thread is currently processing
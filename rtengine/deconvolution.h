@@ -0,0 +1,28 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace rtengine
+{
+
+// Richardson-Lucy deconvolution has converged once the blurred estimate reproduces the observed luminance, i.e. once
+// no ratio computed by the div step deviates more than deconvConvergenceLimit from 1. As the check costs about as
+// much as a div step, it is done every deconvConvergenceInterval iterations only.
+constexpr float deconvConvergenceLimit = 0.001f;
+constexpr int deconvConvergenceInterval = 4;
+
+}
@@ -136,81 +136,7 @@ std::vector<badPix>& dfInfo::getHotPixels()
  */
 void dfInfo::updateRawImage()
 {
-    typedef unsigned int acc_t;
-
-    if( !pathNames.empty() ) {
-        std::list<Glib::ustring>::iterator iName = pathNames.begin();
-        ri = new RawImage(*iName); // First file used also for extra pixels information (width,height, shutter, filters etc.. )
-
-        if( ri->loadRaw(true)) {
-            delete ri;
-            ri = nullptr;
-        } else {
-            int H = ri->get_height();
-            int W = ri->get_width();
-            ri->compress_image(0);
-            int rSize = W * ((ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS) ? 1 : 3);
-            acc_t **acc = new acc_t*[H];
-
-            for( int row = 0; row < H; row++) {
-                acc[row] = new acc_t[rSize ];
-            }
-
-            // copy first image into accumulators
-            for (int row = 0; row < H; row++)
-                for (int col = 0; col < rSize; col++) {
-                    acc[row][col] = ri->data[row][col];
-                }
-
-            int nFiles = 1; // First file data already loaded
-
-            for( ++iName; iName != pathNames.end(); ++iName) {
-                RawImage* temp = new RawImage(*iName);
-
-                if( !temp->loadRaw(true)) {
-                    temp->compress_image(0);     //\ TODO would be better working on original, because is temporary
-                    nFiles++;
-
-                    if( ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS ) {
-                        for( int row = 0; row < H; row++) {
-                            for( int col = 0; col < W; col++) {
-                                acc[row][col] += temp->data[row][col];
-                            }
-                        }
-                    } else {
-                        for( int row = 0; row < H; row++) {
-                            for( int col = 0; col < W; col++) {
-                                acc[row][3 * col + 0] += temp->data[row][3 * col + 0];
-                                acc[row][3 * col + 1] += temp->data[row][3 * col + 1];
-                                acc[row][3 * col + 2] += temp->data[row][3 * col + 2];
-                            }
-                        }
-                    }
-                }
-
-                delete temp;
-            }
-
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < rSize; col++) {
-                    ri->data[row][col] = acc[row][col] / nFiles;
-                }
-
-                delete [] acc[row];
-            }
-
-            delete [] acc;
-        }
-    } else {
-        ri = new RawImage(pathname);
-
-        if( ri->loadRaw(true)) {
-            delete ri;
-            ri = nullptr;
-        } else {
-            ri->compress_image(0);
-        }
-    }
+    ri = loadMasterFrame(pathNames.empty() ? std::list<Glib::ustring>(1, pathname) : pathNames, "dark", nullptr);
 }
 
 void dfInfo::updateBadPixelList( RawImage *df )
@@ -298,6 +224,7 @@ void DFManager::init(const Glib::ustring& pathname)
 
     dfList.clear();
     bpList.clear();
+    index.load();
 
     for (size_t i = 0; i < names.size(); i++) {
         size_t lastdot = names[i].find_last_of ('.');
@@ -317,6 +244,8 @@ void DFManager::init(const Glib::ustring& pathname)
         } catch( std::exception& e ) {}
     }
 
+    index.save();
+
     // Where multiple shots exist for same group, move filename to list
     for( dfList_t::iterator iter = dfList.begin(); iter != dfList.end(); ++iter ) {
         dfInfo &i = iter->second;
@@ -365,7 +294,7 @@ dfInfo* DFManager::addFileInfo (const Glib::ustring& filename, bool pool)
 
     try {
 
-        auto info = file->query_info("standard::name,standard::type,standard::is-hidden");
+        auto info = file->query_info("standard::name,standard::type,standard::is-hidden,standard::size,time::modified,time::modified-usec");
 
         if (!info && info->get_file_type() == Gio::FILE_TYPE_DIRECTORY) {
             return nullptr;
@@ -375,38 +304,70 @@ dfInfo* DFManager::addFileInfo (const Glib::ustring& filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
-
         dfList_t::iterator iter;
 
         if(!pool) {
+            RawImage ri(filename);
+
+            if (ri.loadRaw(false) != 0) {
+                return nullptr;
+            }
+
             dfInfo n(filename, "", "", 0, 0, 0);
             iter = dfList.emplace("", n);
             return &(iter->second);
         }
 
-        FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
+        // the index spares decoding the header of every frame of the directory at each start
+        const std::string stamp = getFrameStamp(info);
+        std::vector<std::string> fields;
+        std::string maker;
+        std::string model;
+        double iso;
+        double shutter;
+        double timestamp;
+
+        if (index.find(filename, stamp, fields)) {
+            // no fields for files which aren't raw files
+            if (fields.size() != 5 || !FrameIndex::fromField(fields[2], iso) || !FrameIndex::fromField(fields[3], shutter) || !FrameIndex::fromField(fields[4], timestamp)) {
+                return nullptr;
+            }
+
+            maker = fields[0];
+            model = fields[1];
+        } else {
+            RawImage ri(filename);
+
+            if (ri.loadRaw(false) != 0) { // Read information about shot
+                index.store(filename, stamp, {});
+                return nullptr;
+            }
+
+            FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
+            maker = ((Glib::ustring)idata.getMake()).uppercase();
+            model = ((Glib::ustring)idata.getModel()).uppercase();
+            iso = idata.getISOSpeed();
+            shutter = idata.getShutterSpeed();
+            timestamp = idata.getDateTimeAsTS();
+            index.store(filename, stamp, {maker, model, FrameIndex::toField(iso), FrameIndex::toField(shutter), FrameIndex::toField(timestamp)});
+        }
+
         /* Files are added in the map, divided by same maker/model,ISO and shutter*/
-        std::string key(dfInfo::key(((Glib::ustring)idata.getMake()).uppercase(), ((Glib::ustring)idata.getModel()).uppercase(), idata.getISOSpeed(), idata.getShutterSpeed()));
+        std::string key(dfInfo::key(maker, model, iso, shutter));
         iter = dfList.find(key);
 
         if(iter == dfList.end()) {
-            dfInfo n(filename, ((Glib::ustring)idata.getMake()).uppercase(), ((Glib::ustring)idata.getModel()).uppercase(), idata.getISOSpeed(), idata.getShutterSpeed(), idata.getDateTimeAsTS());
+            dfInfo n(filename, maker, model, iso, shutter, timestamp);
             iter = dfList.emplace(key, n);
         } else {
-            while(iter != dfList.end() && iter->second.key() == key && ABS(iter->second.timestamp - idata.getDateTimeAsTS()) > 60 * 60 * 6) { // 6 hour difference
+            while(iter != dfList.end() && iter->second.key() == key && ABS(iter->second.timestamp - static_cast<time_t>(timestamp)) > 60 * 60 * 6) { // 6 hour difference
                 ++iter;
             }
 
             if(iter != dfList.end()) {
                 iter->second.pathNames.push_back(filename);
             } else {
-                dfInfo n(filename, ((Glib::ustring)idata.getMake()).uppercase(), ((Glib::ustring)idata.getModel()).uppercase(), idata.getISOSpeed(), idata.getShutterSpeed(), idata.getDateTimeAsTS());
+                dfInfo n(filename, maker, model, iso, shutter, timestamp);
                 iter = dfList.emplace(key, n);
             }
         }
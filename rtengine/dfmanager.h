@@ -25,6 +25,7 @@
 
 #include <glibmm/ustring.h>
 
+#include "masterframe.h"
 #include "pixelsmap.h"
 
 namespace rtengine
@@ -96,6 +97,7 @@ protected:
     bpList_t bpList;
     bool initialized;
     Glib::ustring currentPath;
+    FrameIndex index{"darkframes.index"};
     dfInfo *addFileInfo(const Glib::ustring &filename, bool pool = true );
     dfInfo *find( const std::string &mak, const std::string &mod, int isospeed, double shut, time_t t );
     int scanBadPixelsFile( Glib::ustring filename );
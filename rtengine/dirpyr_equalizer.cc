@@ -21,13 +21,16 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <memory>
 
 #include "array2D.h"
 #include "cieimage.h"
 #include "color.h"
+#include "dirpyrcache.h"
 #include "improcfun.h"
 #include "LUT.h"
 #include "opthelper.h"
+#include "procparams.h"
 #include "rt_math.h"
 #include "settings.h"
 
@@ -244,6 +247,17 @@ void fillLut(LUTf &irangefn, int level, double dirpyrThreshold, float mult, floa
     }
 }
 
+void copy(const float * const * src, float ** dst, int width, int height)
+{
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int i = 0; i < height; i++) {
+        std::copy(src[i], src[i] + width, dst[i]);
+    }
+}
+
 void idirpyr_eq_channel(const float * const * data_coarse, const float * const * data_fine, float ** buffer, int width, int height, int level, float mult, const double dirpyrThreshold, const float * const * hue, const float * const * chrom, const double skinprot, float b_l, float t_l, float t_r)
 {
     const float skinprotneg = -skinprot;
@@ -352,7 +366,34 @@ void idirpyr_eq_channelcam(const float * const * data_coarse, const float * cons
 namespace rtengine
 {
 
-void ImProcFunctions::dirpyr_equalizer(const float * const * src, float ** dst, int srcwidth, int srcheight, const float * const * l_a, const float * const * l_b, const double * mult, const double dirpyrThreshold, const double skinprot, float b_l, float t_l, float t_r, int scaleprev)
+DirPyrCache::DirPyrCache() = default;
+DirPyrCache::~DirPyrCache() = default;
+
+void DirPyrCache::update(const procparams::ProcParams& params, const std::vector<int>& newArea)
+{
+    // neutralise what only the recomposition uses, but keep what decides whether badpixlab() changes the input
+    procparams::ProcParams newUpstream = params;
+    const procparams::DirPyrEqualizerParams& cbdl = params.dirpyrequalizer;
+    newUpstream.dirpyrequalizer = procparams::DirPyrEqualizerParams();
+    newUpstream.dirpyrequalizer.enabled = cbdl.enabled;
+    newUpstream.dirpyrequalizer.gamutlab = cbdl.gamutlab && cbdl.skinprotect != 0;
+    newUpstream.dirpyrequalizer.cbdlMethod = cbdl.cbdlMethod;
+
+    if (!upstream || !(*upstream == newUpstream) || area != newArea) {
+        clear();
+        upstream.reset(new procparams::ProcParams(newUpstream));
+        area = newArea;
+    }
+}
+
+void DirPyrCache::clear()
+{
+    levels.clear();
+    upstream.reset();
+    area.clear();
+}
+
+void ImProcFunctions::dirpyr_equalizer(const float * const * src, float ** dst, int srcwidth, int srcheight, const float * const * l_a, const float * const * l_b, const double * mult, const double dirpyrThreshold, const double skinprot, float b_l, float t_l, float t_r, int scaleprev, DirPyrCache* cache)
 {
     //sequence of scales
     constexpr int maxlevel = 6;
@@ -380,12 +421,34 @@ void ImProcFunctions::dirpyr_equalizer(const float * const * src, float ** dst,
         }
     }
 
-    multi_array2D<float, maxlevel> dirpyrlo (srcwidth, srcheight);
+    float** dirpyrlo[maxlevel];
+    int decomposed = 0;
+    std::unique_ptr<multi_array2D<float, maxlevel>> pyramid;
 
-    dirpyr_channel(src, dirpyrlo[0], srcwidth, srcheight, 0, std::max(scales[0] / scaleprev, 1));
+    if (cache) {
+        if (!cache->levels.empty() && (cache->levels[0]->width() != srcwidth || cache->levels[0]->height() != srcheight)) {
+            cache->clear();
+        }
 
-    for (int level = 1; level < lastlevel; ++level) {
-        dirpyr_channel(dirpyrlo[level - 1], dirpyrlo[level], srcwidth, srcheight, level, std::max(scales[level] / scaleprev, 1));
+        decomposed = std::min<int>(cache->levels.size(), lastlevel);
+
+        while (static_cast<int>(cache->levels.size()) < lastlevel) {
+            cache->levels.emplace_back(new array2D<float>(srcwidth, srcheight));
+        }
+
+        for (int level = 0; level < lastlevel; ++level) {
+            dirpyrlo[level] = *cache->levels[level];
+        }
+    } else {
+        pyramid.reset(new multi_array2D<float, maxlevel>(srcwidth, srcheight));
+
+        for (int level = 0; level < maxlevel; ++level) {
+            dirpyrlo[level] = (*pyramid)[level];
+        }
+    }
+
+    for (int level = decomposed; level < lastlevel; ++level) {
+        dirpyr_channel(level == 0 ? src : dirpyrlo[level - 1], dirpyrlo[level], srcwidth, srcheight, level, std::max(scales[level] / scaleprev, 1));
     }
 
     array2D<float> tmpHue, tmpChr;
@@ -426,6 +489,21 @@ void ImProcFunctions::dirpyr_equalizer(const float * const * src, float ** dst,
         }
     }
 
+    if (cache) {
+        // the levels have to survive, so recompose into a separate buffer
+        array2D<float> buffer(srcwidth, srcheight);
+        copy(dirpyrlo[lastlevel - 1], buffer, srcwidth, srcheight);
+
+        for (int level = lastlevel - 1; level > 0; --level) {
+            idirpyr_eq_channel(dirpyrlo[level], dirpyrlo[level - 1], buffer, srcwidth, srcheight, level, multi[level], dirpyrThreshold, tmpHue, tmpChr, skinprot, b_l, t_l, t_r);
+        }
+
+        idirpyr_eq_channel(dirpyrlo[0], src, buffer, srcwidth, srcheight, 0, multi[0], dirpyrThreshold, tmpHue, tmpChr, skinprot, b_l, t_l, t_r);
+
+        copy(buffer, dst, srcwidth, srcheight);
+        return;
+    }
+
     // with the current implementation of idirpyr_eq_channel we can safely use the buffer from last level as buffer, saves some memory
     float** buffer = dirpyrlo[lastlevel - 1];
 
@@ -435,15 +513,7 @@ void ImProcFunctions::dirpyr_equalizer(const float * const * src, float ** dst,
 
     idirpyr_eq_channel(dirpyrlo[0], dst, buffer, srcwidth, srcheight, 0, multi[0], dirpyrThreshold, tmpHue, tmpChr, skinprot, b_l, t_l, t_r);
 
-#ifdef _OPENMP
-    #pragma omp parallel for
-#endif
-
-    for (int i = 0; i < srcheight; i++) {
-        for (int j = 0; j < srcwidth; j++) {
-            dst[i][j] = buffer[i][j];
-        }
-    }
+    copy(buffer, dst, srcwidth, srcheight);
 }
 
 void ImProcFunctions::dirpyr_equalizercam(const CieImage *ncie, float ** src, float ** dst, int srcwidth, int srcheight, const float * const * h_p, const float * const * C_p, const double * mult, const double dirpyrThreshold, const double skinprot, float b_l, float t_l, float t_r, int scaleprev)
@@ -0,0 +1,65 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "array2D.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+namespace procparams
+{
+
+class ProcParams;
+
+}
+
+/**
+ * @brief Pyramid of the last contrast by detail levels input of a pipeline
+ *
+ * The decomposition only depends on the input luminance and the scale, so as long as nothing upstream
+ * changes, changing the multipliers, threshold or skin settings only has to recompose the image.
+ * Owned by the preview and by each detail window, filled by ImProcFunctions::dirpyr_equalizer().
+ */
+class DirPyrCache :
+    public NonCopyable
+{
+public:
+    DirPyrCache();
+    ~DirPyrCache();
+
+    /**
+     * @brief Drops the levels if they were decomposed from a different pipeline input
+     *
+     * @param params processing parameters of the pipeline, the settings which only affect the recomposition are ignored
+     * @param area position, size and scale of the processed image
+     */
+    void update(const procparams::ProcParams& params, const std::vector<int>& area);
+    void clear();
+
+    std::vector<std::unique_ptr<array2D<float>>> levels;
+
+private:
+    std::unique_ptr<procparams::ProcParams> upstream; // the parameters the levels were decomposed with
+    std::vector<int> area;
+};
+
+}
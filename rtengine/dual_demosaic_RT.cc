@@ -23,6 +23,10 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <memory>
+#include <sstream>
+#include <string>
+
 #include "color.h"
 #include "jaggedarray.h"
 #include "procparams.h"
@@ -38,14 +42,58 @@
 
 using namespace std;
 
+namespace
+{
+
+// everything but the contrast threshold which changes the results of the two demosaicers
+std::string getDualDemosaicKey(bool isBayer, const rtengine::procparams::RAWParams &raw, int border, int winw, int winh)
+{
+    std::ostringstream key;
+
+    if (isBayer) {
+        key << "bayer " << raw.bayersensor.method << ' ' << raw.bayersensor.dcb_iterations << ' ' << raw.bayersensor.dcb_enhance;
+    } else {
+        key << "xtrans " << raw.xtranssensor.method;
+    }
+
+    key << ' ' << border << ' ' << winw << 'x' << winh;
+    return key.str();
+}
+
+}
+
 namespace rtengine
 {
 
-void RawImageSource::dual_demosaic_RT(bool isBayer, const procparams::RAWParams &raw, int winw, int winh, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, double &contrast, bool autoContrast)
+void RawImageSource::dual_demosaic_RT(bool isBayer, const procparams::RAWParams &raw, int winw, int winh, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, double &contrast, bool autoContrast, bool useCache)
 {
     BENCHFUN
 
-    if (contrast == 0.f && !autoContrast) {
+    // the cache holds the results of the first demosaicer in planes 0 to 2 and those of the second one in planes 3 to 5
+    const std::string cacheKey = useCache ? getDualDemosaicKey(isBayer, raw, border, winw, winh) : std::string();
+    const bool cached = useCache && dualDemosaicCache && cacheKey == dualDemosaicKey;
+
+    if (useCache && !cached) {
+        dualDemosaicCache.reset();
+        dualDemosaicKey.clear();
+    }
+
+    if (cached) {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < winh; ++i) {
+            for (int j = 0; j < winw; ++j) {
+                red[i][j] = (*dualDemosaicCache)[0][i][j];
+                green[i][j] = (*dualDemosaicCache)[1][i][j];
+                blue[i][j] = (*dualDemosaicCache)[2][i][j];
+            }
+        }
+
+        if (contrast == 0.f && !autoContrast) {
+            return;
+        }
+    } else if (contrast == 0.f && !autoContrast) {
         // contrast == 0.0 means only first demosaicer will be used
         if(isBayer) {
             if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::AMAZEVNG4) ) {
@@ -53,7 +101,7 @@ void RawImageSource::dual_demosaic_RT(bool isBayer, const procparams::RAWParams
             } else if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::DCBVNG4) ) {
                 dcb_demosaic(raw.bayersensor.dcb_iterations, raw.bayersensor.dcb_enhance);
             } else if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::RCDVNG4) ) {
-                rcd_demosaic(options.chunkSizeRCD, options.measure);
+                rcd_demosaic(0, 0, W, H, options.chunkSizeRCD, options.measure);
             }
         } else {
             if (raw.xtranssensor.method == procparams::RAWParams::XTransSensor::getMethodString(procparams::RAWParams::XTransSensor::Method::FOUR_PASS) ) {
@@ -66,28 +114,55 @@ void RawImageSource::dual_demosaic_RT(bool isBayer, const procparams::RAWParams
         return;
     }
 
-    array2D<float> redTmp(winw, winh);
-    array2D<float> greenTmp(winw, winh);
-    array2D<float> blueTmp(winw, winh);
-    array2D<float> L(winw, winh);
+    std::unique_ptr<multi_array2D<float, 3>> tmpBuffer;
 
-    if (isBayer) {
-        vng4_demosaic(rawData, redTmp, greenTmp, blueTmp);
-
-        if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::AMAZEVNG4) || raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::PIXELSHIFT)) {
-            amaze_demosaic_RT(0, 0, winw, winh, rawData, red, green, blue, options.chunkSizeAMAZE, options.measure);
-        } else if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::DCBVNG4) ) {
-            dcb_demosaic(raw.bayersensor.dcb_iterations, raw.bayersensor.dcb_enhance);
-        } else if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::RCDVNG4) ) {
-            rcd_demosaic(options.chunkSizeRCD, options.measure);
+    if (useCache) {
+        if (!cached) {
+            dualDemosaicCache.reset(new multi_array2D<float, 6>(winw, winh));
         }
     } else {
-        if (raw.xtranssensor.method == procparams::RAWParams::XTransSensor::getMethodString(procparams::RAWParams::XTransSensor::Method::FOUR_PASS) ) {
-            xtrans_interpolate (3, true, options.chunkSizeXT, options.measure);
+        tmpBuffer.reset(new multi_array2D<float, 3>(winw, winh));
+    }
+
+    array2D<float> &redTmp = useCache ? (*dualDemosaicCache)[3] : (*tmpBuffer)[0];
+    array2D<float> &greenTmp = useCache ? (*dualDemosaicCache)[4] : (*tmpBuffer)[1];
+    array2D<float> &blueTmp = useCache ? (*dualDemosaicCache)[5] : (*tmpBuffer)[2];
+    array2D<float> L(winw, winh);
+
+    if (!cached) { // otherwise only the contrast threshold changed, just blend again
+        if (isBayer) {
+            vng4_demosaic(rawData, redTmp, greenTmp, blueTmp);
+
+            if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::AMAZEVNG4) || raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::PIXELSHIFT)) {
+                amaze_demosaic_RT(0, 0, winw, winh, rawData, red, green, blue, options.chunkSizeAMAZE, options.measure);
+            } else if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::DCBVNG4) ) {
+                dcb_demosaic(raw.bayersensor.dcb_iterations, raw.bayersensor.dcb_enhance);
+            } else if (raw.bayersensor.method == procparams::RAWParams::BayerSensor::getMethodString(procparams::RAWParams::BayerSensor::Method::RCDVNG4) ) {
+                rcd_demosaic(0, 0, W, H, options.chunkSizeRCD, options.measure);
+            }
         } else {
-            xtrans_interpolate (1, false, options.chunkSizeXT, options.measure);
+            if (raw.xtranssensor.method == procparams::RAWParams::XTransSensor::getMethodString(procparams::RAWParams::XTransSensor::Method::FOUR_PASS) ) {
+                xtrans_interpolate (3, true, options.chunkSizeXT, options.measure);
+            } else {
+                xtrans_interpolate (1, false, options.chunkSizeXT, options.measure);
+            }
+            fast_xtrans_interpolate(rawData, redTmp, greenTmp, blueTmp);
         }
-        fast_xtrans_interpolate(rawData, redTmp, greenTmp, blueTmp);
+    }
+
+    if (useCache && !cached) {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < winh; ++i) {
+            for (int j = 0; j < winw; ++j) {
+                (*dualDemosaicCache)[0][i][j] = red[i][j];
+                (*dualDemosaicCache)[1][i][j] = green[i][j];
+                (*dualDemosaicCache)[2][i][j] = blue[i][j];
+            }
+        }
+
+        dualDemosaicKey = cacheKey;
     }
 
     const float xyz_rgb[3][3] = {          // XYZ from RGB
@@ -131,109 +131,35 @@ RawImage* ffInfo::getRawImage()
  */
 void ffInfo::updateRawImage()
 {
-    typedef unsigned int acc_t;
-
     // averaging of flatfields if more than one is found matching the same key.
     // this may not be necessary, as flatfield is further blurred before being applied to the processed image.
-    if( !pathNames.empty() ) {
-        std::list<Glib::ustring>::iterator iName = pathNames.begin();
-        ri = new RawImage(*iName); // First file used also for extra pixels information (width, height, shutter, filters etc.. )
-        if( ri->loadRaw(true)) {
-            delete ri;
-            ri = nullptr;
-        } else {
-            int H = ri->get_height();
-            int W = ri->get_width();
-            ri->compress_image(0);
-            int rSize = W * ((ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1) ? 1 : 3);
-            acc_t **acc = new acc_t*[H];
-
-            for( int row = 0; row < H; row++) {
-                acc[row] = new acc_t[rSize ];
-            }
-
-            // copy first image into accumulators
-            for (int row = 0; row < H; row++)
-                for (int col = 0; col < rSize; col++) {
-                    acc[row][col] = ri->data[row][col];
-                }
-
-            int nFiles = 1; // First file data already loaded
-
-            for( ++iName; iName != pathNames.end(); ++iName) {
-                RawImage* temp = new RawImage(*iName);
-
-                if( !temp->loadRaw(true)) {
-                    temp->compress_image(0);     //\ TODO would be better working on original, because is temporary
-                    nFiles++;
-
-                    if( ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1 ) {
-                        for( int row = 0; row < H; row++) {
-                            for( int col = 0; col < W; col++) {
-                                acc[row][col] += temp->data[row][col];
-                            }
-                        }
-                    } else {
-                        for( int row = 0; row < H; row++) {
-                            for( int col = 0; col < W; col++) {
-                                acc[row][3 * col + 0] += temp->data[row][3 * col + 0];
-                                acc[row][3 * col + 1] += temp->data[row][3 * col + 1];
-                                acc[row][3 * col + 2] += temp->data[row][3 * col + 2];
-                            }
-                        }
-                    }
-                }
-
-                delete temp;
-            }
-
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < rSize; col++) {
-                    ri->data[row][col] = acc[row][col] / nFiles;
-                }
-
-                delete [] acc[row];
-            }
-
-            delete [] acc;
-        }
-    } else {
-        ri = new RawImage(pathname);
-        if( ri->loadRaw(true)) {
-            delete ri;
-            ri = nullptr;
-        } else {
-            ri->compress_image(0);
-        }
-    }
-
-    if(ri) {
-        // apply median to avoid this step being executed each time a flat field gets applied
-        int H = ri->get_height();
-        int W = ri->get_width();
-        float *cfatmp = (float (*)) malloc (H * W * sizeof * cfatmp);
+    ri = loadMasterFrame(pathNames.empty() ? std::list<Glib::ustring>(1, pathname) : pathNames, "flat", [](RawImage& ri)
+        {
+            // apply median to avoid this step being executed each time a flat field gets applied
+            int H = ri.get_height();
+            int W = ri.get_width();
+            float *cfatmp = (float (*)) malloc (H * W * sizeof * cfatmp);
 
 #ifdef _OPENMP
-        #pragma omp parallel for schedule(dynamic,16)
+            #pragma omp parallel for schedule(dynamic,16)
 #endif
 
-        for (int i = 0; i < H; i++) {
-            int iprev = i < 2 ? i + 2 : i - 2;
-            int inext = i > H - 3 ? i - 2 : i + 2;
+            for (int i = 0; i < H; i++) {
+                int iprev = i < 2 ? i + 2 : i - 2;
+                int inext = i > H - 3 ? i - 2 : i + 2;
 
-            for (int j = 0; j < W; j++) {
-                int jprev = j < 2 ? j + 2 : j - 2;
-                int jnext = j > W - 3 ? j - 2 : j + 2;
+                for (int j = 0; j < W; j++) {
+                    int jprev = j < 2 ? j + 2 : j - 2;
+                    int jnext = j > W - 3 ? j - 2 : j + 2;
 
-                cfatmp[i * W + j] = median(ri->data[iprev][j], ri->data[i][jprev], ri->data[i][j], ri->data[i][jnext], ri->data[inext][j]);
+                    cfatmp[i * W + j] = median(ri.data[iprev][j], ri.data[i][jprev], ri.data[i][j], ri.data[i][jnext], ri.data[inext][j]);
+                }
             }
-        }
-
-        memcpy(ri->data[0], cfatmp, W * H * sizeof(float));
 
-        free (cfatmp);
+            memcpy(ri.data[0], cfatmp, W * H * sizeof(float));
 
-    }
+            free (cfatmp);
+        });
 }
 
 // ************************* class FFManager *********************************
@@ -262,6 +188,7 @@ void FFManager::init(const Glib::ustring& pathname)
     } catch (Glib::Exception&) {}
 
     ffList.clear();
+    index.load();
 
     for (size_t i = 0; i < names.size(); i++) {
         try {
@@ -269,6 +196,8 @@ void FFManager::init(const Glib::ustring& pathname)
         } catch( std::exception& e ) {}
     }
 
+    index.save();
+
     // Where multiple shots exist for same group, move filename to list
     for( ffList_t::iterator iter = ffList.begin(); iter != ffList.end(); ++iter ) {
         ffInfo &i = iter->second;
@@ -317,7 +246,7 @@ ffInfo* FFManager::addFileInfo (const Glib::ustring& filename, bool pool)
 
     try {
 
-        auto info = file->query_info("standard::name,standard::type,standard::is-hidden");
+        auto info = file->query_info("standard::name,standard::type,standard::is-hidden,standard::size,time::modified,time::modified-usec");
 
         if (!info || info->get_file_type() == Gio::FILE_TYPE_DIRECTORY) {
             return nullptr;
@@ -327,38 +256,76 @@ ffInfo* FFManager::addFileInfo (const Glib::ustring& filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
-
         ffList_t::iterator iter;
 
         if(!pool) {
+            RawImage ri(filename);
+
+            if (ri.loadRaw(false) != 0) {
+                return nullptr;
+            }
+
             ffInfo n(filename, "", "", "", 0, 0, 0);
             iter = ffList.emplace("", n);
             return &(iter->second);
         }
 
-        FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
+        // the index spares decoding the header of every frame of the directory at each start
+        const std::string stamp = getFrameStamp(info);
+        std::vector<std::string> fields;
+        std::string maker;
+        std::string model;
+        std::string lens;
+        double focallength;
+        double aperture;
+        double timestamp;
+        double rawTimestamp;
+
+        if (index.find(filename, stamp, fields)) {
+            // no fields for files which aren't raw files
+            if (fields.size() != 7 || !FrameIndex::fromField(fields[3], focallength) || !FrameIndex::fromField(fields[4], aperture)
+                    || !FrameIndex::fromField(fields[5], timestamp) || !FrameIndex::fromField(fields[6], rawTimestamp)) {
+                return nullptr;
+            }
+
+            maker = fields[0];
+            model = fields[1];
+            lens = fields[2];
+        } else {
+            RawImage ri(filename);
+
+            if (ri.loadRaw(false) != 0) { // Read information about shot
+                index.store(filename, stamp, {});
+                return nullptr;
+            }
+
+            FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
+            maker = idata.getMake();
+            model = idata.getModel();
+            lens = idata.getLens();
+            focallength = idata.getFocalLen();
+            aperture = idata.getFNumber();
+            timestamp = idata.getDateTimeAsTS();
+            rawTimestamp = ri.get_timestamp();
+            index.store(filename, stamp, {maker, model, lens, FrameIndex::toField(focallength), FrameIndex::toField(aperture), FrameIndex::toField(timestamp), FrameIndex::toField(rawTimestamp)});
+        }
+
         /* Files are added in the map, divided by same maker/model,lens and aperture*/
-        std::string key(ffInfo::key(idata.getMake(), idata.getModel(), idata.getLens(), idata.getFocalLen(), idata.getFNumber()));
+        std::string key(ffInfo::key(maker, model, lens, focallength, aperture));
         iter = ffList.find(key);
 
         if(iter == ffList.end()) {
-            ffInfo n(filename, idata.getMake(), idata.getModel(), idata.getLens(), idata.getFocalLen(), idata.getFNumber(), idata.getDateTimeAsTS());
+            ffInfo n(filename, maker, model, lens, focallength, aperture, timestamp);
             iter = ffList.emplace(key, n);
         } else {
-            while(iter != ffList.end() && iter->second.key() == key && ABS(iter->second.timestamp - ri.get_timestamp()) > 60 * 60 * 6) { // 6 hour difference
+            while(iter != ffList.end() && iter->second.key() == key && ABS(iter->second.timestamp - static_cast<time_t>(rawTimestamp)) > 60 * 60 * 6) { // 6 hour difference
                 ++iter;
             }
 
             if(iter != ffList.end()) {
                 iter->second.pathNames.push_back(filename);
             } else {
-                ffInfo n(filename, idata.getMake(), idata.getModel(), idata.getLens(), idata.getFocalLen(), idata.getFNumber(), idata.getDateTimeAsTS());
+                ffInfo n(filename, maker, model, lens, focallength, aperture, timestamp);
                 iter = ffList.emplace(key, n);
             }
         }
@@ -25,6 +25,8 @@
 
 #include <glibmm/ustring.h>
 
+#include "masterframe.h"
+
 namespace rtengine
 {
 
@@ -88,6 +90,7 @@ protected:
     ffList_t ffList;
     bool initialized;
     Glib::ustring currentPath;
+    FrameIndex index{"flatfields.index"};
     ffInfo *addFileInfo(const Glib::ustring &filename, bool pool = true );
     ffInfo *find( const std::string &mak, const std::string &mod, const std::string &len, double focal, double apert, time_t t );
 };
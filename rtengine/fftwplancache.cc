@@ -0,0 +1,234 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstdlib>
+
+#include <glib/gstdio.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+
+#include "fftwplancache.h"
+
+#include "settings.h"
+
+namespace
+{
+
+// Denoise needs four plans per tile geometry, Fattal two per image size
+constexpr std::size_t maxPlans = 32;
+
+enum PlanType {
+    MANY_R2R,
+    R2R_2D
+};
+
+}
+
+namespace rtengine
+{
+
+extern const Settings* settings;
+
+FFTWPlanCache::FFTWPlanCache() :
+    useCount(0),
+    threadsInitialized(false)
+{
+}
+
+FFTWPlanCache* FFTWPlanCache::getInstance()
+{
+    static FFTWPlanCache instance;
+    return &instance;
+}
+
+void FFTWPlanCache::init(const Glib::ustring& wisdomFile)
+{
+    MyMutex::MyLock lock(mutex);
+
+#ifdef RT_FFTW3F_OMP
+
+    if (!threadsInitialized) {
+        threadsInitialized = fftwf_init_threads();
+    }
+
+#endif
+
+    this->wisdomFile = wisdomFile;
+
+    if (wisdomFile.empty()) {
+        return;
+    }
+
+    try {
+        const std::string wisdom = Glib::file_get_contents(wisdomFile);
+
+        if (!fftwf_import_wisdom_from_string(wisdom.c_str()) && settings->verbose) {
+            printf("FFTW wisdom in \"%s\" is not usable\n", wisdomFile.c_str());
+        }
+    } catch (Glib::FileError&) {
+        // first run
+    }
+}
+
+void FFTWPlanCache::cleanup()
+{
+    std::map<std::vector<int>, Entry> oldPlans;
+
+    {
+        MyMutex::MyLock lock(mutex);
+        oldPlans.swap(plans);
+    }
+
+    // the deleters lock the mutex again
+    oldPlans.clear();
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::getManyR2R(int rank, const int* n, int howmany, int dist, const fftw_r2r_kind* kind, unsigned int flags, const float* in, const float* out)
+{
+    std::vector<int> key = {MANY_R2R, rank, howmany, dist, static_cast<int>(flags)};
+    std::size_t size = static_cast<std::size_t>(howmany - 1) * dist;
+    std::size_t transformSize = 1;
+
+    for (int i = 0; i < rank; ++i) {
+        key.push_back(n[i]);
+        key.push_back(kind[i]);
+        transformSize *= n[i];
+    }
+
+    size += transformSize;
+
+    return get(key, size, in, out, [ = ](float* scratchIn, float* scratchOut) {
+        return fftwf_plan_many_r2r(rank, n, howmany, scratchIn, nullptr, 1, dist, scratchOut, nullptr, 1, dist, kind, flags);
+    });
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::getR2R2D(int n0, int n1, fftw_r2r_kind kind0, fftw_r2r_kind kind1, unsigned int flags, int threads, const float* in, const float* out)
+{
+#ifndef RT_FFTW3F_OMP
+    threads = 1;
+#endif
+
+    std::vector<int> key = {R2R_2D, n0, n1, kind0, kind1, static_cast<int>(flags), threads};
+
+    return get(key, static_cast<std::size_t>(n0) * n1, in, out, [ = ](float* scratchIn, float* scratchOut) {
+#ifdef RT_FFTW3F_OMP
+
+        if (threadsInitialized) {
+            fftwf_plan_with_nthreads(threads);
+        }
+
+#endif
+        const fftwf_plan plan = fftwf_plan_r2r_2d(n0, n1, scratchIn, scratchOut, kind0, kind1, flags);
+#ifdef RT_FFTW3F_OMP
+
+        if (threadsInitialized) {
+            fftwf_plan_with_nthreads(1);
+        }
+
+#endif
+        return plan;
+    });
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::get(std::vector<int>& key, std::size_t size, const float* in, const float* out, const std::function<fftwf_plan (float*, float*)>& create)
+{
+    // SIMD code paths of a plan depend on the alignment of the arrays it was created for
+    const int inAlignment = fftwf_alignment_of(const_cast<float*>(in));
+    const int outAlignment = fftwf_alignment_of(const_cast<float*>(out));
+    key.push_back(inAlignment);
+    key.push_back(outAlignment);
+
+    Plan evicted;
+    MyMutex::MyLock lock(mutex);
+
+    ++useCount;
+
+    const auto it = plans.find(key);
+
+    if (it != plans.end()) {
+        it->second.lastUse = useCount;
+        return it->second.plan;
+    }
+
+    // plan on scratch arrays, measuring overwrites them
+    char* const scratchIn = static_cast<char*>(fftwf_malloc(size * sizeof(float) + inAlignment));
+    char* const scratchOut = static_cast<char*>(fftwf_malloc(size * sizeof(float) + outAlignment));
+
+    fftwf_plan plan = nullptr;
+
+    if (scratchIn && scratchOut) {
+        plan = create(reinterpret_cast<float*>(scratchIn + inAlignment), reinterpret_cast<float*>(scratchOut + outAlignment));
+    }
+
+    fftwf_free(scratchIn);
+    fftwf_free(scratchOut);
+
+    if (!plan) {
+        return nullptr;
+    }
+
+    const Plan result(plan, [this](fftwf_plan p) {
+        MyMutex::MyLock lock(mutex);
+        fftwf_destroy_plan(p);
+    });
+
+    if (plans.size() >= maxPlans) {
+        auto oldest = plans.begin();
+
+        for (auto entry = plans.begin(); entry != plans.end(); ++entry) {
+            if (entry->second.lastUse < oldest->second.lastUse) {
+                oldest = entry;
+            }
+        }
+
+        // destroyed after unlocking, unless still in use
+        evicted = std::move(oldest->second.plan);
+        plans.erase(oldest);
+    }
+
+    plans[key] = {result, useCount};
+
+    exportWisdom();
+
+    return result;
+}
+
+void FFTWPlanCache::exportWisdom() const
+{
+    if (wisdomFile.empty()) {
+        return;
+    }
+
+    char* const wisdom = fftwf_export_wisdom_to_string();
+
+    if (!wisdom) {
+        return;
+    }
+
+    try {
+        g_mkdir_with_parents(Glib::path_get_dirname(wisdomFile).c_str(), 0777);
+        Glib::file_set_contents(wisdomFile, wisdom);
+    } catch (Glib::FileError& e) {
+        if (settings->verbose) {
+            printf("Could not save FFTW wisdom to \"%s\": %s\n", wisdomFile.c_str(), e.what().c_str());
+        }
+    }
+
+    free(wisdom);
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <fftw3.h>
+
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/**
+ * Process wide cache of FFTW plans
+ *
+ * Plans are keyed by the transform geometry and the alignment of the arrays and kept until they
+ * fall out of the cache, so repeated jobs of the same size plan only once. All FFTW planner calls
+ * must go through here, the planner isn't thread safe. Plans are created on scratch arrays and
+ * have to be executed with the new-array execute functions (fftwf_execute_r2r) on arrays aligned
+ * like the ones passed on creation. Pass nullptr for arrays which will come from fftwf_malloc.
+ *
+ * The accumulated wisdom is exported to a file whenever new plans were measured and imported at
+ * startup, so later runs start warm.
+ */
+class FFTWPlanCache final :
+    public NonCopyable
+{
+public:
+    using Plan = std::shared_ptr<std::remove_pointer<fftwf_plan>::type>;
+
+    static FFTWPlanCache* getInstance();
+
+    /**
+     * @param wisdomFile file the wisdom is read from and written to, empty to not persist it
+     */
+    void init(const Glib::ustring& wisdomFile);
+    void cleanup();
+
+    /**
+     * @brief Plan of fftwf_plan_many_r2r for howmany contiguous transforms, dist floats apart, out of place
+     *
+     * @return the plan, nullptr if FFTW couldn't create it
+     */
+    Plan getManyR2R(int rank, const int* n, int howmany, int dist, const fftw_r2r_kind* kind, unsigned int flags, const float* in, const float* out);
+
+    /**
+     * @brief Plan of fftwf_plan_r2r_2d, out of place
+     *
+     * @param threads number of threads the plan uses, only effective if FFTW was built with OpenMP
+     * @return the plan, nullptr if FFTW couldn't create it
+     */
+    Plan getR2R2D(int n0, int n1, fftw_r2r_kind kind0, fftw_r2r_kind kind1, unsigned int flags, int threads, const float* in, const float* out);
+
+private:
+    struct Entry {
+        Plan plan;
+        std::uint64_t lastUse;
+    };
+
+    FFTWPlanCache();
+
+    Plan get(std::vector<int>& key, std::size_t size, const float* in, const float* out, const std::function<fftwf_plan (float*, float*)>& create);
+    void exportWisdom() const;
+
+    MyMutex mutex; // first, the plan deleters lock it while the plans are destroyed
+    std::map<std::vector<int>, Entry> plans;
+    std::uint64_t useCount;
+    Glib::ustring wisdomFile;
+    bool threadsInitialized;
+};
+
+}
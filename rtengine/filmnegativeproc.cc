@@ -77,7 +77,7 @@ bool channelsAvg(
 
             // Sample the original unprocessed values from RawImage, subtracting black levels.
             // Scaling is irrelevant, as we are only interested in the ratio between two spots.
-            avgs[ch] += ri->data[r][c] - cblacksom[ch];
+            avgs[ch] += ri->get_data(r, c) - cblacksom[ch];
         }
     }
 
@@ -160,6 +160,9 @@ void rtengine::RawImageSource::filmNegativeProcess(const procparams::FilmNegativ
         return;
     }
 
+    // the raw data changes
+    dualDemosaicCache.reset();
+
     // Exponents are expressed as positive in the parameters, so negate them in order
     // to get the reciprocals.
     const std::array<float, 3> exps = {
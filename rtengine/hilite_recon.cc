@@ -24,9 +24,11 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <vector>
 
 #include "array2D.h"
 #include "opthelper.h"
@@ -283,6 +285,59 @@ void boxblur_resamp(const float* const* src, float** dst, float** temp, int H, i
     }
 }
 
+// one step of the directional extension of the highlight weights: 1 where there is highlight data,
+// otherwise 0.1 if one of the 5 neighbours on the previous line has a weight
+void extendWeights(const float* hiliteWeight, const float* prevWeight, float* dst, int start, int end, float epsilon)
+{
+    int k = start;
+#ifdef __SSE2__
+    const vfloat epsilonv = F2V(epsilon);
+    const vfloat onev = F2V(1.f);
+    const vfloat zd1v = F2V(0.1f);
+
+    for (; k < end - 3; k += 4) {
+        const vfloat sumv = LVFU(prevWeight[k - 2]) + LVFU(prevWeight[k - 1]) + LVFU(prevWeight[k]) + LVFU(prevWeight[k + 1]) + LVFU(prevWeight[k + 2]);
+        const vfloat extv = vself(vmaskf_eq(sumv, ZEROV), ZEROV, zd1v);
+        STVFU(dst[k], vself(vmaskf_gt(LVFU(hiliteWeight[k]), epsilonv), onev, extv));
+    }
+#endif
+
+    for (; k < end; ++k) {
+        if (hiliteWeight[k] > epsilon) {
+            dst[k] = 1.f;
+        } else {
+            dst[k] = (prevWeight[k - 2] + prevWeight[k - 1] + prevWeight[k] + prevWeight[k + 1] + prevWeight[k + 2]) == 0.f ? 0.f : 0.1f;
+        }
+    }
+}
+
+// one step of the directional extension of a highlight colour channel: the normalized highlight data where there is some,
+// otherwise the weighted average of the 5 neighbours on the previous line
+void extendColour(const float* hiliteColour, const float* hiliteWeight, const float* prevColour, const float* prevWeight, float* dst, int start, int end, float epsilon)
+{
+    int k = start;
+#ifdef __SSE2__
+    const vfloat epsilonv = F2V(epsilon);
+    const vfloat zd1v = F2V(0.1f);
+
+    for (; k < end - 3; k += 4) {
+        const vfloat weightv = LVFU(hiliteWeight[k]);
+        const vfloat colourSumv = LVFU(prevColour[k - 2]) + LVFU(prevColour[k - 1]) + LVFU(prevColour[k]) + LVFU(prevColour[k + 1]) + LVFU(prevColour[k + 2]);
+        const vfloat weightSumv = LVFU(prevWeight[k - 2]) + LVFU(prevWeight[k - 1]) + LVFU(prevWeight[k]) + LVFU(prevWeight[k + 1]) + LVFU(prevWeight[k + 2]);
+        STVFU(dst[k], vself(vmaskf_gt(weightv, epsilonv), LVFU(hiliteColour[k]) / weightv, zd1v * (colourSumv / (weightSumv + epsilonv))));
+    }
+#endif
+
+    for (; k < end; ++k) {
+        if (hiliteWeight[k] > epsilon) {
+            dst[k] = hiliteColour[k] / hiliteWeight[k];
+        } else {
+            dst[k] = 0.1f * ((prevColour[k - 2] + prevColour[k - 1] + prevColour[k] + prevColour[k + 1] + prevColour[k + 2]) /
+                             (prevWeight[k - 2] + prevWeight[k - 1] + prevWeight[k] + prevWeight[k + 1] + prevWeight[k + 2] + epsilon));
+        }
+    }
+}
+
 }
 
 namespace rtengine
@@ -394,14 +449,27 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     int miny = height - 1;
     int maxy = 0;
 
-    #pragma omp parallel for reduction(min:minx,miny) reduction(max:maxx,maxy) schedule(dynamic, 16)
-    for (int i = 0; i < height; ++i) {
-        for (int j = 0; j< width; ++j) {
-            if (red[i][j] >= max_f[0] || green[i][j] >= max_f[1] || blue[i][j] >= max_f[2]) {
-                minx = std::min(minx, j);
-                maxx = std::max(maxx, j);
-                miny = std::min(miny, i);
-                maxy = std::max(maxy, i);
+    // the reconstruction only has to visit the tiles with clipped pixels
+    constexpr int tileSize = 64;
+    const int tilesW = (width + tileSize - 1) / tileSize;
+    const int tilesH = (height + tileSize - 1) / tileSize;
+    std::vector<char> clippedTiles(tilesW * tilesH, 0);
+
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(min:minx,miny) reduction(max:maxx,maxy) schedule(dynamic)
+#endif
+    for (int tileRow = 0; tileRow < tilesH; ++tileRow) {
+        char* const clippedRow = &clippedTiles[tileRow * tilesW];
+
+        for (int i = tileRow * tileSize; i < std::min((tileRow + 1) * tileSize, height); ++i) {
+            for (int j = 0; j < width; ++j) {
+                if (red[i][j] >= max_f[0] || green[i][j] >= max_f[1] || blue[i][j] >= max_f[2]) {
+                    minx = std::min(minx, j);
+                    maxx = std::max(maxx, j);
+                    miny = std::min(miny, i);
+                    maxy = std::max(maxy, i);
+                    clippedRow[j / tileSize] = 1;
+                }
             }
         }
     }
@@ -572,6 +640,20 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         hilite_full[c].free();    //free up some memory
     }
 
+    // the extensions from left and right run along the columns of the highlight map, transpose it for them
+    multi_array2D<float, 4> hiliteT(hfh + 1, hfw + 1);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int j = 0; j <= hfw; ++j) {
+        for (int i = 0; i <= hfh; ++i) {
+            for (int c = 0; c < 4; ++c) {
+                hiliteT[c][j][i] = hilite[c][i][j];
+            }
+        }
+    }
+
     multi_array2D<float, 8> hilite_dir(hfw, hfh, ARRAY2D_CLEAR_DATA, 64);
     // for faster processing we create two buffers using (height,width) instead of (width,height)
     multi_array2D<float, 4> hilite_dir0(hfh, hfw, ARRAY2D_CLEAR_DATA, 64);
@@ -585,14 +667,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     //fill gaps in highlight map by directional extension
     //raster scan from four corners
     for (int j = 1; j < hfw - 1; ++j) {
-        for (int i = 2; i < hfh - 2; ++i) {
-            //from left
-            if (hilite[3][i][j] > epsilon) {
-                hilite_dir0[3][j][i] = 1.f;
-            } else {
-                hilite_dir0[3][j][i] = (hilite_dir0[0 + 3][j - 1][i - 2] + hilite_dir0[0 + 3][j - 1][i - 1] + hilite_dir0[0 + 3][j - 1][i] + hilite_dir0[0 + 3][j - 1][i + 1] + hilite_dir0[0 + 3][j - 1][i + 2]) == 0.f ? 0.f : 0.1f;
-            }
-        }
+        //from left
+        extendWeights(hiliteT[3][j], hilite_dir0[3][j - 1], hilite_dir0[3][j], 2, hfh - 2, epsilon);
 
         if (hilite[3][2][j] <= epsilon) {
             hilite_dir[0 + 3][0][j]  = hilite_dir0[3][j][2];
@@ -626,15 +702,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 #endif
         for (int c = 0; c < 3; ++c) {
             for (int j = 1; j < hfw - 1; ++j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    //from left
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir0[c][j][i] = hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir0[c][j][i] = 0.1f * ((hilite_dir0[0 + c][j - 1][i - 2] + hilite_dir0[0 + c][j - 1][i - 1] + hilite_dir0[0 + c][j - 1][i] + hilite_dir0[0 + c][j - 1][i + 1] + hilite_dir0[0 + c][j - 1][i + 2]) /
-                                                       (hilite_dir0[0 + 3][j - 1][i - 2] + hilite_dir0[0 + 3][j - 1][i - 1] + hilite_dir0[0 + 3][j - 1][i] + hilite_dir0[0 + 3][j - 1][i + 1] + hilite_dir0[0 + 3][j - 1][i + 2] + epsilon));
-                    }
-                }
+                //from left
+                extendColour(hiliteT[c][j], hiliteT[3][j], hilite_dir0[c][j - 1], hilite_dir0[3][j - 1], hilite_dir0[c][j], 2, hfh - 2, epsilon);
 
                 if (hilite[3][2][j] <= epsilon) {
                     hilite_dir[0 + c][0][j]  = hilite_dir0[c][j][2];
@@ -665,14 +734,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 #endif
         {
             for (int j = hfw - 2; j > 0; --j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    //from right
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir4[3][j][i] = 1.f;
-                    } else {
-                        hilite_dir4[3][j][i] = (hilite_dir4[3][(j + 1)][(i - 2)] + hilite_dir4[3][(j + 1)][(i - 1)] + hilite_dir4[3][(j + 1)][(i)] + hilite_dir4[3][(j + 1)][(i + 1)] + hilite_dir4[3][(j + 1)][(i + 2)]) == 0.f ? 0.f : 0.1f;
-                    }
-                }
+                //from right
+                extendWeights(hiliteT[3][j], hilite_dir4[3][j + 1], hilite_dir4[3][j], 2, hfh - 2, epsilon);
 
                 if (hilite[3][2][j] <= epsilon) {
                     hilite_dir[0 + 3][0][j] += hilite_dir4[3][j][2];
@@ -715,15 +778,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 #endif
         for (int c = 0; c < 3; ++c) {
             for (int j = hfw - 2; j > 0; --j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    //from right
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir4[c][j][i] = hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir4[c][j][i] = 0.1f * ((hilite_dir4[c][(j + 1)][(i - 2)] + hilite_dir4[c][(j + 1)][(i - 1)] + hilite_dir4[c][(j + 1)][(i)] + hilite_dir4[c][(j + 1)][(i + 1)] + hilite_dir4[c][(j + 1)][(i + 2)]) /
-                                                      (hilite_dir4[3][(j + 1)][(i - 2)] + hilite_dir4[3][(j + 1)][(i - 1)] + hilite_dir4[3][(j + 1)][(i)] + hilite_dir4[3][(j + 1)][(i + 1)] + hilite_dir4[3][(j + 1)][(i + 2)] + epsilon));
-                    }
-                }
+                //from right
+                extendColour(hiliteT[c][j], hiliteT[3][j], hilite_dir4[c][j + 1], hilite_dir4[3][j + 1], hilite_dir4[c][j], 2, hfh - 2, epsilon);
 
                 if (hilite[3][2][j] <= epsilon) {
                     hilite_dir[0 + c][0][j] += hilite_dir4[c][j][2];
@@ -756,15 +812,10 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         #pragma omp single
 #endif
         {
-            for (int i = 1; i < hfh - 1; ++i)
-                for (int j = 2; j < hfw - 2; ++j) {
-                    //from top
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir[0 + 3][i][j] = 1.f;
-                    } else {
-                        hilite_dir[0 + 3][i][j] = (hilite_dir[0 + 3][i - 1][j - 2] + hilite_dir[0 + 3][i - 1][j - 1] + hilite_dir[0 + 3][i - 1][j] + hilite_dir[0 + 3][i - 1][j + 1] + hilite_dir[0 + 3][i - 1][j + 2]) == 0.f ? 0.f : 0.1f;
-                    }
-                }
+            for (int i = 1; i < hfh - 1; ++i) {
+                //from top
+                extendWeights(hilite[3][i], hilite_dir[0 + 3][i - 1], hilite_dir[0 + 3][i], 2, hfw - 2, epsilon);
+            }
 
             for (int j = 2; j < hfw - 2; ++j) {
                 if (hilite[3][hfh - 2][j] <= epsilon) {
@@ -787,15 +838,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 #endif
         for (int c = 0; c < 3; ++c) {
             for (int i = 1; i < hfh - 1; ++i) {
-                for (int j = 2; j < hfw - 2; ++j) {
-                    //from top
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir[0 + c][i][j] = hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir[0 + c][i][j] = 0.1f * ((hilite_dir[0 + c][i - 1][j - 2] + hilite_dir[0 + c][i - 1][j - 1] + hilite_dir[0 + c][i - 1][j] + hilite_dir[0 + c][i - 1][j + 1] + hilite_dir[0 + c][i - 1][j + 2]) /
-                                                         (hilite_dir[0 + 3][i - 1][j - 2] + hilite_dir[0 + 3][i - 1][j - 1] + hilite_dir[0 + 3][i - 1][j] + hilite_dir[0 + 3][i - 1][j + 1] + hilite_dir[0 + 3][i - 1][j + 2] + epsilon));
-                    }
-                }
+                //from top
+                extendColour(hilite[c][i], hilite[3][i], hilite_dir[0 + c][i - 1], hilite_dir[0 + 3][i - 1], hilite_dir[0 + c][i], 2, hfw - 2, epsilon);
             }
 
             for (int j = 2; j < hfw - 2; ++j) {
@@ -810,14 +854,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         #pragma omp single
 #endif
         for (int i = hfh - 2; i > 0; --i) {
-            for (int j = 2; j < hfw - 2; ++j) {
-                //from bottom
-                if (hilite[3][i][j] > epsilon) {
-                    hilite_dir[4 + 3][i][j] = 1.f;
-                } else {
-                    hilite_dir[4 + 3][i][j] = (hilite_dir[4 + 3][(i + 1)][(j - 2)] + hilite_dir[4 + 3][(i + 1)][(j - 1)] + hilite_dir[4 + 3][(i + 1)][(j)] + hilite_dir[4 + 3][(i + 1)][(j + 1)] + hilite_dir[4 + 3][(i + 1)][(j + 2)]) == 0.f ? 0.f : 0.1f;
-                }
-            }
+            //from bottom
+            extendWeights(hilite[3][i], hilite_dir[4 + 3][i + 1], hilite_dir[4 + 3][i], 2, hfw - 2, epsilon);
         }
     }
 
@@ -829,20 +867,18 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 #ifdef _OPENMP
     #pragma omp parallel for
 #endif
-    for (int c = 0; c < 4; ++c) {
+    for (int c = 0; c < 3; ++c) {
         for (int i = hfh - 2; i > 0; --i) {
-            for (int j = 2; j < hfw - 2; ++j) {
-                //from bottom
-                if (hilite[3][i][j] > epsilon) {
-                    hilite_dir[4 + c][i][j] = hilite[c][i][j] / hilite[3][i][j];
-                } else {
-                    hilite_dir[4 + c][i][j] = 0.1f * ((hilite_dir[4 + c][(i + 1)][(j - 2)] + hilite_dir[4 + c][(i + 1)][(j - 1)] + hilite_dir[4 + c][(i + 1)][(j)] + hilite_dir[4 + c][(i + 1)][(j + 1)] + hilite_dir[4 + c][(i + 1)][(j + 2)]) /
-                                                     (hilite_dir[4 + 3][(i + 1)][(j - 2)] + hilite_dir[4 + 3][(i + 1)][(j - 1)] + hilite_dir[4 + 3][(i + 1)][(j)] + hilite_dir[4 + 3][(i + 1)][(j + 1)] + hilite_dir[4 + 3][(i + 1)][(j + 2)] + epsilon));
-                }
-            }
+            //from bottom
+            extendColour(hilite[c][i], hilite[3][i], hilite_dir[4 + c][i + 1], hilite_dir[4 + 3][i + 1], hilite_dir[4 + c][i], 2, hfw - 2, epsilon);
         }
     }
 
+    // the weights are refined in place, so this must not run before the colour channels are done
+    for (int i = hfh - 2; i > 0; --i) {
+        extendColour(hilite[3][i], hilite[3][i], hilite_dir[4 + 3][i + 1], hilite_dir[4 + 3][i + 1], hilite_dir[4 + 3][i], 2, hfw - 2, epsilon);
+    }
+
     if (plistener) {
         progress += 0.05;
         plistener->setProgress(progress);
@@ -922,199 +958,209 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     //free up some memory
     for (int c = 0; c < 4; ++c) {
         hilite[c].free();
+        hiliteT[c].free();
     }
 
     //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
     // now reconstruct clipped channels using color ratios
 
 #ifdef _OPENMP
-    #pragma omp parallel for schedule(dynamic,16)
+    #pragma omp parallel for schedule(dynamic)
 #endif
-    for (int i = 0; i < blurHeight; ++i) {
-        const int i1 = min((i - i % pitch) / pitch, hfh - 1);
+    for (int tile = 0; tile < tilesW * tilesH; ++tile) {
+        if (!clippedTiles[tile]) {
+            continue;
+        }
 
-        for (int j = 0; j < blurWidth; ++j) {
-            const float pixel[3] = {
-                red[i + miny][j + minx],
-                green[i + miny][j + minx],
-                blue[i + miny][j + minx]
-            };
-
-            if (pixel[0] < max_f[0] && pixel[1] < max_f[1] && pixel[2] < max_f[2]) {
-                continue;    //pixel not clipped
-            }
+        const int tileY = (tile / tilesW) * tileSize - miny;
+        const int tileX = (tile % tilesW) * tileSize - minx;
 
-            const int j1 = min((j - j % pitch) / pitch, hfw - 1);
+        for (int i = tileY; i < std::min(tileY + tileSize, blurHeight); ++i) {
+            const int i1 = min((i - i % pitch) / pitch, hfh - 1);
 
-            //estimate recovered values using modified HLRecovery_blend algorithm
-            float rgb[3] = {
-                pixel[0],
-                pixel[1],
-                pixel[2]
-            };// Copy input pixel to rgb so it's easier to access in loops
-            float rgb_blend[3] = {};
-            float cam[2][3];
-            float lab[2][3];
-            float sum[2];
+            for (int j = tileX; j < std::min(tileX + tileSize, blurWidth); ++j) {
+                const float pixel[3] = {
+                    red[i + miny][j + minx],
+                    green[i + miny][j + minx],
+                    blue[i + miny][j + minx]
+                };
 
-            // Initialize cam with raw input [0] and potentially clipped input [1]
-            for (int c = 0; c < 3; ++c) {
-                cam[0][c] = rgb[c];
-                cam[1][c] = min(cam[0][c], clippt);
-            }
+                if (pixel[0] < max_f[0] && pixel[1] < max_f[1] && pixel[2] < max_f[2]) {
+                    continue;    //pixel not clipped
+                }
 
-            // Calculate the lightness correction ratio (chratio)
-            for (int i2 = 0; i2 < 2; ++i2) {
-                for (int c = 0; c < 3; ++c) {
-                    lab[i2][c] = 0;
+                const int j1 = min((j - j % pitch) / pitch, hfw - 1);
 
-                    for (int j2 = 0; j2 < 3; ++j2) {
-                        lab[i2][c] += trans[c][j2] * cam[i2][j2];
-                    }
+                //estimate recovered values using modified HLRecovery_blend algorithm
+                float rgb[3] = {
+                    pixel[0],
+                    pixel[1],
+                    pixel[2]
+                };// Copy input pixel to rgb so it's easier to access in loops
+                float rgb_blend[3] = {};
+                float cam[2][3];
+                float lab[2][3];
+                float sum[2];
+
+                // Initialize cam with raw input [0] and potentially clipped input [1]
+                for (int c = 0; c < 3; ++c) {
+                    cam[0][c] = rgb[c];
+                    cam[1][c] = min(cam[0][c], clippt);
                 }
 
-                sum[i2] = 0.f;
+                // Calculate the lightness correction ratio (chratio)
+                for (int i2 = 0; i2 < 2; ++i2) {
+                    for (int c = 0; c < 3; ++c) {
+                        lab[i2][c] = 0;
 
-                for (int c = 1; c < 3; ++c) {
-                    sum[i2] += SQR(lab[i2][c]);
-                }
-            }
+                        for (int j2 = 0; j2 < 3; ++j2) {
+                            lab[i2][c] += trans[c][j2] * cam[i2][j2];
+                        }
+                    }
 
-            // avoid division by zero
-            sum[0] = std::max(sum[0], epsilon);
+                    sum[i2] = 0.f;
 
-            const float chratio = sqrtf(sum[1] / sum[0]);
+                    for (int c = 1; c < 3; ++c) {
+                        sum[i2] += SQR(lab[i2][c]);
+                    }
+                }
 
-            // Apply ratio to lightness in lab space
-            for (int c = 1; c < 3; ++c) {
-                lab[0][c] *= chratio;
-            }
+                // avoid division by zero
+                sum[0] = std::max(sum[0], epsilon);
 
-            // Transform back from lab to RGB
-            for (int c = 0; c < 3; ++c) {
-                cam[0][c] = 0.f;
+                const float chratio = sqrtf(sum[1] / sum[0]);
 
-                for (int j2 = 0; j2 < 3; ++j2) {
-                    cam[0][c] += itrans[c][j2] * lab[0][j2];
+                // Apply ratio to lightness in lab space
+                for (int c = 1; c < 3; ++c) {
+                    lab[0][c] *= chratio;
                 }
-            }
 
-            for (int c = 0; c < 3; ++c) {
-                rgb[c] = cam[0][c] / 3;
-            }
+                // Transform back from lab to RGB
+                for (int c = 0; c < 3; ++c) {
+                    cam[0][c] = 0.f;
 
-            // Copy converted pixel back
-            if (pixel[0] > blendpt) {
-                const float rfrac = LIM01(medFactor[0] * (pixel[0] - blendpt));
-                rgb_blend[0] = rfrac * rgb[0] + (1.f - rfrac) * pixel[0];
-            }
+                    for (int j2 = 0; j2 < 3; ++j2) {
+                        cam[0][c] += itrans[c][j2] * lab[0][j2];
+                    }
+                }
 
-            if (pixel[1] > blendpt) {
-                const float gfrac = LIM01(medFactor[1] * (pixel[1] - blendpt));
-                rgb_blend[1] = gfrac * rgb[1] + (1.f - gfrac) * pixel[1];
-            }
+                for (int c = 0; c < 3; ++c) {
+                    rgb[c] = cam[0][c] / 3;
+                }
 
-            if (pixel[2] > blendpt) {
-                const float bfrac = LIM01(medFactor[2] * (pixel[2] - blendpt));
-                rgb_blend[2] = bfrac * rgb[2] + (1.f - bfrac) * pixel[2];
-            }
+                // Copy converted pixel back
+                if (pixel[0] > blendpt) {
+                    const float rfrac = LIM01(medFactor[0] * (pixel[0] - blendpt));
+                    rgb_blend[0] = rfrac * rgb[0] + (1.f - rfrac) * pixel[0];
+                }
 
-            //end of HLRecovery_blend estimation
-            //%%%%%%%%%%%%%%%%%%%%%%%
+                if (pixel[1] > blendpt) {
+                    const float gfrac = LIM01(medFactor[1] * (pixel[1] - blendpt));
+                    rgb_blend[1] = gfrac * rgb[1] + (1.f - gfrac) * pixel[1];
+                }
 
-            //there are clipped highlights
-            //first, determine weighted average of unclipped extensions (weighting is by 'hue' proximity)
-            bool totwt = false;
-            float clipfix[3] = {0.f, 0.f, 0.f};
+                if (pixel[2] > blendpt) {
+                    const float bfrac = LIM01(medFactor[2] * (pixel[2] - blendpt));
+                    rgb_blend[2] = bfrac * rgb[2] + (1.f - bfrac) * pixel[2];
+                }
 
-            float Y = epsilon + rgb_blend[0] + rgb_blend[1] + rgb_blend[2];
+                //end of HLRecovery_blend estimation
+                //%%%%%%%%%%%%%%%%%%%%%%%
 
-            for (int c = 0; c < 3; ++c) {
-                rgb_blend[c] /= Y;
-            }
+                //there are clipped highlights
+                //first, determine weighted average of unclipped extensions (weighting is by 'hue' proximity)
+                bool totwt = false;
+                float clipfix[3] = {0.f, 0.f, 0.f};
 
-            float Yhi = 1.f / (hilite_dir0[0][j1][i1] + hilite_dir0[1][j1][i1] + hilite_dir0[2][j1][i1]);
+                float Y = epsilon + rgb_blend[0] + rgb_blend[1] + rgb_blend[2];
 
-            if (Yhi < 2.f) {
-                const float dirwt = 1.f / ((1.f + 65535.f * (SQR(rgb_blend[0] - hilite_dir0[0][j1][i1] * Yhi) +
-                                                      SQR(rgb_blend[1] - hilite_dir0[1][j1][i1] * Yhi) +
-                                                      SQR(rgb_blend[2] - hilite_dir0[2][j1][i1] * Yhi))) * (hilite_dir0[3][j1][i1] + epsilon));
-                totwt = true;
-                clipfix[0] = dirwt * hilite_dir0[0][j1][i1];
-                clipfix[1] = dirwt * hilite_dir0[1][j1][i1];
-                clipfix[2] = dirwt * hilite_dir0[2][j1][i1];
-            }
+                for (int c = 0; c < 3; ++c) {
+                    rgb_blend[c] /= Y;
+                }
 
-            for (int dir = 0; dir < 2; ++dir) {
-                const float Yhi2 = 1.f / ( hilite_dir[dir * 4 + 0][i1][j1] + hilite_dir[dir * 4 + 1][i1][j1] + hilite_dir[dir * 4 + 2][i1][j1]);
+                float Yhi = 1.f / (hilite_dir0[0][j1][i1] + hilite_dir0[1][j1][i1] + hilite_dir0[2][j1][i1]);
 
-                if (Yhi2 < 2.f) {
-                    const float dirwt = 1.f / ((1.f + 65535.f * (SQR(rgb_blend[0] - hilite_dir[dir * 4 + 0][i1][j1] * Yhi2) +
-                                                          SQR(rgb_blend[1] - hilite_dir[dir * 4 + 1][i1][j1] * Yhi2) +
-                                                          SQR(rgb_blend[2] - hilite_dir[dir * 4 + 2][i1][j1] * Yhi2))) * (hilite_dir[dir * 4 + 3][i1][j1] + epsilon));
+                if (Yhi < 2.f) {
+                    const float dirwt = 1.f / ((1.f + 65535.f * (SQR(rgb_blend[0] - hilite_dir0[0][j1][i1] * Yhi) +
+                                                          SQR(rgb_blend[1] - hilite_dir0[1][j1][i1] * Yhi) +
+                                                          SQR(rgb_blend[2] - hilite_dir0[2][j1][i1] * Yhi))) * (hilite_dir0[3][j1][i1] + epsilon));
                     totwt = true;
-                    clipfix[0] += dirwt * hilite_dir[dir * 4 + 0][i1][j1];
-                    clipfix[1] += dirwt * hilite_dir[dir * 4 + 1][i1][j1];
-                    clipfix[2] += dirwt * hilite_dir[dir * 4 + 2][i1][j1];
+                    clipfix[0] = dirwt * hilite_dir0[0][j1][i1];
+                    clipfix[1] = dirwt * hilite_dir0[1][j1][i1];
+                    clipfix[2] = dirwt * hilite_dir0[2][j1][i1];
                 }
-            }
-
-
-            Yhi = 1.f / (hilite_dir4[0][j1][i1] + hilite_dir4[1][j1][i1] + hilite_dir4[2][j1][i1]);
 
-            if (Yhi < 2.f) {
-                const float dirwt = 1.f / ((1.f + 65535.f * (SQR(rgb_blend[0] - hilite_dir4[0][j1][i1] * Yhi) +
-                                                      SQR(rgb_blend[1] - hilite_dir4[1][j1][i1] * Yhi) +
-                                                      SQR(rgb_blend[2] - hilite_dir4[2][j1][i1] * Yhi))) * (hilite_dir4[3][j1][i1] + epsilon));
-                totwt = true;
-                clipfix[0] += dirwt * hilite_dir4[0][j1][i1];
-                clipfix[1] += dirwt * hilite_dir4[1][j1][i1];
-                clipfix[2] += dirwt * hilite_dir4[2][j1][i1];
-            }
+                for (int dir = 0; dir < 2; ++dir) {
+                    const float Yhi2 = 1.f / ( hilite_dir[dir * 4 + 0][i1][j1] + hilite_dir[dir * 4 + 1][i1][j1] + hilite_dir[dir * 4 + 2][i1][j1]);
+
+                    if (Yhi2 < 2.f) {
+                        const float dirwt = 1.f / ((1.f + 65535.f * (SQR(rgb_blend[0] - hilite_dir[dir * 4 + 0][i1][j1] * Yhi2) +
+                                                              SQR(rgb_blend[1] - hilite_dir[dir * 4 + 1][i1][j1] * Yhi2) +
+                                                              SQR(rgb_blend[2] - hilite_dir[dir * 4 + 2][i1][j1] * Yhi2))) * (hilite_dir[dir * 4 + 3][i1][j1] + epsilon));
+                        totwt = true;
+                        clipfix[0] += dirwt * hilite_dir[dir * 4 + 0][i1][j1];
+                        clipfix[1] += dirwt * hilite_dir[dir * 4 + 1][i1][j1];
+                        clipfix[2] += dirwt * hilite_dir[dir * 4 + 2][i1][j1];
+                    }
+                }
 
-            if (UNLIKELY(!totwt)) {
-                continue;
-            }
 
-            //now correct clipped channels
-            if (pixel[0] > max_f[0] && pixel[1] > max_f[1] && pixel[2] > max_f[2]) {
-                //all channels clipped
-
-                const float mult = whitept / (0.299f * clipfix[0] + 0.587f * clipfix[1] + 0.114f * clipfix[2]);
-                red[i + miny][j + minx]   = clipfix[0] * mult;
-                green[i + miny][j + minx] = clipfix[1] * mult;
-                blue[i + miny][j + minx]  = clipfix[2] * mult;
-            } else {//some channels clipped
-                const float notclipped[3] = {
-                    pixel[0] <= max_f[0] ? 1.f : 0.f,
-                    pixel[1] <= max_f[1] ? 1.f : 0.f,
-                    pixel[2] <= max_f[2] ? 1.f : 0.f
-                };
+                Yhi = 1.f / (hilite_dir4[0][j1][i1] + hilite_dir4[1][j1][i1] + hilite_dir4[2][j1][i1]);
 
-                if (notclipped[0] == 0.f) { //red clipped
-                    red[i + miny][j + minx]  = max(pixel[0], clipfix[0] * ((notclipped[1] * pixel[1] + notclipped[2] * pixel[2]) /
-                                                 (notclipped[1] * clipfix[1] + notclipped[2] * clipfix[2] + epsilon)));
+                if (Yhi < 2.f) {
+                    const float dirwt = 1.f / ((1.f + 65535.f * (SQR(rgb_blend[0] - hilite_dir4[0][j1][i1] * Yhi) +
+                                                          SQR(rgb_blend[1] - hilite_dir4[1][j1][i1] * Yhi) +
+                                                          SQR(rgb_blend[2] - hilite_dir4[2][j1][i1] * Yhi))) * (hilite_dir4[3][j1][i1] + epsilon));
+                    totwt = true;
+                    clipfix[0] += dirwt * hilite_dir4[0][j1][i1];
+                    clipfix[1] += dirwt * hilite_dir4[1][j1][i1];
+                    clipfix[2] += dirwt * hilite_dir4[2][j1][i1];
                 }
 
-                if (notclipped[1] == 0.f) { //green clipped
-                    green[i + miny][j + minx] = max(pixel[1], clipfix[1] * ((notclipped[2] * pixel[2] + notclipped[0] * pixel[0]) /
-                                                    (notclipped[2] * clipfix[2] + notclipped[0] * clipfix[0] + epsilon)));
+                if (UNLIKELY(!totwt)) {
+                    continue;
                 }
 
-                if (notclipped[2] == 0.f) { //blue clipped
-                    blue[i + miny][j + minx]  = max(pixel[2], clipfix[2] * ((notclipped[0] * pixel[0] + notclipped[1] * pixel[1]) /
-                                                   (notclipped[0] * clipfix[0] + notclipped[1] * clipfix[1] + epsilon)));
+                //now correct clipped channels
+                if (pixel[0] > max_f[0] && pixel[1] > max_f[1] && pixel[2] > max_f[2]) {
+                    //all channels clipped
+
+                    const float mult = whitept / (0.299f * clipfix[0] + 0.587f * clipfix[1] + 0.114f * clipfix[2]);
+                    red[i + miny][j + minx]   = clipfix[0] * mult;
+                    green[i + miny][j + minx] = clipfix[1] * mult;
+                    blue[i + miny][j + minx]  = clipfix[2] * mult;
+                } else {//some channels clipped
+                    const float notclipped[3] = {
+                        pixel[0] <= max_f[0] ? 1.f : 0.f,
+                        pixel[1] <= max_f[1] ? 1.f : 0.f,
+                        pixel[2] <= max_f[2] ? 1.f : 0.f
+                    };
+
+                    if (notclipped[0] == 0.f) { //red clipped
+                        red[i + miny][j + minx]  = max(pixel[0], clipfix[0] * ((notclipped[1] * pixel[1] + notclipped[2] * pixel[2]) /
+                                                     (notclipped[1] * clipfix[1] + notclipped[2] * clipfix[2] + epsilon)));
+                    }
+
+                    if (notclipped[1] == 0.f) { //green clipped
+                        green[i + miny][j + minx] = max(pixel[1], clipfix[1] * ((notclipped[2] * pixel[2] + notclipped[0] * pixel[0]) /
+                                                        (notclipped[2] * clipfix[2] + notclipped[0] * clipfix[0] + epsilon)));
+                    }
+
+                    if (notclipped[2] == 0.f) { //blue clipped
+                        blue[i + miny][j + minx]  = max(pixel[2], clipfix[2] * ((notclipped[0] * pixel[0] + notclipped[1] * pixel[1]) /
+                                                       (notclipped[0] * clipfix[0] + notclipped[1] * clipfix[1] + epsilon)));
+                    }
                 }
-            }
 
-            Y = 0.299f * red[i + miny][j + minx] + 0.587f * green[i + miny][j + minx] + 0.114f * blue[i + miny][j + minx];
+                Y = 0.299f * red[i + miny][j + minx] + 0.587f * green[i + miny][j + minx] + 0.114f * blue[i + miny][j + minx];
 
-            if (Y > whitept) {
-                const float mult = whitept / Y;
+                if (Y > whitept) {
+                    const float mult = whitept / Y;
 
-                red[i + miny][j + minx]   *= mult;
-                green[i + miny][j + minx] *= mult;
-                blue[i + miny][j + minx]  *= mult;
+                    red[i + miny][j + minx]   *= mult;
+                    green[i + miny][j + minx] *= mult;
+                    blue[i + miny][j + minx]  *= mult;
+                }
             }
         }
     }
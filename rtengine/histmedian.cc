@@ -0,0 +1,228 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "histmedian.h"
+
+#include "rt_math.h"
+
+namespace
+{
+
+constexpr int fineBits = 6;
+constexpr int coarseBins = 64;
+constexpr int fineBins = 1 << fineBits;
+constexpr int levels = coarseBins * fineBins;
+
+// 128 columns plus the window keep the column histograms of a thread in the L2 cache for small radii
+constexpr int stripWidth = 128;
+
+struct Histogram {
+    std::uint16_t coarse[coarseBins];
+    std::uint16_t fine[coarseBins][fineBins];
+};
+
+inline void add(std::uint16_t* dst, const std::uint16_t* src, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+inline void sub(std::uint16_t* dst, const std::uint16_t* src, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i] -= src[i];
+    }
+}
+
+}
+
+namespace rtengine
+{
+
+void histogramMedian(const float* const* src, float** dst, int W, int H, int radius, int numThreads)
+{
+    float minVal = RT_INFINITY_F;
+    float maxVal = -RT_INFINITY_F;
+
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(min:minVal) reduction(max:maxVal) num_threads(numThreads) if (numThreads > 1)
+#endif
+
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            minVal = std::min(minVal, src[y][x]);
+            maxVal = std::max(maxVal, src[y][x]);
+        }
+    }
+
+    if (!(maxVal > minVal)) { // flat image, or empty
+        for (int y = 0; y < H; ++y) {
+            std::copy(src[y], src[y] + W, dst[y]);
+        }
+
+        return;
+    }
+
+    const std::size_t size = static_cast<std::size_t>(W) * H;
+    // the quantization only selects the level holding the median, its exact value is taken from src
+    const float scale = (levels - 1) / (maxVal - minVal);
+    std::vector<std::uint16_t> quantized(size);
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numThreads) if (numThreads > 1)
+#endif
+
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            quantized[static_cast<std::size_t>(y) * W + x] = std::min<int>((src[y][x] - minVal) * scale + 0.5f, levels - 1);
+        }
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(numThreads) if (numThreads > 1)
+#endif
+    {
+        std::vector<Histogram> columns(std::min(stripWidth + 2 * radius, W));
+        Histogram kernel;
+        int lastUpdate[coarseBins];
+        std::vector<float> candidates;
+
+        const auto addRow =
+            [&](int y, int c0, int c1, int delta) -> void
+            {
+                const std::uint16_t* row = &quantized[static_cast<std::size_t>(y) * W];
+
+                for (int c = c0; c < c1; ++c) {
+                    Histogram& column = columns[c - c0];
+                    column.coarse[row[c] >> fineBits] += delta;
+                    column.fine[row[c] >> fineBits][row[c] & (fineBins - 1)] += delta;
+                }
+            };
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+
+        for (int x0 = 0; x0 < W; x0 += stripWidth) {
+            const int x1 = std::min(x0 + stripWidth, W);
+            // column histograms of the strip and the window overlap
+            const int c0 = std::max(x0 - radius, 0);
+            const int c1 = std::min(x1 + radius, W);
+
+            std::memset(columns.data(), 0, (c1 - c0) * sizeof(Histogram));
+
+            for (int y = 0; y < std::min(radius, H); ++y) {
+                addRow(y, c0, c1, 1);
+            }
+
+            for (int y = 0; y < H; ++y) {
+                if (y + radius < H) {
+                    addRow(y + radius, c0, c1, 1);
+                }
+
+                if (y - radius - 1 >= 0) {
+                    addRow(y - radius - 1, c0, c1, -1);
+                }
+
+                const int rows = std::min(y + radius, H - 1) - std::max(y - radius, 0) + 1;
+
+                // the fine bins of the kernel are only brought up to date for the coarse bin of the median
+                std::memset(kernel.coarse, 0, sizeof(kernel.coarse));
+                std::fill_n(lastUpdate, coarseBins, x0 - 2 * radius - 2);
+
+                for (int c = std::max(x0 - radius, 0); c <= std::min(x0 + radius, W - 1); ++c) {
+                    add(kernel.coarse, columns[c - c0].coarse, coarseBins);
+                }
+
+                for (int x = x0; x < x1; ++x) {
+                    if (x > x0) {
+                        if (x + radius < W) {
+                            add(kernel.coarse, columns[x + radius - c0].coarse, coarseBins);
+                        }
+
+                        if (x - radius - 1 >= 0) {
+                            sub(kernel.coarse, columns[x - radius - 1 - c0].coarse, coarseBins);
+                        }
+                    }
+
+                    const int cols = std::min(x + radius, W - 1) - std::max(x - radius, 0) + 1;
+                    int rank = rows * cols / 2;
+                    int bin = 0;
+
+                    while (rank >= kernel.coarse[bin]) {
+                        rank -= kernel.coarse[bin];
+                        ++bin;
+                    }
+
+                    std::uint16_t* fine = kernel.fine[bin];
+
+                    if (x - lastUpdate[bin] > 2 * radius + 1) {
+                        // no overlap with the window of the last update
+                        std::memset(fine, 0, sizeof(kernel.fine[bin]));
+
+                        for (int c = std::max(x - radius, 0); c <= std::min(x + radius, W - 1); ++c) {
+                            add(fine, columns[c - c0].fine[bin], fineBins);
+                        }
+                    } else {
+                        for (int xx = lastUpdate[bin] + 1; xx <= x; ++xx) {
+                            if (xx + radius < W) {
+                                add(fine, columns[xx + radius - c0].fine[bin], fineBins);
+                            }
+
+                            if (xx - radius - 1 >= 0) {
+                                sub(fine, columns[xx - radius - 1 - c0].fine[bin], fineBins);
+                            }
+                        }
+                    }
+
+                    lastUpdate[bin] = x;
+
+                    int level = 0;
+
+                    while (rank >= fine[level]) {
+                        rank -= fine[level];
+                        ++level;
+                    }
+
+                    // second pass over the window, only for the values of the median level
+                    const std::uint16_t code = (bin << fineBits) + level;
+                    candidates.clear();
+
+                    for (int yy = std::max(y - radius, 0); yy <= std::min(y + radius, H - 1); ++yy) {
+                        const std::uint16_t* const row = &quantized[static_cast<std::size_t>(yy) * W];
+
+                        for (int xx = std::max(x - radius, 0); xx <= std::min(x + radius, W - 1); ++xx) {
+                            if (row[xx] == code) {
+                                candidates.push_back(src[yy][xx]);
+                            }
+                        }
+                    }
+
+                    std::nth_element(candidates.begin(), candidates.begin() + rank, candidates.end());
+                    dst[y][x] = candidates[rank];
+                }
+            }
+        }
+    }
+}
+
+}
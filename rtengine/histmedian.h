@@ -0,0 +1,41 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace rtengine
+{
+
+/**
+ * @brief Median over the (2 * radius + 1)^2 window around each pixel, using sliding histograms
+ *
+ * Perreault and Hébert, "Median Filtering in Constant Time": every column keeps a histogram of the
+ * window rows, the window histogram slides along the row by adding and removing column histograms.
+ * The histograms work on the values quantized to 12 bit between the minimum and maximum of src, with
+ * a coarse level of 64 bins and fine bins which are only updated for the coarse bin holding the median.
+ * They select the level of the median, its exact value is then picked from the window values of that
+ * level, so the result is the same as the one of a sort based median. Only that pick depends on the
+ * window size, it compares 16 bit codes and sorts just the few values sharing the level of the median.
+ * Windows are clipped at the borders. Meant for windows larger than the sorting networks of median.h,
+ * radius must not exceed 100.
+ *
+ * @param src source image, may not be the same as dst
+ * @param dst destination image
+ * @param numThreads number of threads, the filter runs on vertical strips
+ */
+void histogramMedian(const float* const* src, float** dst, int W, int H, int radius, int numThreads);
+
+}
@@ -29,6 +29,7 @@
 #include "imagedata.h"
 #include "imagesource.h"
 #include "iptcpairs.h"
+#include "myfile.h"
 #include "procparams.h"
 #include "rt_math.h"
 #include "utils.h"
@@ -53,6 +54,26 @@ Glib::ustring to_utf8 (const std::string& str)
     }
 }
 
+// Everything FrameData and the fix-ups of rtexif::ExifManager::parse() look for in IFD0, the sub-IFDs and the Exif directory
+const rtexif::TagFilter& getSummaryFilter()
+{
+    static const rtexif::TagFilter filter {
+        // camera and frames
+        "Make", "Model", "UniqueCameraModel", "LocalizedCameraModel", "Orientation", "Rating", "ApplicationNotes",
+        "NewSubFileType", "SubIFD", "Exif", "MakerNote", "ImageWidth", "BitsPerSample", "SamplesPerPixel",
+        "SampleFormat", "PhotometricInterpretation", "Compression", "RawImageSegmentation",
+        "PanaISO", "KodakIFD", "LeafData",
+        // exposure
+        "ShutterSpeedValue", "ExposureTime", "ApertureValue", "FNumber", "ExposureBiasValue", "FocalLength",
+        "FocalLengthIn35mmFilm", "SubjectDistance", "ISOSpeedRatings", "RecommendedExposureIndex", "ExposureIndex",
+        "DateTimeOriginal", "SerialNumber",
+        // lens
+        "LensMake", "LensModel", "LensInfo", "DNGLensInfo"
+    };
+
+    return filter;
+}
+
 template<typename T>
 T getFromFrame(
     const std::vector<std::unique_ptr<FrameData>>& frames,
@@ -76,6 +97,11 @@ FramesMetaData* FramesMetaData::fromFile (const Glib::ustring& fname, std::uniqu
     return new FramesData (fname, std::move(rml), firstFrameOnly);
 }
 
+FramesMetaData* FramesMetaData::summaryFromFile (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml)
+{
+    return new FramesData (fname, std::move(rml), false, true);
+}
+
 FrameData::FrameData(rtexif::TagDirectory* frameRootDir_, rtexif::TagDirectory* rootDir, rtexif::TagDirectory* firstRootDir) :
     frameRootDir(frameRootDir_),
     iptc(nullptr),
@@ -1335,14 +1361,18 @@ failure:
 
 }
 
-FramesData::FramesData (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml, bool firstFrameOnly) :
+FramesData::FramesData (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml, bool firstFrameOnly, bool summaryOnly) :
     iptc(nullptr), dcrawFrameCount (0)
 {
+    // the summary skips all tags FrameData doesn't evaluate, the IPTC data included
+    const rtexif::TagFilter* const filter = summaryOnly ? &getSummaryFilter() : nullptr;
+
+    // the maker notes are decoded while parsing, the trees only hold the file up to the end of the constructor
     if (rml && (rml->exifBase >= 0 || rml->ciffBase >= 0)) {
-        FILE* f = g_fopen (fname.c_str (), "rb");
+        IMFILE* const f = gfopen (fname.c_str ());
 
         if (f) {
-            rtexif::ExifManager exifManager (f, std::move(rml), firstFrameOnly);
+            rtexif::ExifManager exifManager (std::make_shared<rtexif::ExifSource> (f, filter), std::move(rml), firstFrameOnly);
             if (exifManager.f && exifManager.rml) {
                 if (exifManager.rml->exifBase >= 0) {
                     exifManager.parseRaw ();
@@ -1366,30 +1396,31 @@ FramesData::FramesData (const Glib::ustring& fname, std::unique_ptr<RawMetaDataL
                     break;
                 }
             }
-
-            fclose (f);
         }
     } else if (hasJpegExtension(fname)) {
-        FILE* f = g_fopen (fname.c_str (), "rb");
+        IMFILE* const f = gfopen (fname.c_str ());
 
         if (f) {
-            rtexif::ExifManager exifManager (f, std::move(rml), true);
-            if (exifManager.f) {
-                exifManager.parseJPEG ();
-                roots = exifManager.roots;
-                for (auto currFrame : exifManager.frames) {
-                    frames.push_back(std::unique_ptr<FrameData>(new FrameData(currFrame, currFrame->getRoot(), roots.at(0))));
-                }
-                rewind (exifManager.f); // Not sure this is necessary
-                iptc = iptc_data_new_from_jpeg_file (exifManager.f);
+            rtexif::ExifManager exifManager (std::make_shared<rtexif::ExifSource> (f, filter), std::move(rml), true);
+            exifManager.parseJPEG ();
+            roots = exifManager.roots;
+            for (auto currFrame : exifManager.frames) {
+                frames.push_back(std::unique_ptr<FrameData>(new FrameData(currFrame, currFrame->getRoot(), roots.at(0))));
+            }
+
+            // the IPTC reader needs a stdio stream
+            FILE* const iptcFile = summaryOnly ? nullptr : g_fopen (fname.c_str (), "rb");
+
+            if (iptcFile) {
+                iptc = iptc_data_new_from_jpeg_file (iptcFile);
+                fclose (iptcFile);
             }
-            fclose (f);
         }
     } else if (hasTiffExtension(fname)) {
-        FILE* f = g_fopen (fname.c_str (), "rb");
+        IMFILE* const f = gfopen (fname.c_str ());
 
         if (f) {
-            rtexif::ExifManager exifManager (f, std::move(rml), firstFrameOnly);
+            rtexif::ExifManager exifManager (std::make_shared<rtexif::ExifSource> (f, filter), std::move(rml), firstFrameOnly);
 
             exifManager.parseTIFF();
             roots = exifManager.roots;
@@ -1406,9 +1437,14 @@ FramesData::FramesData (const Glib::ustring& fname, std::unique_ptr<RawMetaDataL
                     break;
                 }
             }
-            fclose (f);
         }
     }
+
+    // The metadata lives as long as the image is open. Keeping the file mapped that long would prevent renaming
+    // or deleting it on Windows, and reading a mapping of a file truncated in the meantime raises SIGBUS.
+    for (auto currRoot : roots) {
+        currRoot->releaseSource ();
+    }
 }
 
 FramesData::~FramesData ()
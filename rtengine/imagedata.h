@@ -105,7 +105,8 @@ private:
     unsigned int dcrawFrameCount;
 
 public:
-    explicit FramesData (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml = nullptr, bool firstFrameOnly = false);
+    // summaryOnly: see FramesMetaData::summaryFromFile()
+    explicit FramesData (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml = nullptr, bool firstFrameOnly = false, bool summaryOnly = false);
     ~FramesData () override;
 
     void setDCRawFrameCount (unsigned int frameCount);
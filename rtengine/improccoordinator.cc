@@ -67,6 +67,8 @@ ImProcCoordinator::ImProcCoordinator() :
     scale(10),
     highDetailPreprocessComputed(false),
     highDetailRawComputed(false),
+    demosaicDeferred(false),
+    rawGeneration(0),
     allocated(false),
     bwAutoR(-9000.f),
     bwAutoG(-9000.f),
@@ -284,6 +286,7 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             imgsrc->setCurrentFrame(params->raw.bayersensor.imageNum);
 
             imgsrc->preprocess(rp, params->lensProf, params->coarse);
+            ++rawGeneration;
             if (flatFieldAutoClipListener && rp.ff_AutoClipControl) {
                 flatFieldAutoClipListener->flatFieldAutoClipValueChanged(imgsrc->getFlatFieldAutoClipValue());
             }
@@ -320,7 +323,17 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             imageTypeListener->imageTypeChanged(imgsrc->isRAW(), imgsrc->getSensorType() == ST_BAYER, imgsrc->getSensorType() == ST_FUJI_XTRANS, imgsrc->isMono());
         }
 
+        // Unless the preview itself is needed at full resolution, the raw source bins the raw data for the preview
+        // and demosaics only the regions the detail windows show, when they ask for them. That doesn't work for tools
+        // which need the demosaiced planes of the whole image, so the source is demosaiced as soon as one of them
+        // gets enabled.
+        const bool canDeferDemosaic = scale >= 2 && !(todo & M_HIGHQUAL) && options.prevdemo != PD_Sidecar
+                                      && !params->pdsharpening.enabled && !params->retinex.enabled
+                                      && !(params->toneCurve.hrenabled && params->toneCurve.method == "Color");
+        const bool undeferDemosaic = demosaicDeferred && !canDeferDemosaic;
+
         if ((todo & M_RAW)
+                || undeferDemosaic
                 || (!highDetailRawComputed && highDetailNeeded)
                 || (params->toneCurve.hrenabled && params->toneCurve.method != "Color" && imgsrc->isRGBSourceModified())
                 || (!params->toneCurve.hrenabled && params->toneCurve.method == "Color" && imgsrc->isRGBSourceModified())) {
@@ -341,14 +354,21 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS) {
                 imgsrc->setBorder(params->raw.xtranssensor.border);
             }
-            bool autoContrast = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicAutoContrast : params->raw.xtranssensor.dualDemosaicAutoContrast;
-            double contrastThreshold = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicContrast : params->raw.xtranssensor.dualDemosaicContrast;
-            imgsrc->demosaic(rp, autoContrast, contrastThreshold, params->pdsharpening.enabled);
-
-            if (imgsrc->getSensorType() == ST_BAYER && bayerAutoContrastListener && autoContrast) {
-                bayerAutoContrastListener->autoContrastChanged(contrastThreshold);
-            } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS && xtransAutoContrastListener && autoContrast) {
-                xtransAutoContrastListener->autoContrastChanged(autoContrast ? contrastThreshold : -1.0);
+
+            demosaicDeferred = canDeferDemosaic && imgsrc->deferDemosaic(rp);
+            ++rawGeneration;
+
+            if (!demosaicDeferred) {
+                bool autoContrast = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicAutoContrast : params->raw.xtranssensor.dualDemosaicAutoContrast;
+                double contrastThreshold = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicContrast : params->raw.xtranssensor.dualDemosaicContrast;
+                imgsrc->setDualDemosaicCaching(settings->cacheDualDemosaic);
+                imgsrc->demosaic(rp, autoContrast, contrastThreshold, params->pdsharpening.enabled);
+
+                if (imgsrc->getSensorType() == ST_BAYER && bayerAutoContrastListener && autoContrast) {
+                    bayerAutoContrastListener->autoContrastChanged(contrastThreshold);
+                } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS && xtransAutoContrastListener && autoContrast) {
+                    xtransAutoContrastListener->autoContrastChanged(autoContrast ? contrastThreshold : -1.0);
+                }
             }
             // if a demosaic happened we should also call getimage later, so we need to set the M_INIT flag
             todo |= (M_INIT | M_CSHARP);
@@ -369,6 +389,7 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
 
 
         if ((todo & M_RAW)
+                || undeferDemosaic
                 || (!highDetailRawComputed && highDetailNeeded)
                 || (params->toneCurve.hrenabled && params->toneCurve.method != "Color" && imgsrc->isRGBSourceModified())
                 || (!params->toneCurve.hrenabled && params->toneCurve.method == "Color" && imgsrc->isRGBSourceModified())) {
@@ -568,12 +589,17 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             }
         }
 
+        if (!params->dirpyrequalizer.enabled) {
+            cbdlCache.clear();
+        }
+
         if ((todo & (M_TRANSFORM | M_RGBCURVE))  && params->dirpyrequalizer.cbdlMethod == "bef" && params->dirpyrequalizer.enabled && !params->colorappearance.enabled) {
             const int W = oprevi->getWidth();
             const int H = oprevi->getHeight();
             LabImage labcbdl(W, H);
             ipf.rgb2lab(*oprevi, labcbdl, params->icm.workingProfile);
-            ipf.dirpyrequalizer(&labcbdl, scale);
+            cbdlCache.update(*params, {scale, pW, pH, rawGeneration});
+            ipf.dirpyrequalizer(&labcbdl, scale, &cbdlCache);
             ipf.lab2rgb(labcbdl, *oprevi, params->icm.workingProfile);
         }
 
@@ -869,7 +895,8 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             if (params->dirpyrequalizer.cbdlMethod == "aft") {
                 if (((params->colorappearance.enabled && !settings->autocielab) || (!params->colorappearance.enabled))) {
                     progress("Pyramid wavelet...", 100 * readyphase / numofphases);
-                    ipf.dirpyrequalizer(nprevl, scale);
+                    cbdlCache.update(*params, {scale, pW, pH, rawGeneration});
+                    ipf.dirpyrequalizer(nprevl, scale, &cbdlCache);
                     //ipf.Lanczoslab (ip_wavelet(LabImage * lab, LabImage * dst, const procparams::EqualizerParams & eqparams), nprevl, 1.f/scale);
                     readyphase++;
                 }
@@ -1404,6 +1431,7 @@ void ImProcCoordinator::saveInputICCReference(const Glib::ustring& fname, bool a
     imgsrc->preprocess(ppar.raw, ppar.lensProf, ppar.coarse);
     double dummy = 0.0;
     imgsrc->demosaic(ppar.raw, false, dummy);
+    ++rawGeneration;
     ColorTemp currWB = ColorTemp(params->wb.temperature, params->wb.green, params->wb.equal, params->wb.method);
 
     if (params->wb.method == "Camera") {
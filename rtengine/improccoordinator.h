@@ -24,6 +24,7 @@
 #include "colortemp.h"
 #include "curves.h"
 #include "dcrop.h"
+#include "dirpyrcache.h"
 #include "imagesource.h"
 #include "improcfun.h"
 #include "LUT.h"
@@ -66,6 +67,7 @@ protected:
     LabImage *oprevl;
     LabImage *nprevl;
     Imagefloat *fattal_11_dcrop_cache; // global cache for ToneMapFattal02 used in 1:1 detail windows (except when denoise is active)
+    DirPyrCache cbdlCache; // contrast by detail levels decomposition of the preview
     Image8 *previmg;  // displayed image in monitor color space, showing the output profile as well (soft-proofing enabled, which then correspond to workimg) or not
     Image8 *workimg;  // internal image in output color space for analysis
     CieImage *ncie;
@@ -87,6 +89,8 @@ protected:
     int scale;
     bool highDetailPreprocessComputed;
     bool highDetailRawComputed;
+    bool demosaicDeferred;
+    int rawGeneration; // counts the runs of the raw stage, the CBDL caches are keyed on it
     bool allocated;
 
     void freeAll ();
@@ -30,6 +30,7 @@
 #include "improcfun.h"
 #include "curves.h"
 #include "dcp.h"
+#include "dirpyrcache.h"
 #include "iccstore.h"
 #include "imagesource.h"
 #include "rtthumbnail.h"
@@ -5095,7 +5096,7 @@ void ImProcFunctions::badpixlab (LabImage* lab, double rad, int thr, float chrom
     }
 }
 
-void ImProcFunctions::dirpyrequalizer (LabImage* lab, int scale)
+void ImProcFunctions::dirpyrequalizer (LabImage* lab, int scale, DirPyrCache* cache)
 {
     if (params->dirpyrequalizer.enabled && lab->W >= 8 && lab->H >= 8) {
         float b_l = static_cast<float> (params->dirpyrequalizer.hueskin.getBottomLeft()) / 100.f;
@@ -5111,7 +5112,9 @@ void ImProcFunctions::dirpyrequalizer (LabImage* lab, int scale)
         }
 
         //dirpyrLab_equalizer(lab, lab, params->dirpyrequalizer.mult);
-        dirpyr_equalizer (lab->L, lab->L, lab->W, lab->H, lab->a, lab->b, params->dirpyrequalizer.mult, params->dirpyrequalizer.threshold, params->dirpyrequalizer.skinprotect, b_l, t_l, t_r, scale);
+        dirpyr_equalizer (lab->L, lab->L, lab->W, lab->H, lab->a, lab->b, params->dirpyrequalizer.mult, params->dirpyrequalizer.threshold, params->dirpyrequalizer.skinprotect, b_l, t_l, t_r, scale, cache);
+    } else if (cache) {
+        cache->clear();
     }
 }
 void ImProcFunctions::EPDToneMapCIE (CieImage *ncie, float a_w, float c_, int Wid, int Hei, float minQ, float maxQ, unsigned int Iterates, int skip)
@@ -40,6 +40,7 @@ class ColorAppearance;
 class ColorGradientCurve;
 class DCPProfile;
 class DCPProfileApplyState;
+class DirPyrCache;
 class FlatCurve;
 class FramesMetaData;
 class LensCorrection;
@@ -106,7 +107,9 @@ public:
         TYPE_5X5_SOFT,
         TYPE_5X5_STRONG,
         TYPE_7X7,
-        TYPE_9X9
+        TYPE_9X9,
+        TYPE_15X15,
+        TYPE_21X21
     };
 
     double lumimul[3];
@@ -171,7 +174,7 @@ public:
     void impulse_nrcam(CieImage* ncie, double thresh, float **buffers[3]);
 
     void dirpyrdenoise(LabImage* src);    //Emil's pyramid denoise
-    void dirpyrequalizer(LabImage* lab, int scale);  //Emil's wavelet
+    void dirpyrequalizer(LabImage* lab, int scale, DirPyrCache* cache = nullptr);  //Emil's wavelet
 
 
     void EPDToneMapResid(float * WavCoeffs_L0, unsigned int Iterates,  int skip, struct cont_params& cp, int W_L, int H_L, float max0, float min0);
@@ -243,7 +246,7 @@ public:
     float MadRgb(const float * DataList, int datalen);
 
     // pyramid wavelet
-    void dirpyr_equalizer(const float * const * src, float ** dst, int srcwidth, int srcheight, const float * const * l_a, const float * const * l_b, const double * mult, double dirpyrThreshold, double skinprot, float b_l, float t_l, float t_r, int scale);    //Emil's directional pyramid wavelet
+    void dirpyr_equalizer(const float * const * src, float ** dst, int srcwidth, int srcheight, const float * const * l_a, const float * const * l_b, const double * mult, double dirpyrThreshold, double skinprot, float b_l, float t_l, float t_r, int scale, DirPyrCache* cache = nullptr);    //Emil's directional pyramid wavelet
     void dirpyr_equalizercam(const CieImage* ncie, float ** src, float ** dst, int srcwidth, int srcheight, const float * const * h_p, const float * const * C_p,  const double * mult, const double dirpyrThreshold, const double skinprot, float b_l, float t_l, float t_r, int scale);    //Emil's directional pyramid wavelet
     void defringe(LabImage* lab);
     void defringecam(CieImage* ncie);
@@ -29,6 +29,7 @@
 #include "improccoordinator.h"
 #include "dfmanager.h"
 #include "ffmanager.h"
+#include "fftwplancache.h"
 #include "rtthumbnail.h"
 #include "profilestore.h"
 #include "../rtgui/threadutils.h"
@@ -106,6 +107,7 @@ int init (const Settings* s, const Glib::ustring& baseDir, const Glib::ustring&
     delete lcmsMutex;
     lcmsMutex = new MyMutex;
     fftwMutex = new MyMutex;
+    FFTWPlanCache::getInstance()->init(s->cacheDirectory.empty() ? Glib::ustring() : Glib::build_filename(s->cacheDirectory, "fftwf_wisdom"));
     return 0;
 }
 
@@ -114,6 +116,7 @@ void cleanup ()
     ProcParams::cleanup ();
     Color::cleanup ();
     RawImageSource::cleanup ();
+    FFTWPlanCache::getInstance()->cleanup();
 
 #ifdef RT_FFTW3F_OMP
     fftwf_cleanup_threads();
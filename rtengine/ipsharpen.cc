@@ -19,6 +19,7 @@
 
 #include "bilateral2.h"
 #include "cieimage.h"
+#include "deconvolution.h"
 #include "gauss.h"
 #include "improcfun.h"
 #include "jaggedarray.h"
@@ -202,6 +203,7 @@ BENCHFUN
     const bool needdamp = sharpenParam.deconvdamping > 0;
     const double sigma = sharpenParam.deconvradius / Scale;
     const float amount = sharpenParam.deconvamount / 100.f;
+    float maxDeviation = 0.f;
 
 #ifdef _OPENMP
     #pragma omp parallel
@@ -216,6 +218,26 @@ BENCHFUN
                 gaussianBlur(tmpI, tmp, W, H, sigma);
                 dcdamping(tmp, luminance, damping, W, H);
             }
+            if (k % deconvConvergenceInterval == deconvConvergenceInterval - 1) {
+                // stop as soon as the blurred estimate reproduces the luminance, i.e. all ratios are close to 1
+#ifdef _OPENMP
+                #pragma omp single
+#endif
+                maxDeviation = 0.f;
+#ifdef _OPENMP
+                #pragma omp for reduction(max:maxDeviation)
+#endif
+                for (int i = 0; i < H; ++i) {
+                    for (int j = 0; j < W; ++j) {
+                        if (luminance[i][j] > 0.f) {
+                            maxDeviation = max(maxDeviation, std::fabs(tmp[i][j] - 1.f));
+                        }
+                    }
+                }
+                if (maxDeviation <= deconvConvergenceLimit) {
+                    break;
+                }
+            }
             gaussianBlur(tmp, tmpI, W, H, sigma, false, GAUSS_MULT);
         } // end for
 
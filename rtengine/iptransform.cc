@@ -16,7 +16,9 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <array>
+#include <vector>
 
 #include "imagefloat.h"
 #include "improcfun.h"
@@ -195,6 +197,136 @@ inline void interpolateTransformChannelsCubic(const float* const* src, int xs, i
 }
 #endif
 
+constexpr int maxGridStep = 16;
+constexpr int minGridStep = 4;
+constexpr double maxGridError = 0.01; // in pixels
+
+// Smooth mapping of the output pixels (source coordinates and the like), evaluated on a sparse grid
+// and interpolated bilinearly in between
+template<std::size_t N>
+class TransformGrid
+{
+public:
+    using Node = std::array<double, N>;
+
+    // Samples mapping(x, y, node) every maxGridStep pixels and refines the grid until the interpolation
+    // error at the edge midpoints and cell centers, measured by error(exact, interpolated), is below maxGridError.
+    // Returns false if even minGridStep is too coarse, the mapping has to be evaluated per pixel then.
+    template<typename Mapping, typename Error>
+    bool init(int W, int H, const Mapping& mapping, const Error& error, bool multiThread)
+    {
+        for (step = maxGridStep; step >= minGridStep; step /= 2) {
+            gridW = std::max((W + step - 2) / step + 1, 2);
+            gridH = std::max((H + step - 2) / step + 1, 2);
+            nodes.resize(gridW * gridH);
+
+#ifdef _OPENMP
+            #pragma omp parallel for if (multiThread)
+#endif
+
+            for (int j = 0; j < gridH; ++j) {
+                for (int i = 0; i < gridW; ++i) {
+                    mapping(i * step, j * step, nodes[j * gridW + i]);
+                }
+            }
+
+            double maxError = 0.0;
+
+#ifdef _OPENMP
+            #pragma omp parallel for reduction(max:maxError) if (multiThread)
+#endif
+
+            for (int j = 0; j < gridH; ++j) {
+                for (int i = 0; i < gridW; ++i) {
+                    const Node& topLeft = nodes[j * gridW + i];
+                    Node exact;
+                    Node interpolated;
+
+                    if (i < gridW - 1) {
+                        // midpoint of the top edge
+                        const Node& topRight = nodes[j * gridW + i + 1];
+                        mapping(i * step + step / 2, j * step, exact);
+
+                        for (std::size_t k = 0; k < N; ++k) {
+                            interpolated[k] = 0.5 * (topLeft[k] + topRight[k]);
+                        }
+
+                        maxError = std::max(maxError, error(exact, interpolated));
+                    }
+
+                    if (j < gridH - 1) {
+                        // midpoint of the left edge
+                        const Node& bottomLeft = nodes[(j + 1) * gridW + i];
+                        mapping(i * step, j * step + step / 2, exact);
+
+                        for (std::size_t k = 0; k < N; ++k) {
+                            interpolated[k] = 0.5 * (topLeft[k] + bottomLeft[k]);
+                        }
+
+                        maxError = std::max(maxError, error(exact, interpolated));
+                    }
+
+                    if (i < gridW - 1 && j < gridH - 1) {
+                        // center of the cell
+                        const Node& topRight = nodes[j * gridW + i + 1];
+                        const Node& bottomLeft = nodes[(j + 1) * gridW + i];
+                        const Node& bottomRight = nodes[(j + 1) * gridW + i + 1];
+                        mapping(i * step + step / 2, j * step + step / 2, exact);
+
+                        for (std::size_t k = 0; k < N; ++k) {
+                            interpolated[k] = 0.25 * ((topLeft[k] + topRight[k]) + (bottomLeft[k] + bottomRight[k]));
+                        }
+
+                        maxError = std::max(maxError, error(exact, interpolated));
+                    }
+                }
+            }
+
+            if (maxError <= maxGridError) {
+                stepInv = 1.0 / step;
+                return true;
+            }
+        }
+
+        nodes.clear();
+        return false;
+    }
+
+    // Interpolates the grid columns at output row y
+    void interpolateRow(int y, std::vector<Node>& row) const
+    {
+        const int j = std::min(y / step, gridH - 2);
+        const double f = (y - j * step) * stepInv;
+        const Node* const top = &nodes[j * gridW];
+        const Node* const bottom = &nodes[(j + 1) * gridW];
+        row.resize(gridW);
+
+        for (int i = 0; i < gridW; ++i) {
+            for (std::size_t k = 0; k < N; ++k) {
+                row[i][k] = top[i][k] + f * (bottom[i][k] - top[i][k]);
+            }
+        }
+    }
+
+    // Interpolates a row returned by interpolateRow() at output column x
+    void interpolate(const std::vector<Node>& row, int x, Node& node) const
+    {
+        const int i = std::min(x / step, gridW - 2);
+        const double f = (x - i * step) * stepInv;
+
+        for (std::size_t k = 0; k < N; ++k) {
+            node[k] = row[i][k] + f * (row[i + 1][k] - row[i][k]);
+        }
+    }
+
+private:
+    std::vector<Node> nodes;
+    int step;
+    double stepInv;
+    int gridW;
+    int gridH;
+};
+
 }
 
 namespace rtengine
@@ -925,13 +1057,10 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, I
     const double centerFactorx = cx - w2;
     const double centerFactory = cy - h2;
 
-    // main cycle
-#ifdef _OPENMP
-    #pragma omp parallel for schedule(dynamic, 16) if(multiThread)
-#endif
-
-    for (int y = 0; y < transformed->getHeight(); ++y) {
-        for (int x = 0; x < transformed->getWidth(); ++x) {
+    // source position relative to the image center before the distortion correction, and the distortion scale
+    const auto mapping =
+        [&](int x, int y, TransformGrid<3>::Node& node) -> void
+        {
             double x_d = x;
             double y_d = y;
 
@@ -956,94 +1085,145 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, I
             }
 
             // rotate
-            const double Dxc = x_d * cost - y_d * sint;
-            const double Dyc = x_d * sint + y_d * cost;
+            node[0] = x_d * cost - y_d * sint;
+            node[1] = x_d * sint + y_d * cost;
 
             // distortion correction
-            double s = 1.0;
+            node[2] = 1.0;
 
             if (enableDistortion) {
-                const double r = sqrt(Dxc * Dxc + Dyc * Dyc) / maxRadius;
-                s = 1.0 - distAmount + distAmount * r;
+                const double r = sqrt(node[0] * node[0] + node[1] * node[1]) / maxRadius;
+                node[2] = 1.0 - distAmount + distAmount * r;
             }
+        };
+
+    // the lens models and the perspective correction are expensive per pixel, but smooth
+    TransformGrid<3> grid;
+    const bool useGrid = grid.init(transformed->getWidth(), transformed->getHeight(), mapping,
+        [&](const TransformGrid<3>::Node& exact, const TransformGrid<3>::Node& interpolated) -> double
+        {
+            // error of the source position of each channel, including the c/a scale
+            double error = 0.0;
 
             for (int c = 0; c < (enableCA ? 3 : 1); ++c) {
-                double Dx = Dxc * (s + chDist[c]);
-                double Dy = Dyc * (s + chDist[c]);
-
-                // de-center
-                Dx += w2;
-                Dy += h2;
-
-                // Extract integer and fractions of source screen coordinates
-                int xc = Dx;
-                Dx -= xc;
-                xc -= sx;
-                int yc = Dy;
-                Dy -= yc;
-                yc -= sy;
-
-                // Convert only valid pixels
-                if (yc >= 0 && yc < original->getHeight() && xc >= 0 && xc < original->getWidth()) {
-                    // multiplier for vignetting correction
-                    double vignmul = 1.0;
-
-                    if (enableVignetting) {
-                        const double vig_x_d = ascale * (x + cx - vig_w2); // centering x coord & scale
-                        const double vig_y_d = ascale * (y + cy - vig_h2); // centering y coord & scale
-                        const double vig_Dx = vig_x_d * cost - vig_y_d * sint;
-                        const double vig_Dy = vig_x_d * sint + vig_y_d * cost;
-                        const double r2 = sqrt(vig_Dx * vig_Dx + vig_Dy * vig_Dy);
-                        if (darkening) {
-                            vignmul /= std::max(v + mul * tanh(b * (maxRadius - s * r2) / maxRadius), 0.001);
-                        } else {
-                            vignmul *= (v + mul * tanh(b * (maxRadius - s * r2) / maxRadius));
+                const double exactScale = exact[2] + chDist[c];
+                const double interpolatedScale = interpolated[2] + chDist[c];
+                error = std::max(error, std::fabs(exact[0] * exactScale - interpolated[0] * interpolatedScale));
+                error = std::max(error, std::fabs(exact[1] * exactScale - interpolated[1] * interpolatedScale));
+            }
+
+            return error;
+        },
+        multiThread
+    );
+
+    // main cycle
+#ifdef _OPENMP
+    #pragma omp parallel if(multiThread)
+#endif
+    {
+        std::vector<TransformGrid<3>::Node> gridRow;
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 16)
+#endif
+
+        for (int y = 0; y < transformed->getHeight(); ++y) {
+            if (useGrid) {
+                grid.interpolateRow(y, gridRow);
+            }
+
+            for (int x = 0; x < transformed->getWidth(); ++x) {
+                TransformGrid<3>::Node node;
+
+                if (useGrid) {
+                    grid.interpolate(gridRow, x, node);
+                } else {
+                    mapping(x, y, node);
+                }
+
+                const double Dxc = node[0];
+                const double Dyc = node[1];
+                const double s = node[2];
+
+                for (int c = 0; c < (enableCA ? 3 : 1); ++c) {
+                    double Dx = Dxc * (s + chDist[c]);
+                    double Dy = Dyc * (s + chDist[c]);
+
+                    // de-center
+                    Dx += w2;
+                    Dy += h2;
+
+                    // Extract integer and fractions of source screen coordinates
+                    int xc = Dx;
+                    Dx -= xc;
+                    xc -= sx;
+                    int yc = Dy;
+                    Dy -= yc;
+                    yc -= sy;
+
+                    // Convert only valid pixels
+                    if (yc >= 0 && yc < original->getHeight() && xc >= 0 && xc < original->getWidth()) {
+                        // multiplier for vignetting correction
+                        double vignmul = 1.0;
+
+                        if (enableVignetting) {
+                            const double vig_x_d = ascale * (x + cx - vig_w2); // centering x coord & scale
+                            const double vig_y_d = ascale * (y + cy - vig_h2); // centering y coord & scale
+                            const double vig_Dx = vig_x_d * cost - vig_y_d * sint;
+                            const double vig_Dy = vig_x_d * sint + vig_y_d * cost;
+                            const double r2 = sqrt(vig_Dx * vig_Dx + vig_Dy * vig_Dy);
+                            if (darkening) {
+                                vignmul /= std::max(v + mul * tanh(b * (maxRadius - s * r2) / maxRadius), 0.001);
+                            } else {
+                                vignmul *= (v + mul * tanh(b * (maxRadius - s * r2) / maxRadius));
+                            }
                         }
-                    }
 
-                    if (enableGradient) {
-                        vignmul *= calcGradientFactor(gp, cx + x, cy + y);
-                    }
+                        if (enableGradient) {
+                            vignmul *= calcGradientFactor(gp, cx + x, cy + y);
+                        }
 
-                    if (enablePCVignetting) {
-                        vignmul *= calcPCVignetteFactor(pcv, cx + x, cy + y);
-                    }
+                        if (enablePCVignetting) {
+                            vignmul *= calcPCVignetteFactor(pcv, cx + x, cy + y);
+                        }
 
-                    if (yc > 0 && yc < original->getHeight() - 2 && xc > 0 && xc < original->getWidth() - 2) {
-                        // all interpolation pixels inside image
-                        if (enableCA) {
-                            interpolateTransformChannelsCubic(chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], vignmul);
-                        } else if (!highQuality) {
-                            transformed->r(y, x) = vignmul * (original->r(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->r(yc, xc + 1) * Dx * (1.0 - Dy) + original->r(yc + 1, xc) * (1.0 - Dx) * Dy + original->r(yc + 1, xc + 1) * Dx * Dy);
-                            transformed->g(y, x) = vignmul * (original->g(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->g(yc, xc + 1) * Dx * (1.0 - Dy) + original->g(yc + 1, xc) * (1.0 - Dx) * Dy + original->g(yc + 1, xc + 1) * Dx * Dy);
-                            transformed->b(y, x) = vignmul * (original->b(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->b(yc, xc + 1) * Dx * (1.0 - Dy) + original->b(yc + 1, xc) * (1.0 - Dx) * Dy + original->b(yc + 1, xc + 1) * Dx * Dy);
+                        if (yc > 0 && yc < original->getHeight() - 2 && xc > 0 && xc < original->getWidth() - 2) {
+                            // all interpolation pixels inside image
+                            if (enableCA) {
+                                interpolateTransformChannelsCubic(chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], vignmul);
+                            } else if (!highQuality) {
+                                transformed->r(y, x) = vignmul * (original->r(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->r(yc, xc + 1) * Dx * (1.0 - Dy) + original->r(yc + 1, xc) * (1.0 - Dx) * Dy + original->r(yc + 1, xc + 1) * Dx * Dy);
+                                transformed->g(y, x) = vignmul * (original->g(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->g(yc, xc + 1) * Dx * (1.0 - Dy) + original->g(yc + 1, xc) * (1.0 - Dx) * Dy + original->g(yc + 1, xc + 1) * Dx * Dy);
+                                transformed->b(y, x) = vignmul * (original->b(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->b(yc, xc + 1) * Dx * (1.0 - Dy) + original->b(yc + 1, xc) * (1.0 - Dx) * Dy + original->b(yc + 1, xc + 1) * Dx * Dy);
+                            } else {
+                                interpolateTransformCubic(original, xc - 1, yc - 1, Dx, Dy, transformed->r(y, x), transformed->g(y, x), transformed->b(y, x), vignmul);
+                            }
                         } else {
-                            interpolateTransformCubic(original, xc - 1, yc - 1, Dx, Dy, transformed->r(y, x), transformed->g(y, x), transformed->b(y, x), vignmul);
+                            // edge pixels
+                            const int y1 = LIM(yc, 0, original->getHeight() - 1);
+                            const int y2 = LIM(yc + 1, 0, original->getHeight() - 1);
+                            const int x1 = LIM(xc, 0, original->getWidth() - 1);
+                            const int x2 = LIM(xc + 1, 0, original->getWidth() - 1);
+
+                            if (enableCA) {
+                                chTrans[c][y][x] = vignmul * (chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                            } else {
+                                transformed->r(y, x) = vignmul * (original->r(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->r(y1, x2) * Dx * (1.0 - Dy) + original->r(y2, x1) * (1.0 - Dx) * Dy + original->r(y2, x2) * Dx * Dy);
+                                transformed->g(y, x) = vignmul * (original->g(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->g(y1, x2) * Dx * (1.0 - Dy) + original->g(y2, x1) * (1.0 - Dx) * Dy + original->g(y2, x2) * Dx * Dy);
+                                transformed->b(y, x) = vignmul * (original->b(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->b(y1, x2) * Dx * (1.0 - Dy) + original->b(y2, x1) * (1.0 - Dx) * Dy + original->b(y2, x2) * Dx * Dy);
+                            }
                         }
                     } else {
-                        // edge pixels
-                        const int y1 = LIM(yc, 0, original->getHeight() - 1);
-                        const int y2 = LIM(yc + 1, 0, original->getHeight() - 1);
-                        const int x1 = LIM(xc, 0, original->getWidth() - 1);
-                        const int x2 = LIM(xc + 1, 0, original->getWidth() - 1);
-
                         if (enableCA) {
-                            chTrans[c][y][x] = vignmul * (chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                            // not valid (source pixel x,y not inside source image, etc.)
+                            chTrans[c][y][x] = 0;
                         } else {
-                            transformed->r(y, x) = vignmul * (original->r(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->r(y1, x2) * Dx * (1.0 - Dy) + original->r(y2, x1) * (1.0 - Dx) * Dy + original->r(y2, x2) * Dx * Dy);
-                            transformed->g(y, x) = vignmul * (original->g(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->g(y1, x2) * Dx * (1.0 - Dy) + original->g(y2, x1) * (1.0 - Dx) * Dy + original->g(y2, x2) * Dx * Dy);
-                            transformed->b(y, x) = vignmul * (original->b(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->b(y1, x2) * Dx * (1.0 - Dy) + original->b(y2, x1) * (1.0 - Dx) * Dy + original->b(y2, x2) * Dx * Dy);
+                            transformed->r(y, x) = 0;
+                            transformed->g(y, x) = 0;
+                            transformed->b(y, x) = 0;
                         }
                     }
-                } else {
-                    if (enableCA) {
-                        // not valid (source pixel x,y not inside source image, etc.)
-                        chTrans[c][y][x] = 0;
-                    } else {
-                        transformed->r(y, x) = 0;
-                        transformed->g(y, x) = 0;
-                        transformed->b(y, x) = 0;
-                    }
                 }
             }
         }
@@ -1065,43 +1245,86 @@ void ImProcFunctions::transformLCPCAOnly(Imagefloat *original, Imagefloat *trans
     chTrans[1] = transformed->g.ptrs;
     chTrans[2] = transformed->b.ptrs;
 
+    // source coordinates of the three channels
+    const auto mapping =
+        [&](int x, int y, TransformGrid<6>::Node& node) -> void
+        {
+            for (int c = 0; c < 3; c++) {
+                node[2 * c] = x;
+                node[2 * c + 1] = y;
+                pLCPMap->correctCA(node[2 * c], node[2 * c + 1], cx, cy, c);
+            }
+        };
+
+    TransformGrid<6> grid;
+    const bool useGrid = grid.init(transformed->getWidth(), transformed->getHeight(), mapping,
+        [](const TransformGrid<6>::Node& exact, const TransformGrid<6>::Node& interpolated) -> double
+        {
+            double error = 0.0;
+
+            for (int i = 0; i < 6; ++i) {
+                error = std::max(error, std::fabs(exact[i] - interpolated[i]));
+            }
+
+            return error;
+        },
+        multiThread
+    );
+
 #ifdef _OPENMP
-    #pragma omp parallel for if (multiThread)
+    #pragma omp parallel if (multiThread)
 #endif
+    {
+        std::vector<TransformGrid<6>::Node> gridRow;
 
-    for (int y = 0; y < transformed->getHeight(); y++) {
-        for (int x = 0; x < transformed->getWidth(); x++) {
-            for (int c = 0; c < 3; c++) {
-                double Dx = x;
-                double Dy = y;
-                
-                pLCPMap->correctCA(Dx, Dy, cx, cy, c);
-
-                // Extract integer and fractions of coordinates
-                int xc = (int)Dx;
-                Dx -= (double)xc;
-                int yc = (int)Dy;
-                Dy -= (double)yc;
-
-                // Convert only valid pixels
-                if (yc >= 0 && yc < original->getHeight() && xc >= 0 && xc < original->getWidth()) {
-
-                    // multiplier for vignetting correction
-                    if (yc > 0 && yc < original->getHeight() - 2 && xc > 0 && xc < original->getWidth() - 2) {
-                        // all interpolation pixels inside image
-                        interpolateTransformChannelsCubic (chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], 1.0);
-                    } else {
-                        // edge pixels
-                        int y1 = LIM (yc,   0, original->getHeight() - 1);
-                        int y2 = LIM (yc + 1, 0, original->getHeight() - 1);
-                        int x1 = LIM (xc,   0, original->getWidth() - 1);
-                        int x2 = LIM (xc + 1, 0, original->getWidth() - 1);
+#ifdef _OPENMP
+        #pragma omp for
+#endif
 
-                        chTrans[c][y][x] = (chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
-                    }
+        for (int y = 0; y < transformed->getHeight(); y++) {
+            if (useGrid) {
+                grid.interpolateRow(y, gridRow);
+            }
+
+            for (int x = 0; x < transformed->getWidth(); x++) {
+                TransformGrid<6>::Node node;
+
+                if (useGrid) {
+                    grid.interpolate(gridRow, x, node);
                 } else {
-                    // not valid (source pixel x,y not inside source image, etc.)
-                    chTrans[c][y][x] = 0;
+                    mapping(x, y, node);
+                }
+
+                for (int c = 0; c < 3; c++) {
+                    double Dx = node[2 * c];
+                    double Dy = node[2 * c + 1];
+
+                    // Extract integer and fractions of coordinates
+                    int xc = (int)Dx;
+                    Dx -= (double)xc;
+                    int yc = (int)Dy;
+                    Dy -= (double)yc;
+
+                    // Convert only valid pixels
+                    if (yc >= 0 && yc < original->getHeight() && xc >= 0 && xc < original->getWidth()) {
+
+                        // multiplier for vignetting correction
+                        if (yc > 0 && yc < original->getHeight() - 2 && xc > 0 && xc < original->getWidth() - 2) {
+                            // all interpolation pixels inside image
+                            interpolateTransformChannelsCubic (chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], 1.0);
+                        } else {
+                            // edge pixels
+                            int y1 = LIM (yc,   0, original->getHeight() - 1);
+                            int y2 = LIM (yc + 1, 0, original->getHeight() - 1);
+                            int x1 = LIM (xc,   0, original->getWidth() - 1);
+                            int x2 = LIM (xc + 1, 0, original->getWidth() - 1);
+
+                            chTrans[c][y][x] = (chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                        }
+                    } else {
+                        // not valid (source pixel x,y not inside source image, etc.)
+                        chTrans[c][y][x] = 0;
+                    }
                 }
             }
         }
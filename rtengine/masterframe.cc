@@ -0,0 +1,400 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <locale>
+#include <memory>
+#include <sstream>
+
+#include <glib/gstdio.h>
+#include <giomm/file.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+
+#include "masterframe.h"
+
+#include "rawimage.h"
+#include "settings.h"
+
+namespace
+{
+
+constexpr char masterFrameMagic[] = "RTMASTERFRAME2";
+
+// every frame which is being decoded takes several times the size of the master frame
+constexpr int maxParallelFrames = 4;
+
+Glib::ustring getCacheDir()
+{
+    return rtengine::settings->cacheDirectory.empty() ? Glib::ustring() : Glib::build_filename(rtengine::settings->cacheDirectory, "masterframes");
+}
+
+bool readMasterFrame(const Glib::ustring& fileName, const std::string& key, rtengine::RawImage& ri, int rSize)
+{
+    FILE* const f = g_fopen(fileName.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    const int H = ri.get_height();
+    char magic[sizeof(masterFrameMagic)];
+    std::uint32_t keySize;
+    std::int32_t height;
+    std::int32_t rowSize;
+    std::int32_t sampleSize;
+
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 && !std::memcmp(magic, masterFrameMagic, sizeof(magic))
+              && fread(&keySize, sizeof(keySize), 1, f) == 1 && keySize == key.size();
+
+    if (ok) {
+        std::string fileKey(keySize, '\0');
+        ok = fread(&fileKey[0], 1, keySize, f) == keySize && fileKey == key
+             && fread(&height, sizeof(height), 1, f) == 1 && height == H
+             && fread(&rowSize, sizeof(rowSize), 1, f) == 1 && rowSize == rSize
+             && fread(&sampleSize, sizeof(sampleSize), 1, f) == 1 && (sampleSize == sizeof(std::uint16_t) || sampleSize == sizeof(float));
+    }
+
+    // don't touch the frame until the whole file has been read
+    std::vector<std::uint16_t> data16;
+    std::vector<float> data;
+
+    if (ok) {
+        if (sampleSize == sizeof(std::uint16_t)) {
+            data16.resize(static_cast<std::size_t>(H) * rSize);
+            ok = fread(data16.data(), sizeof(std::uint16_t), data16.size(), f) == data16.size();
+        } else {
+            data.resize(static_cast<std::size_t>(H) * rSize);
+            ok = fread(data.data(), sizeof(float), data.size(), f) == data.size();
+        }
+    }
+
+    fclose(f);
+
+    if (ok) {
+        for (int row = 0; row < H; ++row) {
+            if (sampleSize == sizeof(std::uint16_t)) {
+                std::copy_n(&data16[static_cast<std::size_t>(row) * rSize], rSize, ri.data[row]);
+            } else {
+                std::copy_n(&data[static_cast<std::size_t>(row) * rSize], rSize, ri.data[row]);
+            }
+        }
+    }
+
+    return ok;
+}
+
+void writeMasterFrame(const Glib::ustring& fileName, const std::string& key, const rtengine::RawImage& ri, int rSize)
+{
+    const Glib::ustring tmpName = fileName + ".tmp";
+    FILE* const f = g_fopen(tmpName.c_str(), "wb");
+
+    if (!f) {
+        return;
+    }
+
+    const std::uint32_t keySize = key.size();
+    const std::int32_t height = ri.get_height();
+    const std::int32_t rowSize = rSize;
+    // half the size for integer data, which covers dark frames and unblurred flat fields
+    const bool compact = ri.fits_uint16();
+    const std::int32_t sampleSize = compact ? sizeof(std::uint16_t) : sizeof(float);
+
+    bool ok = fwrite(masterFrameMagic, sizeof(masterFrameMagic), 1, f) == 1
+              && fwrite(&keySize, sizeof(keySize), 1, f) == 1
+              && fwrite(key.data(), 1, keySize, f) == keySize
+              && fwrite(&height, sizeof(height), 1, f) == 1
+              && fwrite(&rowSize, sizeof(rowSize), 1, f) == 1
+              && fwrite(&sampleSize, sizeof(sampleSize), 1, f) == 1;
+
+    std::vector<std::uint16_t> row16(compact ? rSize : 0);
+
+    for (int row = 0; ok && row < height; ++row) {
+        if (compact) {
+            std::copy_n(ri.data[row], rSize, row16.begin());
+            ok = fwrite(row16.data(), sizeof(std::uint16_t), rSize, f) == static_cast<std::size_t>(rSize);
+        } else {
+            ok = fwrite(ri.data[row], sizeof(float), rSize, f) == static_cast<std::size_t>(rSize);
+        }
+    }
+
+    ok = fclose(f) == 0 && ok;
+
+    if (ok) {
+        g_remove(fileName.c_str());
+        ok = g_rename(tmpName.c_str(), fileName.c_str()) == 0;
+    }
+
+    if (!ok) {
+        g_remove(tmpName.c_str());
+    }
+}
+
+}
+
+namespace rtengine
+{
+
+std::string getFrameStamp(const Glib::RefPtr<Gio::FileInfo>& info)
+{
+    const Glib::TimeVal mtime = info->modification_time();
+    std::ostringstream s;
+    s << mtime.tv_sec << '.' << mtime.tv_usec << ':' << info->get_size();
+    return s.str();
+}
+
+RawImage* loadMasterFrame(const std::list<Glib::ustring>& pathNames, const std::string& kind, const std::function<void(RawImage&)>& postprocess)
+{
+    typedef unsigned int acc_t;
+
+    if (pathNames.empty()) {
+        return nullptr;
+    }
+
+    std::unique_ptr<RawImage> ri(new RawImage(pathNames.front())); // First file used also for extra pixels information (width, height, shutter, filters etc.. )
+
+    if (ri->loadRaw(true)) {
+        return nullptr;
+    }
+
+    ri->compress_image(0);
+
+    if (pathNames.size() == 1) {
+        if (postprocess) {
+            postprocess(*ri);
+        }
+
+        return ri.release();
+    }
+
+    const int H = ri->get_height();
+    const int W = ri->get_width();
+    const int rSize = W * ((ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1) ? 1 : 3);
+
+    // the cache key are the frames, so the cache has to be rebuilt if one of them changes
+    std::string key = kind;
+    Glib::ustring cacheFile;
+    const Glib::ustring cacheDir = getCacheDir();
+
+    if (!cacheDir.empty()) {
+        try {
+            std::string files = kind;
+
+            for (const auto& name : pathNames) {
+                files += '\n' + name.raw();
+                key += '\n' + name.raw() + '\t' + getFrameStamp(Gio::File::create_for_path(name)->query_info("time::modified,time::modified-usec,standard::size"));
+            }
+
+            // named after the files only, so a rebuilt master frame replaces the one of the previous versions of the files
+            std::ostringstream fileName;
+            fileName << kind << '_' << std::hex << std::hash<std::string>()(files) << ".rtm";
+            cacheFile = Glib::build_filename(cacheDir, fileName.str());
+        } catch (Glib::Exception&) {}
+    }
+
+    if (!cacheFile.empty() && readMasterFrame(cacheFile, key, *ri, rSize)) {
+        if (settings->verbose) {
+            printf("Loaded master %s frame of %d files from %s\n", kind.c_str(), static_cast<int>(pathNames.size()), cacheFile.c_str());
+        }
+
+        return ri.release();
+    }
+
+    std::vector<acc_t> acc(static_cast<std::size_t>(H) * rSize);
+
+    // copy first image into accumulators
+    for (int row = 0; row < H; row++) {
+        for (int col = 0; col < rSize; col++) {
+            acc[static_cast<std::size_t>(row) * rSize + col] = ri->data[row][col];
+        }
+    }
+
+    const std::vector<Glib::ustring> others(std::next(pathNames.begin()), pathNames.end());
+    int nFiles = 1; // First file data already loaded
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(std::min<int>(others.size(), maxParallelFrames))
+#endif
+
+    for (int i = 0; i < static_cast<int>(others.size()); ++i) {
+        RawImage temp(others[i]);
+
+        if (!temp.loadRaw(true)) {
+            temp.compress_image(0);     //\ TODO would be better working on original, because is temporary
+
+            if (temp.get_height() == H && temp.get_width() == W) {
+#ifdef _OPENMP
+                #pragma omp critical
+#endif
+                {
+                    nFiles++;
+
+                    for (int row = 0; row < H; row++) {
+                        acc_t* const accRow = &acc[static_cast<std::size_t>(row) * rSize];
+
+                        for (int col = 0; col < rSize; col++) {
+                            accRow[col] += temp.data[row][col];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int row = 0; row < H; row++) {
+        for (int col = 0; col < rSize; col++) {
+            ri->data[row][col] = acc[static_cast<std::size_t>(row) * rSize + col] / nFiles;
+        }
+    }
+
+    if (postprocess) {
+        postprocess(*ri);
+    }
+
+    if (!cacheFile.empty() && g_mkdir_with_parents(cacheDir.c_str(), 0755) == 0) {
+        writeMasterFrame(cacheFile, key, *ri, rSize);
+    }
+
+    return ri.release();
+}
+
+FrameIndex::FrameIndex(const std::string& name) :
+    name(name),
+    modified(false)
+{
+}
+
+void FrameIndex::load()
+{
+    entries.clear();
+    used.clear();
+    modified = false;
+
+    const Glib::ustring cacheDir = getCacheDir();
+
+    if (cacheDir.empty()) {
+        return;
+    }
+
+    try {
+        std::istringstream stream(Glib::file_get_contents(Glib::build_filename(cacheDir, name)));
+        std::string line;
+
+        while (std::getline(stream, line)) {
+            // path, stamp and the fields, separated by tabs
+            std::vector<std::string> parts;
+            std::string::size_type begin = 0;
+            std::string::size_type end;
+
+            while ((end = line.find('\t', begin)) != std::string::npos) {
+                parts.push_back(line.substr(begin, end - begin));
+                begin = end + 1;
+            }
+
+            parts.push_back(line.substr(begin));
+
+            if (parts.size() >= 2) {
+                Entry& entry = entries[parts[0]];
+                entry.stamp = parts[1];
+                entry.fields.assign(parts.begin() + 2, parts.end());
+            }
+        }
+    } catch (Glib::Exception&) {}
+}
+
+void FrameIndex::save()
+{
+    // entries which were not used belong to files which don't exist anymore
+    if (!modified && used.size() == entries.size()) {
+        return;
+    }
+
+    const Glib::ustring cacheDir = getCacheDir();
+
+    if (cacheDir.empty()) {
+        return;
+    }
+
+    std::ostringstream stream;
+
+    for (const auto& entry : used) {
+        stream << entry.first.raw() << '\t' << entry.second.stamp;
+
+        for (const auto& field : entry.second.fields) {
+            stream << '\t' << field;
+        }
+
+        stream << '\n';
+    }
+
+    try {
+        if (g_mkdir_with_parents(cacheDir.c_str(), 0755) == 0) {
+            Glib::file_set_contents(Glib::build_filename(cacheDir, name), stream.str());
+            entries = used;
+            modified = false;
+        }
+    } catch (Glib::Exception&) {}
+}
+
+bool FrameIndex::find(const Glib::ustring& path, const std::string& stamp, std::vector<std::string>& fields)
+{
+    const auto entry = entries.find(path);
+
+    if (entry == entries.end() || entry->second.stamp != stamp) {
+        return false;
+    }
+
+    fields = entry->second.fields;
+    used[path] = entry->second;
+    return true;
+}
+
+void FrameIndex::store(const Glib::ustring& path, const std::string& stamp, const std::vector<std::string>& fields)
+{
+    const auto separator = [](const std::string& s)
+    {
+        return s.find_first_of("\t\n") != std::string::npos;
+    };
+
+    if (separator(path.raw()) || std::any_of(fields.begin(), fields.end(), separator)) {
+        return;
+    }
+
+    used[path] = {stamp, fields};
+    modified = true;
+}
+
+std::string FrameIndex::toField(double value)
+{
+    std::ostringstream s;
+    s.imbue(std::locale::classic());
+    s.precision(17);
+    s << value;
+    return s.str();
+}
+
+bool FrameIndex::fromField(const std::string& field, double& value)
+{
+    std::istringstream s(field);
+    s.imbue(std::locale::classic());
+    return static_cast<bool>(s >> value);
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glibmm/refptr.h>
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+
+namespace Gio
+{
+class FileInfo;
+}
+
+namespace rtengine
+{
+
+class RawImage;
+
+/**
+ * @brief Modification time and size of a file, as reported by a query for "time::modified,time::modified-usec,standard::size"
+ */
+std::string getFrameStamp(const Glib::RefPtr<Gio::FileInfo>& info);
+
+/**
+ * @brief Average of the raw data of several dark or flat frames
+ *
+ * The frames are decoded in parallel. The average is kept in the cache directory, keyed by the paths,
+ * modification times and sizes of the frames, so later sessions only decode the first frame for its layout.
+ * There is one cached average per kind and list of frames, it gets replaced when one of the frames changes.
+ *
+ * @param pathNames frames to average, the first one provides everything but the pixel data
+ * @param kind name of the kind of frame, part of the cache key
+ * @param postprocess applied to the average before it gets cached, may be empty
+ * @return the master frame, owned by the caller, nullptr if the first frame can't be loaded
+ */
+RawImage* loadMasterFrame(const std::list<Glib::ustring>& pathNames, const std::string& kind, const std::function<void(RawImage&)>& postprocess);
+
+/**
+ * @brief Metadata of the frames of a dark or flat frame directory, kept between sessions
+ *
+ * Entries are keyed by path and frame stamp, so files which changed are read again. Only the entries
+ * which were looked up or stored since load() are saved.
+ */
+class FrameIndex :
+    public NonCopyable
+{
+public:
+    explicit FrameIndex(const std::string& name);
+
+    void load();
+    void save();
+
+    bool find(const Glib::ustring& path, const std::string& stamp, std::vector<std::string>& fields);
+    void store(const Glib::ustring& path, const std::string& stamp, const std::vector<std::string>& fields);
+
+    // locale independent conversion of numeric fields
+    static std::string toField(double value);
+    static bool fromField(const std::string& field, double& value);
+
+private:
+    struct Entry {
+        std::string stamp;
+        std::vector<std::string> fields;
+    };
+
+    const std::string name;
+    std::map<Glib::ustring, Entry> entries;
+    std::map<Glib::ustring, Entry> used;
+    bool modified;
+};
+
+}
@@ -214,7 +214,7 @@ int fscanf (IMFILE* f, const char* s ...)
     // were parsed. However, only dcraw.cc code use it and only for "%f" and
     // "%d", so we make a dummy fscanf here just to support dcraw case.
     char buf[51], *endptr = nullptr;
-    int copy_sz = f->size - f->pos;
+    int copy_sz = std::max<ssize_t>(f->size - f->pos, 0);
 
     if (copy_sz >= static_cast<int>(sizeof(buf))) {
         copy_sz = sizeof(buf) - 1;
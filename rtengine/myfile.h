@@ -18,6 +18,7 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -68,24 +69,28 @@ inline int feof (IMFILE* f)
     return f->eof;
 }
 
-inline void fseek (IMFILE* f, int p, int how)
+// like the stdio version, positions beyond the end are allowed (reading there hits EOF), negative ones fail
+inline int fseek (IMFILE* f, int p, int how)
 {
-    int fpos = f->pos;
+    ssize_t npos;
 
     if (how == SEEK_SET) {
-        f->pos = p;
+        npos = p;
     } else if (how == SEEK_CUR) {
-        f->pos += p;
+        npos = f->pos + p;
     } else if (how == SEEK_END) {
-        if(p <= 0 && -p <= f->size) {
-            f->pos = f->size + p;
-        }
-        return;
+        npos = f->size + p;
+    } else {
+        return -1;
     }
 
-    if (f->pos < 0  || f->pos > f->size) {
-        f->pos = fpos;
+    if (npos < 0) {
+        return -1;
     }
+
+    f->pos = npos;
+    f->eof = false;
+    return 0;
 }
 
 inline int fgetc (IMFILE* f)
@@ -113,7 +118,7 @@ inline int fread (void* dst, int es, int count, IMFILE* f)
 {
 
     int s = es * count;
-    int avail = f->size - f->pos;
+    int avail = std::max<ssize_t>(f->size - f->pos, 0);
 
     if (s <= avail) {
         memcpy (dst, f->data + f->pos, s);
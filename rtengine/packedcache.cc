@@ -0,0 +1,819 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include <glib/gstdio.h>
+
+#ifdef WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/file.h>
+#endif
+
+#include "packedcache.h"
+
+#include "settings.h"
+
+namespace
+{
+
+constexpr char fileMagic[8] = {'R', 'T', 'P', 'A', 'C', 'K', '\n', '\0'};
+constexpr std::uint32_t fileVersion = 1;
+constexpr std::uint64_t fileHeaderSize = 16;
+
+constexpr std::uint32_t recordMagic = 0x52505452; // "RTPR"
+constexpr std::uint32_t indexMagic = 0x49505452;  // "RTPI"
+constexpr std::uint8_t tombstone = 1;
+
+constexpr std::size_t md5Size = 32;
+constexpr std::uint8_t recordTypes = 4;
+
+// records appended after the data file was mapped are read with stdio until the unmapped tail gets this large
+constexpr std::uint64_t minRemapBytes = 4 << 20;
+
+struct RecordHeader {
+    std::uint32_t magic;
+    std::uint32_t size;
+    std::uint8_t record;
+    std::uint8_t flags;
+    std::uint8_t reserved[6];
+    char md5[md5Size];
+};
+
+static_assert(sizeof(RecordHeader) == 48, "Unexpected padding in RecordHeader");
+
+struct IndexHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t dataSize;
+    std::uint64_t clock;
+    std::uint64_t count;
+};
+
+struct IndexEntry {
+    char key[md5Size + 1];
+    char reserved[3];
+    std::uint32_t size;
+    std::uint64_t offset;
+    std::uint64_t lastAccess;
+};
+
+static_assert(sizeof(IndexEntry) == 56, "Unexpected padding in IndexEntry");
+
+std::uint64_t alignedSize(std::uint64_t size)
+{
+    return (size + 7) & ~std::uint64_t(7);
+}
+
+std::uint64_t recordBytes(std::uint64_t size)
+{
+    return sizeof(RecordHeader) + alignedSize(size);
+}
+
+std::string makeKey(const std::string& md5, std::uint8_t record)
+{
+    std::string key(md5);
+    key.push_back(static_cast<char>(record));
+    return key;
+}
+
+int seekTo(FILE* f, std::uint64_t pos)
+{
+#ifdef WIN32
+    return _fseeki64(f, pos, SEEK_SET);
+#else
+    return fseeko(f, pos, SEEK_SET);
+#endif
+}
+
+std::uint64_t fileLength(FILE* f)
+{
+#ifdef WIN32
+    return _fseeki64(f, 0, SEEK_END) ? 0 : _ftelli64(f);
+#else
+    return fseeko(f, 0, SEEK_END) ? 0 : ftello(f);
+#endif
+}
+
+bool writeFileHeader(FILE* f)
+{
+    char header[fileHeaderSize] = {};
+    std::memcpy(header, fileMagic, sizeof(fileMagic));
+    std::memcpy(header + sizeof(fileMagic), &fileVersion, sizeof(fileVersion));
+    return fwrite(header, 1, sizeof(header), f) == sizeof(header);
+}
+
+bool replaceFile(const Glib::ustring& from, const Glib::ustring& to)
+{
+#ifdef WIN32
+    g_remove(to.c_str());
+#endif
+    return g_rename(from.c_str(), to.c_str()) == 0;
+}
+
+}
+
+namespace rtengine
+{
+
+PackedCache::PackedCache(const Glib::ustring& baseName, std::uint64_t maxBytes) :
+    dataFileName(baseName + ".pack"),
+    indexFileName(baseName + ".idx"),
+    lockFileName(baseName + ".lock"),
+    maxBytes(maxBytes),
+    lockFile(nullptr),
+    lockedElsewhere(false),
+    dataFile(nullptr),
+    mapping(nullptr),
+    mappedData(nullptr),
+    mappedSize(0),
+    fileSize(0),
+    liveBytes(0),
+    deadBytes(0),
+    clock(0),
+    indexDirty(false)
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (!this->lock()) {
+        if (settings->verbose) {
+            printf("PackedCache: \"%s\" is %s\n", dataFileName.c_str(), lockedElsewhere ? "in use by another process" : "not accessible");
+        }
+        return;
+    }
+
+    if (!openDataFile()) {
+        if (settings->verbose) {
+            printf("PackedCache: unable to open \"%s\"\n", dataFileName.c_str());
+        }
+        unlock();
+        return;
+    }
+
+    if (!loadIndex()) {
+        // index missing or out of date, rebuild it from the record headers
+        if (!scan()) {
+            // truncated or damaged tail, keep what could be read
+            compactLocked();
+        }
+        indexDirty = true;
+    }
+}
+
+PackedCache::~PackedCache()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (dataFile && indexDirty) {
+        writeIndex();
+    }
+
+    unmap();
+    closeDataFile();
+    unlock();
+}
+
+bool PackedCache::isOpen() const
+{
+    MyMutex::MyLock lock(mutex);
+    return dataFile;
+}
+
+bool PackedCache::isLockedElsewhere() const
+{
+    MyMutex::MyLock lock(mutex);
+    return lockedElsewhere;
+}
+
+bool PackedCache::get(const std::string& md5, Record record, std::vector<char>& data)
+{
+    MyMutex::MyLock lock(mutex);
+    return getLocked(makeKey(md5, static_cast<std::uint8_t>(record)), data);
+}
+
+bool PackedCache::put(const std::string& md5, Record record, const void* data, std::size_t size)
+{
+    if (md5.size() != md5Size || size > std::numeric_limits<std::uint32_t>::max()) {
+        return false;
+    }
+
+    MyMutex::MyLock lock(mutex);
+    return putLocked(makeKey(md5, static_cast<std::uint8_t>(record)), data, size);
+}
+
+bool PackedCache::contains(const std::string& md5, Record record) const
+{
+    MyMutex::MyLock lock(mutex);
+    return index.count(makeKey(md5, static_cast<std::uint8_t>(record)));
+}
+
+void PackedCache::remove(const std::string& md5)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (std::uint8_t record = 0; record < recordTypes; ++record) {
+        removeLocked(makeKey(md5, record), true);
+    }
+}
+
+void PackedCache::remove(const std::string& md5, Record record)
+{
+    MyMutex::MyLock lock(mutex);
+    removeLocked(makeKey(md5, static_cast<std::uint8_t>(record)), true);
+}
+
+void PackedCache::rename(const std::string& oldMd5, const std::string& newMd5)
+{
+    if (newMd5.size() != md5Size || oldMd5 == newMd5) {
+        return;
+    }
+
+    MyMutex::MyLock lock(mutex);
+
+    std::vector<char> data;
+
+    for (std::uint8_t record = 0; record < recordTypes; ++record) {
+        const std::string oldKey = makeKey(oldMd5, record);
+
+        if (getLocked(oldKey, data)) {
+            putLocked(makeKey(newMd5, record), data.data(), data.size());
+            removeLocked(oldKey, true);
+        }
+    }
+}
+
+void PackedCache::clear()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (!lockFile) {
+        return;
+    }
+
+    unmap();
+    closeDataFile();
+    g_remove(dataFileName.c_str());
+    g_remove(indexFileName.c_str());
+
+    index.clear();
+    liveBytes = 0;
+    deadBytes = 0;
+    clock = 0;
+    indexDirty = true;
+
+    openDataFile();
+}
+
+void PackedCache::applySizeLimitation()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (!dataFile) {
+        return;
+    }
+
+    bool evicted = false;
+
+    if (liveBytes > maxBytes) {
+        // LRU is tracked per record, but evicting an image drops all of its records
+        std::unordered_map<std::string, std::uint64_t> lastAccess;
+
+        for (const auto& entry : index) {
+            auto& access = lastAccess[entry.first.substr(0, md5Size)];
+            access = std::max(access, entry.second.lastAccess);
+        }
+
+        std::vector<std::pair<std::uint64_t, std::string>> images;
+        images.reserve(lastAccess.size());
+
+        for (const auto& image : lastAccess) {
+            images.emplace_back(image.second, image.first);
+        }
+
+        std::sort(images.begin(), images.end());
+
+        const std::uint64_t target = maxBytes - maxBytes * 5 / 100; // reserve 5% free cache space
+
+        for (const auto& image : images) {
+            if (liveBytes <= target) {
+                break;
+            }
+
+            for (std::uint8_t record = 0; record < recordTypes; ++record) {
+                // no tombstones needed, the file is compacted right below
+                removeLocked(makeKey(image.second, record), false);
+            }
+
+            evicted = true;
+        }
+    }
+
+    if (evicted || deadBytes > liveBytes / 4) {
+        compactLocked();
+    }
+
+    if (indexDirty) {
+        writeIndex();
+    }
+}
+
+bool PackedCache::compact()
+{
+    MyMutex::MyLock lock(mutex);
+
+    const bool res = compactLocked();
+
+    if (res) {
+        writeIndex();
+    }
+
+    return res;
+}
+
+void PackedCache::flush()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (dataFile && indexDirty) {
+        writeIndex();
+    }
+}
+
+bool PackedCache::lock()
+{
+#ifdef WIN32
+    // a handle without sharing is released by the system when the process ends
+    std::unique_ptr<wchar_t, GFreeFunc> wfname(reinterpret_cast<wchar_t*>(g_utf8_to_utf16(lockFileName.c_str(), -1, nullptr, nullptr, nullptr)), g_free);
+    const HANDLE hFile = CreateFileW(wfname.get(), GENERIC_READ | GENERIC_WRITE, 0 /* no sharing allowed */, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        lockedElsewhere = GetLastError() == ERROR_SHARING_VIOLATION;
+        return false;
+    }
+
+    lockFile = _fdopen(_open_osfhandle(reinterpret_cast<intptr_t>(hFile), 0), "r+b");
+
+    if (!lockFile) {
+        CloseHandle(hFile);
+        return false;
+    }
+#else
+    lockFile = g_fopen(lockFileName.c_str(), "a+b");
+
+    if (!lockFile) {
+        return false;
+    }
+
+    // flock() locks are released with the last descriptor, even if the process gets killed
+    if (flock(fileno(lockFile), LOCK_EX | LOCK_NB)) {
+        lockedElsewhere = errno == EWOULDBLOCK;
+        fclose(lockFile);
+        lockFile = nullptr;
+        return false;
+    }
+#endif
+
+    lockedElsewhere = false;
+    return true;
+}
+
+void PackedCache::unlock()
+{
+    // the lock file stays, removing it would race with another process locking it
+    if (lockFile) {
+        fclose(lockFile);
+        lockFile = nullptr;
+    }
+}
+
+bool PackedCache::openDataFile()
+{
+    dataFile = g_fopen(dataFileName.c_str(), "r+b");
+
+    if (dataFile) {
+        char header[fileHeaderSize];
+
+        if (
+            fread(header, 1, sizeof(header), dataFile) != sizeof(header)
+            || std::memcmp(header, fileMagic, sizeof(fileMagic))
+            || std::memcmp(header + sizeof(fileMagic), &fileVersion, sizeof(fileVersion))
+        ) {
+            // foreign or outdated file, start over
+            fclose(dataFile);
+            dataFile = nullptr;
+        }
+    }
+
+    if (!dataFile) {
+        dataFile = g_fopen(dataFileName.c_str(), "w+b");
+
+        if (!dataFile) {
+            return false;
+        }
+
+        if (!writeFileHeader(dataFile) || fflush(dataFile)) {
+            closeDataFile();
+            return false;
+        }
+    }
+
+    fileSize = fileLength(dataFile);
+
+    if (fileSize < fileHeaderSize) {
+        closeDataFile();
+        return false;
+    }
+
+    return true;
+}
+
+void PackedCache::closeDataFile()
+{
+    if (dataFile) {
+        fclose(dataFile);
+        dataFile = nullptr;
+    }
+
+    fileSize = 0;
+}
+
+bool PackedCache::map()
+{
+    unmap();
+
+    if (!dataFile || fflush(dataFile)) {
+        return false;
+    }
+
+    GError* error = nullptr;
+    mapping = g_mapped_file_new(dataFileName.c_str(), FALSE, &error);
+
+    if (!mapping) {
+        if (settings->verbose && error) {
+            printf("PackedCache: unable to map \"%s\": %s\n", dataFileName.c_str(), error->message);
+        }
+
+        if (error) {
+            g_error_free(error);
+        }
+
+        return false;
+    }
+
+    mappedData = g_mapped_file_get_contents(mapping);
+    mappedSize = g_mapped_file_get_length(mapping);
+    return true;
+}
+
+void PackedCache::unmap()
+{
+    if (mapping) {
+        g_mapped_file_unref(mapping);
+        mapping = nullptr;
+    }
+
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+bool PackedCache::loadIndex()
+{
+    FILE* f = g_fopen(indexFileName.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    IndexHeader header;
+
+    if (
+        fread(&header, sizeof(header), 1, f) != 1
+        || header.magic != indexMagic
+        || header.version != fileVersion
+        || header.dataSize != fileSize
+    ) {
+        fclose(f);
+        return false;
+    }
+
+    index.clear();
+    index.reserve(header.count);
+    liveBytes = 0;
+
+    IndexEntry entry;
+
+    for (std::uint64_t i = 0; i < header.count; ++i) {
+        if (
+            fread(&entry, sizeof(entry), 1, f) != 1
+            || static_cast<unsigned char>(entry.key[md5Size]) >= recordTypes
+            || entry.offset + entry.size > fileSize
+        ) {
+            fclose(f);
+            index.clear();
+            liveBytes = 0;
+            return false;
+        }
+
+        index.emplace(std::string(entry.key, md5Size + 1), Entry{entry.offset, entry.size, entry.lastAccess});
+        liveBytes += recordBytes(entry.size);
+    }
+
+    fclose(f);
+
+    clock = header.clock;
+    deadBytes = fileSize - fileHeaderSize > liveBytes ? fileSize - fileHeaderSize - liveBytes : 0;
+    indexDirty = false;
+
+    return true;
+}
+
+bool PackedCache::writeIndex()
+{
+    const Glib::ustring tmpName = indexFileName + ".tmp";
+    FILE* f = g_fopen(tmpName.c_str(), "wb");
+
+    if (!f) {
+        return false;
+    }
+
+    const IndexHeader header = {indexMagic, fileVersion, fileSize, clock, index.size()};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    IndexEntry entry = {};
+
+    for (auto it = index.cbegin(); ok && it != index.cend(); ++it) {
+        std::memcpy(entry.key, it->first.data(), md5Size + 1);
+        entry.size = it->second.size;
+        entry.offset = it->second.offset;
+        entry.lastAccess = it->second.lastAccess;
+        ok = fwrite(&entry, sizeof(entry), 1, f) == 1;
+    }
+
+    ok = !fclose(f) && ok;
+
+    if (!ok || !replaceFile(tmpName, indexFileName)) {
+        g_remove(tmpName.c_str());
+        return false;
+    }
+
+    indexDirty = false;
+    return true;
+}
+
+bool PackedCache::scan()
+{
+    index.clear();
+    liveBytes = 0;
+    deadBytes = 0;
+    clock = 0;
+
+    if (!map()) {
+        return true;
+    }
+
+    std::uint64_t pos = fileHeaderSize;
+    RecordHeader header;
+
+    while (pos + sizeof(header) <= mappedSize) {
+        std::memcpy(&header, mappedData + pos, sizeof(header));
+
+        const std::uint64_t payload = pos + sizeof(header);
+
+        if (header.magic != recordMagic || header.record >= recordTypes || payload + header.size > mappedSize) {
+            break;
+        }
+
+        const std::string key = makeKey(std::string(header.md5, md5Size), header.record);
+        const auto it = index.find(key);
+
+        if (it != index.end()) {
+            // superseded by this record
+            liveBytes -= recordBytes(it->second.size);
+            deadBytes += recordBytes(it->second.size);
+            index.erase(it);
+        }
+
+        if (header.flags & tombstone) {
+            deadBytes += recordBytes(0);
+        } else {
+            index.emplace(key, Entry{payload, header.size, ++clock});
+            liveBytes += recordBytes(header.size);
+        }
+
+        pos = payload + alignedSize(header.size);
+    }
+
+    return pos == mappedSize;
+}
+
+bool PackedCache::getLocked(const std::string& key, std::vector<char>& data)
+{
+    const auto it = index.find(key);
+
+    if (it == index.end()) {
+        return false;
+    }
+
+    Entry& entry = it->second;
+
+    if (entry.offset + entry.size > mappedSize && fileSize - mappedSize >= std::max(mappedSize / 8, minRemapBytes)) {
+        // the file has grown well past the mapping, remapping is worth it
+        map();
+    }
+
+    if (entry.offset + entry.size <= mappedSize) {
+        data.assign(mappedData + entry.offset, mappedData + entry.offset + entry.size);
+    } else {
+        // appended after the last mapping
+        data.resize(entry.size);
+
+        if (!dataFile || seekTo(dataFile, entry.offset) || (entry.size && fread(data.data(), 1, entry.size, dataFile) != entry.size)) {
+            data.clear();
+            return false;
+        }
+    }
+
+    entry.lastAccess = ++clock;
+    indexDirty = true;
+
+    return true;
+}
+
+bool PackedCache::putLocked(const std::string& key, const void* data, std::size_t size)
+{
+    std::uint64_t offset;
+
+    if (!appendRecord(key, 0, data, size, offset)) {
+        return false;
+    }
+
+    const auto it = index.find(key);
+
+    if (it != index.end()) {
+        liveBytes -= recordBytes(it->second.size);
+        deadBytes += recordBytes(it->second.size);
+        it->second = Entry{offset, static_cast<std::uint32_t>(size), ++clock};
+    } else {
+        index.emplace(key, Entry{offset, static_cast<std::uint32_t>(size), ++clock});
+    }
+
+    liveBytes += recordBytes(size);
+    indexDirty = true;
+
+    return true;
+}
+
+bool PackedCache::appendRecord(const std::string& key, std::uint8_t flags, const void* data, std::size_t size, std::uint64_t& payloadOffset)
+{
+    if (!dataFile || seekTo(dataFile, fileSize)) {
+        return false;
+    }
+
+    RecordHeader header = {};
+    header.magic = recordMagic;
+    header.size = size;
+    header.record = static_cast<std::uint8_t>(key[md5Size]);
+    header.flags = flags;
+    std::memcpy(header.md5, key.data(), md5Size);
+
+    static const char padding[8] = {};
+    const std::size_t paddingSize = alignedSize(size) - size;
+
+    const bool ok =
+        fwrite(&header, sizeof(header), 1, dataFile) == 1
+        && (size == 0 || fwrite(data, 1, size, dataFile) == size)
+        && (paddingSize == 0 || fwrite(padding, 1, paddingSize, dataFile) == paddingSize)
+        && !fflush(dataFile);
+
+    if (!ok) {
+        // fileSize is left untouched, so the partial record gets overwritten by the next append
+        return false;
+    }
+
+    payloadOffset = fileSize + sizeof(header);
+    fileSize += recordBytes(size);
+
+    return true;
+}
+
+void PackedCache::removeLocked(const std::string& key, bool writeTombstone)
+{
+    const auto it = index.find(key);
+
+    if (it == index.end()) {
+        return;
+    }
+
+    std::uint64_t offset;
+
+    if (writeTombstone && appendRecord(key, tombstone, nullptr, 0, offset)) {
+        deadBytes += recordBytes(0);
+    }
+
+    liveBytes -= recordBytes(it->second.size);
+    deadBytes += recordBytes(it->second.size);
+    index.erase(it);
+    indexDirty = true;
+}
+
+bool PackedCache::compactLocked()
+{
+    if (!dataFile || !map()) {
+        return false;
+    }
+
+    const Glib::ustring tmpName = dataFileName + ".tmp";
+    FILE* f = g_fopen(tmpName.c_str(), "wb");
+
+    if (!f) {
+        return false;
+    }
+
+    // copy the live records in file order to keep reading the mapping sequential
+    std::vector<Index::value_type*> entries;
+    entries.reserve(index.size());
+
+    for (auto& entry : index) {
+        entries.push_back(&entry);
+    }
+
+    std::sort(
+        entries.begin(),
+        entries.end(),
+        [](const Index::value_type* lhs, const Index::value_type* rhs) -> bool
+        {
+            return lhs->second.offset < rhs->second.offset;
+        }
+    );
+
+    static const char padding[8] = {};
+    std::vector<std::uint64_t> offsets(entries.size());
+    std::uint64_t pos = fileHeaderSize;
+    bool ok = writeFileHeader(f);
+
+    for (std::size_t i = 0; ok && i < entries.size(); ++i) {
+        const Entry& entry = entries[i]->second;
+        const std::size_t bytes = sizeof(RecordHeader) + entry.size;
+        const std::size_t paddingSize = alignedSize(entry.size) - entry.size;
+
+        ok =
+            fwrite(mappedData + entry.offset - sizeof(RecordHeader), 1, bytes, f) == bytes
+            && (paddingSize == 0 || fwrite(padding, 1, paddingSize, f) == paddingSize);
+
+        offsets[i] = pos + sizeof(RecordHeader);
+        pos += recordBytes(entry.size);
+    }
+
+    ok = !fclose(f) && ok;
+
+    if (!ok) {
+        g_remove(tmpName.c_str());
+        return false;
+    }
+
+    unmap();
+    closeDataFile();
+
+    if (!replaceFile(tmpName, dataFileName)) {
+        g_remove(tmpName.c_str());
+
+        if (openDataFile() && !scan()) {
+            index.clear();
+            liveBytes = 0;
+        }
+
+        indexDirty = true;
+        return false;
+    }
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        entries[i]->second.offset = offsets[i];
+    }
+
+    deadBytes = 0;
+    indexDirty = true;
+
+    return openDataFile();
+}
+
+}
@@ -0,0 +1,131 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/**
+ * Single file store for the thumbnail cache
+ *
+ * Every record (thumbnail image, AE histogram, embedded profile, data KeyFile) is appended to one
+ * data file which is memory mapped for reading. A hash index keyed by the MD5 of the image and the
+ * record type points into that file. The index is written next to the data file together with the
+ * access stamps used for LRU eviction, and rebuilt by scanning the data file if it is missing or
+ * stale. Overwritten and removed records leave dead space behind which is reclaimed by compact().
+ *
+ * The store is used by one process at a time, an exclusive lock on a ".lock" file next to it is
+ * held as long as it is open. If another process holds the lock, the store doesn't open.
+ */
+class PackedCache final :
+    public NonCopyable
+{
+public:
+    enum class Record : std::uint8_t {
+        DATA = 0,         // KeyFile shared by CacheImageData and rtengine::Thumbnail
+        IMAGE = 1,        // thumbnail image, same layout as the .rtti files
+        AE_HISTOGRAM = 2,
+        EMB_PROFILE = 3
+    };
+
+    /**
+     * @param baseName path of the store without extension, ".pack", ".idx" and ".lock" are appended
+     * @param maxBytes limit of the live payload enforced by applySizeLimitation()
+     */
+    PackedCache(const Glib::ustring& baseName, std::uint64_t maxBytes);
+    ~PackedCache();
+
+    bool isOpen() const;
+    // true if the store didn't open because another process uses it
+    bool isLockedElsewhere() const;
+
+    bool get(const std::string& md5, Record record, std::vector<char>& data);
+    bool put(const std::string& md5, Record record, const void* data, std::size_t size);
+    bool contains(const std::string& md5, Record record) const;
+
+    void remove(const std::string& md5);
+    void remove(const std::string& md5, Record record);
+    void rename(const std::string& oldMd5, const std::string& newMd5);
+    void clear();
+
+    // Evicts the least recently used images until the live payload fits into maxBytes, then compacts
+    void applySizeLimitation();
+    bool compact();
+    void flush();
+
+private:
+    struct Entry {
+        std::uint64_t offset; // of the payload
+        std::uint32_t size;
+        std::uint64_t lastAccess;
+    };
+
+    using Index = std::unordered_map<std::string, Entry>;
+
+    bool lock();
+    void unlock();
+    bool openDataFile();
+    void closeDataFile();
+    bool map();
+    void unmap();
+
+    bool loadIndex();
+    bool writeIndex();
+    bool scan();
+
+    bool getLocked(const std::string& key, std::vector<char>& data);
+    bool putLocked(const std::string& key, const void* data, std::size_t size);
+    bool appendRecord(const std::string& key, std::uint8_t flags, const void* data, std::size_t size, std::uint64_t& payloadOffset);
+    void removeLocked(const std::string& key, bool writeTombstone);
+    bool compactLocked();
+
+    const Glib::ustring dataFileName;
+    const Glib::ustring indexFileName;
+    const Glib::ustring lockFileName;
+    const std::uint64_t maxBytes;
+
+    FILE* lockFile;
+    bool lockedElsewhere;
+    FILE* dataFile;
+    GMappedFile* mapping;
+    const char* mappedData;
+    std::uint64_t mappedSize;
+    std::uint64_t fileSize;
+
+    Index index;
+    std::uint64_t liveBytes;
+    std::uint64_t deadBytes;
+    std::uint64_t clock;
+    bool indexDirty;
+
+    mutable MyMutex mutex;
+};
+
+}
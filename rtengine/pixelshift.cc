@@ -20,8 +20,11 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
 #include <stack>
+#include <vector>
 
 #include "array2D.h"
 #include "gauss.h"
@@ -342,35 +345,89 @@ BENCHFUN
                 } else {
                     amaze_demosaic_RT(winx, winy, winw, winh, *(rawDataFrames[0]), red, green, blue, options.chunkSizeAMAZE, options.measure);
                 }
-                multi_array2D<float, 3> redTmp(winw, winh);
-                multi_array2D<float, 3> greenTmp(winw, winh);
-                multi_array2D<float, 3> blueTmp(winw, winh);
-
-                for(int i = 0; i < 3; i++) {
-                    if (bayerParams.pixelShiftDemosaicMethod == bayerParams.getPSDemosaicMethodString(procparams::RAWParams::BayerSensor::PSDemosaicMethod::LMMSE)) {
-                        lmmse_interpolate_omp(winw, winh, *(rawDataFrames[i + 1]), redTmp[i], greenTmp[i], blueTmp[i], bayerParams.lmmse_iterations);
-                    } else if (bayerParams.pixelShiftDemosaicMethod == bayerParams.getPSDemosaicMethodString(procparams::RAWParams::BayerSensor::PSDemosaicMethod::AMAZEVNG4)) {
-                        dual_demosaic_RT (true, rawParamsIn, winw, winh, *(rawDataFrames[i + 1]), redTmp[i], greenTmp[i], blueTmp[i], bayerParams.dualDemosaicContrast, true);
-                    } else {
-                        amaze_demosaic_RT(winx, winy, winw, winh, *(rawDataFrames[i + 1]), redTmp[i], greenTmp[i], blueTmp[i], options.chunkSizeAMAZE, options.measure);
-                    }
-                }
-
+                // median of the four frames, the demosaiced frames 1 to 3 (tmp[frame - 1][channel]) are shifted by one pixel against frame 0
+                const auto medianFrames =
+                    [&](int rowStart, int rowEnd, const array2D<float>* const tmp[3][3])
+                    {
 #ifdef _OPENMP
-                #pragma omp parallel for schedule(dynamic,16)
+                        #pragma omp parallel for schedule(dynamic,16)
 #endif
 
-                for(int i = winy + border; i < winh - border; i++) {
-                    for(int j = winx + border; j < winw - border; j++) {
-                        red[i][j] = median(red[i][j], redTmp[0][i + 1][j], redTmp[1][i + 1][j + 1], redTmp[2][i][j + 1]);
-                    }
+                        for(int i = rowStart; i < rowEnd; i++) {
+                            for(int j = winx + border; j < winw - border; j++) {
+                                red[i][j] = median(red[i][j], (*tmp[0][0])[i + 1][j], (*tmp[1][0])[i + 1][j + 1], (*tmp[2][0])[i][j + 1]);
+                            }
+
+                            for(int j = winx + border; j < winw - border; j++) {
+                                green[i][j] = median(green[i][j], (*tmp[0][1])[i + 1][j], (*tmp[1][1])[i + 1][j + 1], (*tmp[2][1])[i][j + 1]);
+                            }
 
-                    for(int j = winx + border; j < winw - border; j++) {
-                        green[i][j] = median(green[i][j], greenTmp[0][i + 1][j], greenTmp[1][i + 1][j + 1], greenTmp[2][i][j + 1]);
+                            for(int j = winx + border; j < winw - border; j++) {
+                                blue[i][j] = median(blue[i][j], (*tmp[0][2])[i + 1][j], (*tmp[1][2])[i + 1][j + 1], (*tmp[2][2])[i][j + 1]);
+                            }
+                        }
+                    };
+
+                if (bayerParams.pixelShiftDemosaicMethod == bayerParams.getPSDemosaicMethodString(procparams::RAWParams::BayerSensor::PSDemosaicMethod::LMMSE)
+                        || bayerParams.pixelShiftDemosaicMethod == bayerParams.getPSDemosaicMethodString(procparams::RAWParams::BayerSensor::PSDemosaicMethod::AMAZEVNG4)) {
+                    // these demosaicers only work on whole frames
+                    multi_array2D<float, 3> redTmp(winw, winh);
+                    multi_array2D<float, 3> greenTmp(winw, winh);
+                    multi_array2D<float, 3> blueTmp(winw, winh);
+
+                    for(int i = 0; i < 3; i++) {
+                        if (bayerParams.pixelShiftDemosaicMethod == bayerParams.getPSDemosaicMethodString(procparams::RAWParams::BayerSensor::PSDemosaicMethod::LMMSE)) {
+                            lmmse_interpolate_omp(winw, winh, *(rawDataFrames[i + 1]), redTmp[i], greenTmp[i], blueTmp[i], bayerParams.lmmse_iterations);
+                        } else {
+                            dual_demosaic_RT (true, rawParamsIn, winw, winh, *(rawDataFrames[i + 1]), redTmp[i], greenTmp[i], blueTmp[i], bayerParams.dualDemosaicContrast, true);
+                        }
                     }
 
-                    for(int j = winx + border; j < winw - border; j++) {
-                        blue[i][j] = median(blue[i][j], blueTmp[0][i + 1][j], blueTmp[1][i + 1][j + 1], blueTmp[2][i][j + 1]);
+                    const array2D<float>* const tmp[3][3] = {
+                        {&redTmp[0], &greenTmp[0], &blueTmp[0]},
+                        {&redTmp[1], &greenTmp[1], &blueTmp[1]},
+                        {&redTmp[2], &greenTmp[2], &blueTmp[2]}
+                    };
+                    medianFrames(winy + border, winh - border, tmp);
+                } else {
+                    // AMaZE works on windows, so frames 1 to 3 are demosaiced in horizontal strips and only one strip of
+                    // each frame is resident. The strips get a margin of real data because AMaZE mirrors the data at the
+                    // borders of its window. Rows outside of a strip are never read, they point to a scratch row which
+                    // takes the writes of the border interpolation. Each plane has its own scratch row, the last row of
+                    // its buffer, so no two planes ever write to the same memory.
+                    constexpr int stripHeight = 256;
+                    constexpr int stripMargin = 32;
+                    constexpr int bufferHeight = stripHeight + 1 + 2 * stripMargin + 1;
+                    std::vector<float> stripBuffer(static_cast<std::size_t>(9) * bufferHeight * winw);
+                    std::vector<float*> rows(winh);
+
+                    for(int top = winy + border; top < winh - border; top += stripHeight) {
+                        const int bottom = std::min(top + stripHeight, winh - border);
+                        const int y0 = std::max(top - stripMargin, winy);
+                        const int y1 = std::min(bottom + 1 + stripMargin, winh);
+                        std::unique_ptr<array2D<float>> strips[3][3];
+
+                        for(int i = 0; i < 3; i++) {
+                            for(int c = 0; c < 3; c++) {
+                                float* const buffer = &stripBuffer[static_cast<std::size_t>(i * 3 + c) * bufferHeight * winw];
+                                std::fill(rows.begin(), rows.end(), buffer + static_cast<std::size_t>(bufferHeight - 1) * winw);
+
+                                for(int row = y0; row < y1; row++) {
+                                    rows[row] = buffer + static_cast<std::size_t>(row - y0) * winw;
+                                }
+
+                                strips[i][c].reset(new array2D<float>(winw, winh, rows.data(), ARRAY2D_BYREFERENCE));
+                            }
+
+                            amaze_demosaic_RT(winx, y0, winw, y1 - y0, *(rawDataFrames[i + 1]), *strips[i][0], *strips[i][1], *strips[i][2], options.chunkSizeAMAZE, options.measure);
+                        }
+
+                        const array2D<float>* const tmp[3][3] = {
+                            {strips[0][0].get(), strips[0][1].get(), strips[0][2].get()},
+                            {strips[1][0].get(), strips[1][1].get(), strips[1][2].get()},
+                            {strips[2][0].get(), strips[2][1].get(), strips[2][2].get()}
+                        };
+                        medianFrames(top, bottom, tmp);
                     }
                 }
             } else {
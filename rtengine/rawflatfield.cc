@@ -263,7 +263,7 @@ void cfaboxblur(const float* const * riFlatFile, float* cfablur, int boxH, int b
 namespace rtengine
 {
 
-void RawImageSource::processFlatField(const procparams::RAWParams &raw, const RawImage *riFlatFile, const unsigned short black[4])
+std::unique_ptr<float[]> RawImageSource::flatFieldGain(const procparams::RAWParams &raw, const RawImage *riFlatFile, const RawImage *src, const RawImage *riDark, const unsigned short black[4])
 {
 //    BENCHFUN
     const float fblack[4] = {static_cast<float>(black[0]), static_cast<float>(black[1]), static_cast<float>(black[2]), static_cast<float>(black[3])};
@@ -282,6 +282,33 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
         cfaboxblur(riFlatFile->data, cfablur.get(), BS, BS, H, W);
     }
 
+    std::unique_ptr<float []> cfablur1;
+    std::unique_ptr<float []> cfablur2;
+
+    if (raw.ff_BlurType == procparams::RAWParams::getFlatFieldBlurTypeString(procparams::RAWParams::FlatFieldBlurType::VH)) {
+        cfablur1.reset(new float[H * W]);
+        cfablur2.reset(new float[H * W]);
+        //slightly more complicated blur if trying to correct both vertical and horizontal anomalies
+        cfaboxblur(riFlatFile->data, cfablur1.get(), 0, 2 * BS, H, W); //now do horizontal blur
+        cfaboxblur(riFlatFile->data, cfablur2.get(), 2 * BS, 0, H, W); //now do vertical blur
+    }
+
+    // raw value after dark frame subtraction, the way copyOriginalPixels() computes it
+    const auto rawValue =
+        [src, riDark, black, this](int row, int col) -> float
+        {
+            if (!riDark) {
+                return src->get_data(row, col);
+            }
+
+            const int c  = ri->get_colors() != 1 ? FC(row, col) : 0;
+            const int c4 = (c == 1 && !(row & 1)) ? 3 : c;
+            return std::max(src->get_data(row, col) + black[c4] - riDark->data[row][col], 0.f);
+        };
+
+    // the gain replaces the blurred flat field in place, every pixel only depends on its own blur values
+    float* const gain = cfablur.get();
+
     if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
         float refcolor[2][2];
 
@@ -310,7 +337,7 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
 #endif
                     for (int row = 0; row < H - m; row += 2) {
                         for (int col = 0; col < W - n && !clippedBefore; col += 2) {
-                            const float rawVal = rawData[row + m][col + n];
+                            const float rawVal = rawValue(row + m, col + n);
                             if (rawVal >= clipVal) {
                                 clippedBefore = true;
                                 break;
@@ -367,6 +394,7 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
 
         const vfloat onev = F2V(1.f);
         const vfloat minValuev = F2V(minValue);
+        const vfloat epsv = F2V(1e-5f);
 #endif
 #ifdef _OPENMP
         #pragma omp parallel for schedule(dynamic,16)
@@ -382,16 +410,29 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
                 const vfloat blurv = LVFU(cfablur[row * W + col]) - rowBlackv;
                 vfloat vignettecorrv = rowRefcolorv / blurv;
                 vignettecorrv = vself(vmaskf_le(blurv, minValuev), onev, vignettecorrv);
-                const vfloat valv = LVFU(rawData[row][col]) - rowBlackv;
-                STVFU(rawData[row][col], valv * vignettecorrv + rowBlackv);
+
+                if (cfablur1) {
+                    const vfloat linecorrv = SQRV(vmaxf(blurv, epsv)) /
+                                             (vmaxf(LVFU(cfablur1[row * W + col]) - rowBlackv, epsv) * vmaxf(LVFU(cfablur2[row * W + col]) - rowBlackv, epsv));
+                    vignettecorrv *= linecorrv;
+                }
+
+                STVFU(gain[row * W + col], vignettecorrv);
             }
 
 #endif
 
             for (; col < W; ++col) {
                 const float blur = cfablur[row * W + col] - fblack[c4[row & 1][col & 1]];
-                const float vignettecorr = blur <= minValue ? 1.f : refcolor[row & 1][col & 1] / blur;
-                rawData[row][col] = (rawData[row][col] - fblack[c4[row & 1][col & 1]]) * vignettecorr + fblack[c4[row & 1][col & 1]];
+                float vignettecorr = blur <= minValue ? 1.f : refcolor[row & 1][col & 1] / blur;
+
+                if (cfablur1) {
+                    const float linecorr = SQR(std::max(1e-5f, blur)) /
+                                           (std::max(1e-5f, cfablur1[row * W + col] - fblack[c4[row & 1][col & 1]]) * std::max(1e-5f, cfablur2[row * W + col] - fblack[c4[row & 1][col & 1]]));
+                    vignettecorr *= linecorr;
+                }
+
+                gain[row * W + col] = vignettecorr;
             }
         }
     } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
@@ -425,7 +466,7 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
 #endif
             for (int row = 0; row < H; ++row) {
                 for (int col = 0; col < W && !clippedBefore; ++col) {
-                    const float rawVal = rawData[row][col];
+                    const float rawVal = rawValue(row, col);
                     if (rawVal >= clipVal) {
                         clippedBefore = true;
                         break;
@@ -459,79 +500,19 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
             for (int col = 0; col < W; ++col) {
                 const int c = ri->XTRANSFC(row, col);
                 const float blur = cfablur[(row) * W + col] - fblack[c];
-                const float vignettecorr = blur <= minValue ? 1.f : refcolor[c] / blur;
-                rawData[row][col] = (rawData[row][col] - fblack[c]) * vignettecorr + fblack[c];
-            }
-        }
-    }
-
-    if (raw.ff_BlurType == procparams::RAWParams::getFlatFieldBlurTypeString(procparams::RAWParams::FlatFieldBlurType::VH)) {
-        std::unique_ptr<float []> cfablur1(new float[H * W]);
-        std::unique_ptr<float []> cfablur2(new float[H * W]);
-        //slightly more complicated blur if trying to correct both vertical and horizontal anomalies
-        cfaboxblur(riFlatFile->data, cfablur1.get(), 0, 2 * BS, H, W); //now do horizontal blur
-        cfaboxblur(riFlatFile->data, cfablur2.get(), 2 * BS, 0, H, W); //now do vertical blur
-
-        if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
-            unsigned int c[2][2] {};
-            unsigned int c4[2][2] {};
-            if (ri->get_colors() != 1) {
-                for (int i = 0; i < 2; ++i) {
-                    for (int j = 0; j < 2; ++j) {
-                        c[i][j] = FC(i, j);
-                    }
-                }
-                c4[0][0] = (c[0][0] == 1) ? 3 : c[0][0];
-                c4[0][1] = (c[0][1] == 1) ? 3 : c[0][1];
-                c4[1][0] = c[1][0];
-                c4[1][1] = c[1][1];
-            }
-
-#ifdef __SSE2__
-            const vfloat blackv[2] = {_mm_set_ps(fblack[c4[0][1]], fblack[c4[0][0]], fblack[c4[0][1]], fblack[c4[0][0]]),
-                                      _mm_set_ps(fblack[c4[1][1]], fblack[c4[1][0]], fblack[c4[1][1]], fblack[c4[1][0]])
-                                     };
-
-            const vfloat epsv = F2V(1e-5f);
-#endif
-#ifdef _OPENMP
-            #pragma omp parallel for schedule(dynamic,16)
-#endif
-
-            for (int row = 0; row < H; ++row) {
-                int col = 0;
-#ifdef __SSE2__
-                const vfloat rowBlackv = blackv[row & 1];
+                float vignettecorr = blur <= minValue ? 1.f : refcolor[c] / blur;
 
-                for (; col < W - 3; col += 4) {
-                    const vfloat linecorrv = SQRV(vmaxf(LVFU(cfablur[row * W + col]) - rowBlackv, epsv)) /
-                                             (vmaxf(LVFU(cfablur1[row * W + col]) - rowBlackv, epsv) * vmaxf(LVFU(cfablur2[row * W + col]) - rowBlackv, epsv));
-                    const vfloat valv = LVFU(rawData[row][col]) - rowBlackv;
-                    STVFU(rawData[row][col], valv * linecorrv + rowBlackv);
+                if (cfablur1) {
+                    const float hlinecorr = std::max(1e-5f, blur) / std::max(1e-5f, cfablur1[(row) * W + col] - fblack[c]);
+                    const float vlinecorr = std::max(1e-5f, blur) / std::max(1e-5f, cfablur2[(row) * W + col] - fblack[c]);
+                    vignettecorr *= hlinecorr * vlinecorr;
                 }
 
-#endif
-
-                for (; col < W; ++col) {
-                    const float linecorr = SQR(std::max(1e-5f, cfablur[row * W + col] - fblack[c4[row & 1][col & 1]])) /
-                                           (std::max(1e-5f, cfablur1[row * W + col] - fblack[c4[row & 1][col & 1]]) * std::max(1e-5f, cfablur2[row * W + col] - fblack[c4[row & 1][col & 1]]));
-                    rawData[row][col] = (rawData[row][col] - fblack[c4[row & 1][col & 1]]) * linecorr + fblack[c4[row & 1][col & 1]];
-                }
-            }
-        } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
-#ifdef _OPENMP
-            #pragma omp parallel for
-#endif
-
-            for (int row = 0; row < H; ++row) {
-                for (int col = 0; col < W; ++col) {
-                    const int c  = ri->XTRANSFC(row, col);
-                    const float hlinecorr = std::max(1e-5f, cfablur[(row) * W + col] - fblack[c]) / std::max(1e-5f, cfablur1[(row) * W + col] - fblack[c]);
-                    const float vlinecorr = std::max(1e-5f, cfablur[(row) * W + col] - fblack[c]) / std::max(1e-5f, cfablur2[(row) * W + col] - fblack[c]);
-                    rawData[row][col] = (rawData[row][col] - fblack[c]) * hlinecorr * vlinecorr + fblack[c];
-                }
+                gain[row * W + col] = vignettecorr;
             }
         }
     }
+
+    return cfablur;
 }
 } /* namespace */
@@ -27,6 +27,8 @@ RawImage::RawImage(  const Glib::ustring &name )
     , rotate_deg(0)
     , profile_data(nullptr)
     , allocation(nullptr)
+    , compactAllocation(nullptr)
+    , compactRowSize(0)
 {
     memset(maximum_c4, 0, sizeof(maximum_c4));
     RT_matrix_from_constant = ThreeValBool::X;
@@ -50,6 +52,8 @@ RawImage::~RawImage()
         allocation = nullptr;
     }
 
+    delete [] compactAllocation;
+
     if(float_raw_image) {
         delete [] float_raw_image;
         float_raw_image = nullptr;
@@ -789,6 +793,74 @@ float** RawImage::compress_image(unsigned int frameNum, bool freeImage)
     return data;
 }
 
+bool RawImage::fits_uint16() const
+{
+    if (!data) {
+        return false;
+    }
+
+    const int rowSize = (isBayer() || isXtrans() || colors == 1) ? width : 3 * width;
+    bool lossless = true;
+
+    // raw values are integers, except for float dng files and scaled data of some decoders
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(&&:lossless)
+#endif
+
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < rowSize; ++col) {
+            const float val = data[row][col];
+            lossless = lossless && val >= 0.f && val <= 65535.f && val == static_cast<float>(static_cast<int>(val));
+        }
+    }
+
+    return lossless;
+}
+
+bool RawImage::compact_data()
+{
+    if (!data || compactAllocation || !fits_uint16()) {
+        return false;
+    }
+
+    const int rowSize = (isBayer() || isXtrans() || colors == 1) ? width : 3 * width;
+    compactAllocation = new std::uint16_t[static_cast<std::size_t>(height) * rowSize];
+    compactRowSize = rowSize;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int row = 0; row < height; ++row) {
+        std::uint16_t* const dst = compactAllocation + static_cast<std::size_t>(row) * rowSize;
+
+        for (int col = 0; col < rowSize; ++col) {
+            dst[col] = data[row][col];
+        }
+    }
+
+    delete [] allocation;
+    allocation = nullptr;
+    delete [] data;
+    data = nullptr;
+    return true;
+}
+
+const float* RawImage::get_data_row(int row, float* buffer) const
+{
+    if (data) {
+        return data[row];
+    }
+
+    const std::uint16_t* const src = compactAllocation + static_cast<std::size_t>(row) * compactRowSize;
+
+    for (int col = 0; col < compactRowSize; ++col) {
+        buffer[col] = src[col];
+    }
+
+    return buffer;
+}
+
 bool
 RawImage::is_supportedThumb() const
 {
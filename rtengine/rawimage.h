@@ -18,6 +18,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <ctime>
 #include <cmath>
 #include <iostream>
@@ -50,7 +51,22 @@ public:
         return image;
     }
     float** compress_image(unsigned int frameNum, bool freeImage = true); // revert to compressed pixels format and release image data
-    float** data;             // holds pixel values, data[i][j] corresponds to the ith row and jth column
+    float** data;             // holds pixel values, data[i][j] corresponds to the ith row and jth column, nullptr once the data is compact
+
+    // Store data as 16 bit integers, if that's lossless. Afterwards the pixels have to be read by get_data() or get_data_row()
+    bool compact_data();
+    // true if all pixels of data are integers from 0 to 65535
+    bool fits_uint16() const;
+    bool is_compact() const
+    {
+        return compactAllocation != nullptr;
+    }
+    float get_data(int row, int col) const
+    {
+        return data ? data[row][col] : compactAllocation[static_cast<std::size_t>(row) * compactRowSize + col];
+    }
+    // returns data[row], or the row converted into buffer (of the size of a row) if the data is compact
+    const float* get_data_row(int row, float* buffer) const;
     unsigned prefilters;               // original filters saved ( used for 4 color processing )
     unsigned int getFrameCount() const { return is_raw; }
 
@@ -60,6 +76,8 @@ protected:
     int rotate_deg; // 0,90,180,270 degree of rotation: info taken by dcraw from exif
     char* profile_data; // Embedded ICC color profile
     float* allocation; // pointer to allocated memory
+    std::uint16_t* compactAllocation; // data as 16 bit integers, see compact_data()
+    int compactRowSize;
     int maximum_c4[4];
     bool isFoveon() const
     {
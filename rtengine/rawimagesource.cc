@@ -16,8 +16,18 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <utility>
+
+#include <glib/gstdio.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
 
 #include "camconst.h"
 #include "color.h"
@@ -39,6 +49,7 @@
 #include "rt_math.h"
 #include "rtengine.h"
 #include "rtlensfun.h"
+#include "settings.h"
 #include "../rtgui/options.h"
 
 //#define BENCHMARK
@@ -57,6 +68,173 @@
 namespace
 {
 
+// granularity of the regions demosaiced on demand, see RawImageSource::deferDemosaic()
+constexpr int demosaicBlockSize = 256;
+
+// number of auto CA fits kept in the cache, the least recently used ones are removed first
+constexpr std::size_t maxCAFits = 500;
+
+// changes whenever the fit of CA_correct_RT() changes, so fits of older versions are estimated again
+constexpr char caFitMagic[] = "RTCAFIT1";
+
+// a fit has one record per iteration: the order of the polynomial, 0 if the fit failed, and the coefficients, see CA_correct_RT()
+constexpr std::size_t caFitRecordSize = 1 + 2 * 2 * 16;
+constexpr int caFitMaxOrder = 4;
+
+// the auto CA fit only depends on the data it is estimated from, the number of iterations and the colour shift avoidance
+std::uint64_t getCAFitKey(const array2D<float> &data, int W, int H, int iterations, bool avoidColourshift)
+{
+    constexpr std::uint64_t fnvOffset = 14695981039346656037ULL;
+    constexpr std::uint64_t fnvPrime = 1099511628211ULL;
+    std::vector<std::uint64_t> rowKeys(H);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int row = 0; row < H; ++row) {
+        std::uint64_t key = fnvOffset;
+
+        for (int col = 0; col < W; ++col) {
+            std::uint32_t bits;
+            std::memcpy(&bits, &data[row][col], sizeof(bits));
+            key = (key ^ bits) * fnvPrime;
+        }
+
+        rowKeys[row] = key;
+    }
+
+    std::uint64_t key = ((((fnvOffset ^ W) * fnvPrime ^ H) * fnvPrime ^ iterations) * fnvPrime ^ avoidColourshift) * fnvPrime;
+
+    for (const auto rowKey : rowKeys) {
+        key = (key ^ rowKey) * fnvPrime;
+    }
+
+    return key;
+}
+
+Glib::ustring getCAFitDir()
+{
+    return Glib::build_filename(rtengine::settings->cacheDirectory, "cafits");
+}
+
+Glib::ustring getCAFitFileName(std::uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.caf", static_cast<unsigned long long>(key));
+    return Glib::build_filename(getCAFitDir(), name);
+}
+
+// removes the least recently used fits beyond maxCAFits, loadCAFit() refreshes the modification time of a fit
+void limitCAFits()
+{
+    std::vector<std::pair<time_t, Glib::ustring>> files;
+
+    try {
+        Glib::Dir dir(getCAFitDir());
+
+        for (const auto& name : dir) {
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".caf")) {
+                continue; // e.g. a fit which is just being written
+            }
+
+            const Glib::ustring fileName = Glib::build_filename(getCAFitDir(), name);
+            GStatBuf fileStat;
+
+            if (g_stat(fileName.c_str(), &fileStat) == 0) {
+                files.emplace_back(fileStat.st_mtime, fileName);
+            }
+        }
+    } catch (Glib::Error&) {
+        return;
+    }
+
+    if (files.size() <= maxCAFits) {
+        return;
+    }
+
+    const auto oldest = files.begin() + (files.size() - maxCAFits);
+    std::nth_element(files.begin(), oldest, files.end());
+
+    for (auto file = files.begin(); file != oldest; ++file) {
+        g_remove(file->second.c_str());
+    }
+}
+
+bool loadCAFit(std::uint64_t key, std::vector<double> &fit)
+{
+    FILE* const f = g_fopen(getCAFitFileName(key).c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    char magic[sizeof(caFitMagic)];
+    std::uint64_t fileKey;
+    std::uint32_t size;
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 && !std::memcmp(magic, caFitMagic, sizeof(magic))
+              && fread(&fileKey, sizeof(fileKey), 1, f) == 1 && fileKey == key
+              && fread(&size, sizeof(size), 1, f) == 1 && size > 0 && size < 65536 && size % caFitRecordSize == 0;
+
+    if (ok) {
+        fit.resize(size);
+        ok = fread(fit.data(), sizeof(double), size, f) == size;
+    }
+
+    fclose(f);
+
+    for (std::size_t record = 0; ok && record < fit.size(); record += caFitRecordSize) {
+        // CA_correct_RT() trusts the order of the polynomial, it sizes the fit
+        const double order = fit[record];
+        ok = order >= 0.0 && order <= caFitMaxOrder && order == static_cast<int>(order);
+    }
+
+    if (ok) {
+        // mark as recently used
+        g_utime(getCAFitFileName(key).c_str(), nullptr);
+    } else {
+        fit.clear();
+    }
+
+    return ok;
+}
+
+void saveCAFit(std::uint64_t key, const std::vector<double> &fit)
+{
+    if (g_mkdir_with_parents(getCAFitDir().c_str(), 0755) != 0) {
+        return;
+    }
+
+    // other processes may write the same fit at the same time, so each one writes its own file and renames it
+    const Glib::ustring fileName = getCAFitFileName(key);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%08x.tmp", static_cast<unsigned int>(g_random_int()));
+    const Glib::ustring tmpName = fileName + suffix;
+    FILE* const f = g_fopen(tmpName.c_str(), "wb");
+
+    if (!f) {
+        return;
+    }
+
+    const std::uint32_t size = fit.size();
+    bool ok = fwrite(caFitMagic, sizeof(caFitMagic), 1, f) == 1
+              && fwrite(&key, sizeof(key), 1, f) == 1
+              && fwrite(&size, sizeof(size), 1, f) == 1
+              && fwrite(fit.data(), sizeof(double), size, f) == size;
+    ok = fclose(f) == 0 && ok;
+
+    if (ok) {
+        g_remove(fileName.c_str());
+        ok = g_rename(tmpName.c_str(), fileName.c_str()) == 0;
+    }
+
+    if (!ok) {
+        g_remove(tmpName.c_str());
+    } else {
+        limitCAFits();
+    }
+}
+
 void rotateLine (const float* const line, rtengine::PlanarPtr<float> &channel, const int tran, const int i, const int w, const int h)
 {
     switch(tran & TR_ROT) {
@@ -470,6 +648,9 @@ RawImageSource::RawImageSource ()
     camProfile = nullptr;
     embProfile = nullptr;
     rgbSourceModified = false;
+    rgbBinned = false;
+    caFitKey = 0;
+    dualDemosaicCaching = false;
     for(int i = 0; i < 4; ++i) {
         psRedBrightness[i] = psGreenBrightness[i] = psBlueBrightness[i] = 1.f;
     }
@@ -744,6 +925,11 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
     }
 
     int maxx = this->W, maxy = this->H, skip = pp.getSkip();
+    const bool binRaw = rgbBinned && skip >= 2;
+
+    if (rgbBinned && !binRaw) {
+        demosaicRegion(sx1, sy1, imwidth, imheight);
+    }
 
     // raw clip levels after white balance
     hlmax[0] = clmax[0] * rm;
@@ -752,7 +938,7 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
 
     const bool doClip = (chmax[0] >= clmax[0] || chmax[1] >= clmax[1] || chmax[2] >= clmax[2]) && !hrp.hrenabled && hrp.clampOOG;
 
-    float area = skip * skip;
+    const float area = skip * skip;
     rm /= area;
     gm /= area;
     bm /= area;
@@ -785,12 +971,29 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
 
                     float rtot = 0.f, gtot = 0.f, btot = 0.f;
 
-                    for (int m = 0; m < skip; m++)
-                        for (int n = 0; n < skip; n++) {
-                            rtot += red[i + m][jx + n];
-                            gtot += green[i + m][jx + n];
-                            btot += blue[i + m][jx + n];
-                        }
+                    if (binRaw) {
+                        // mean of the raw samples of each colour in the box, scaled to the sum over the box like a demosaiced image
+                        float tot[3] = {};
+                        int count[3] = {};
+
+                        for (int m = 0; m < skip; m++)
+                            for (int n = 0; n < skip; n++) {
+                                const unsigned c = FC(i + m, jx + n);
+                                tot[c] += rawData[i + m][jx + n];
+                                count[c]++;
+                            }
+
+                        rtot = tot[0] * area / count[0];
+                        gtot = tot[1] * area / count[1];
+                        btot = tot[2] * area / count[2];
+                    } else {
+                        for (int m = 0; m < skip; m++)
+                            for (int n = 0; n < skip; n++) {
+                                rtot += red[i + m][jx + n];
+                                gtot += green[i + m][jx + n];
+                                btot += blue[i + m][jx + n];
+                            }
+                    }
 
                     rtot *= rm;
                     gtot *= gm;
@@ -1224,6 +1427,15 @@ int RawImageSource::load (const Glib::ustring &fname, bool firstFrameOnly)
         riFrames[i]->set_prefilters();
     }
 
+    if (settings->compactRawData) {
+        // the original frames are only read again by preprocess(), which converts them row by row
+        for(unsigned int i = 0; i < numFrames; ++i) {
+            if (riFrames[i]->compact_data() && settings->verbose) {
+                printf("Keeping raw frame %u as 16 bit data\n", i);
+            }
+        }
+    }
+
 
     // Load complete Exif information
     std::unique_ptr<RawMetaDataLocation> rml(new RawMetaDataLocation (ri->get_exifBase(), ri->get_ciffBase(), ri->get_ciffLen()));
@@ -1257,6 +1469,8 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
     MyTime t1, t2;
     t1.set();
 
+    dualDemosaicCache.reset();
+
     Glib::ustring newDF = raw.dark_frame;
     RawImage *rid = nullptr;
 
@@ -1303,11 +1517,43 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
         printf( "Flat Field Correction:%s\n", rif->get_filename().c_str());
     }
 
+    // TODO: Change type of black[] to float to avoid conversions
+    const unsigned short black[4] = {
+        (unsigned short)ri->get_cblack(0), (unsigned short)ri->get_cblack(1),
+        (unsigned short)ri->get_cblack(2), (unsigned short)ri->get_cblack(3)
+    };
+
+    // the flat field gain only depends on the current frame for auto clip control, so it's shared by all frames
+    std::unique_ptr<float[]> ffGain;
+
+    if (rif && W == rif->get_width() && H == rif->get_height() && (ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1)) {
+        ffGain = flatFieldGain(raw, rif, ri, rid && W == rid->get_width() && H == rid->get_height() ? rid : nullptr, black);
+    }
+    //FLATFIELD end
+
+    // Correct vignetting of lens profile
+    std::unique_ptr<LensCorrection> pmap;
+
+    if (!hasFlatField && lensProf.useVign && lensProf.lcMode != LensProfParams::LcMode::NONE) {
+        if (lensProf.useLensfun()) {
+            pmap = LFDatabase::findModifier(lensProf, idata, W, H, coarse, -1);
+        } else {
+            const std::shared_ptr<LCPProfile> pLCPProf = LCPStore::getInstance()->getProfile(lensProf.lcpFile);
+
+            if (pLCPProf) { // don't check focal length to allow distortion correction for lenses without chip, also pass dummy focal length 1 in case of 0
+                pmap.reset(new LCPMapper(pLCPProf, max(idata->getFocalLen(), 1.0), idata->getFocalLen35mm(), idata->getFocusDist(), idata->getFNumber(), true, false, W, H, coarse, -1));
+            }
+        }
+    }
+
+    scaleColors(raw); //+ + raw parameters for black level(raw.blackxx)
+
+    // dark frame, flat field, scaling and vignetting are applied in one pass per frame
     if(numFrames == 4) {
         int bufferNumber = 0;
         for(unsigned int i=0; i<4; ++i) {
             if(i==currFrame) {
-                copyOriginalPixels(raw, ri, rid, rif, rawData);
+                copyOriginalPixels(ri, rid, ffGain.get(), pmap.get(), rawData);
                 rawDataFrames[i] = &rawData;
             } else {
                 if(!rawDataBuffer[bufferNumber]) {
@@ -1315,7 +1561,7 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
                 }
                 rawDataFrames[i] = rawDataBuffer[bufferNumber];
                 ++bufferNumber;
-                copyOriginalPixels(raw, riFrames[i], rid, rif, *rawDataFrames[i]);
+                copyOriginalPixels(riFrames[i], rid, ffGain.get(), pmap.get(), *rawDataFrames[i]);
             }
         }
     } else if (numFrames == 2 && currFrame == 2) { // average the frames
@@ -1323,19 +1569,14 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
             rawDataBuffer[0] = new array2D<float>;
         }
         rawDataFrames[1] = rawDataBuffer[0];
-        copyOriginalPixels(raw, riFrames[1], rid, rif, *rawDataFrames[1]);
-        copyOriginalPixels(raw, ri, rid, rif, rawData);
-
-        for (int i = 0; i < H; ++i) {
-            for (int j = 0; j < W; ++j) {
-                rawData[i][j] = (rawData[i][j] + (*rawDataFrames[1])[i][j]) * 0.5f;
-            }
-        }
+        copyOriginalPixels(riFrames[1], rid, ffGain.get(), nullptr, *rawDataFrames[1], nullptr, false);
+        copyOriginalPixels(ri, rid, ffGain.get(), pmap.get(), rawData, rawDataFrames[1]);
     } else {
-        copyOriginalPixels(raw, ri, rid, rif, rawData);
+        copyOriginalPixels(ri, rid, ffGain.get(), pmap.get(), rawData);
     }
-    //FLATFIELD end
 
+    ffGain.reset();
+    pmap.reset();
 
     // Always correct camera badpixels from .badpixels file
     std::vector<badPix> *bp = dfm.getBadPixels( ri->get_maker(), ri->get_model(), idata->getSerialNumber() );
@@ -1373,62 +1614,6 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
         }
     }
 
-    if(numFrames == 4) {
-        for(int i=0; i<4; ++i) {
-            scaleColors( 0, 0, W, H, raw, *rawDataFrames[i]);
-        }
-    } else {
-        scaleColors( 0, 0, W, H, raw, rawData); //+ + raw parameters for black level(raw.blackxx)
-    }
-
-    // Correct vignetting of lens profile
-    if (!hasFlatField && lensProf.useVign && lensProf.lcMode != LensProfParams::LcMode::NONE) {
-        std::unique_ptr<LensCorrection> pmap;
-        if (lensProf.useLensfun()) {
-            pmap = LFDatabase::findModifier(lensProf, idata, W, H, coarse, -1);
-        } else {
-            const std::shared_ptr<LCPProfile> pLCPProf = LCPStore::getInstance()->getProfile(lensProf.lcpFile);
-
-            if (pLCPProf) { // don't check focal length to allow distortion correction for lenses without chip, also pass dummy focal length 1 in case of 0
-                pmap.reset(new LCPMapper(pLCPProf, max(idata->getFocalLen(), 1.0), idata->getFocalLen35mm(), idata->getFocusDist(), idata->getFNumber(), true, false, W, H, coarse, -1));
-            }
-        }
-
-        if (pmap) {
-            LensCorrection &map = *pmap;
-            if (ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1) {
-                if(numFrames == 4) {
-                    for(int i = 0; i < 4; ++i) {
-#ifdef _OPENMP
-                    #pragma omp parallel for schedule(dynamic,16)
-#endif
-
-                        for (int y = 0; y < H; y++) {
-                            map.processVignetteLine(W, y, (*rawDataFrames[i])[y]);
-                        }
-                    }
-                } else {
-
-#ifdef _OPENMP
-                    #pragma omp parallel for schedule(dynamic,16)
-#endif
-
-                    for (int y = 0; y < H; y++) {
-                        map.processVignetteLine(W, y, rawData[y]);
-                    }
-                }
-            } else if(ri->get_colors() == 3) {
-#ifdef _OPENMP
-                #pragma omp parallel for schedule(dynamic,16)
-#endif
-
-                for (int y = 0; y < H; y++) {
-                    map.processVignetteLine3Channels(W, y, rawData[y]);
-                }
-            }
-        }
-    }
-
     defGain = 0.0;//log(initialGain) / log(2.0);
 
     if ( ri->getSensorType() == ST_BAYER && (raw.hotPixelFilter > 0 || raw.deadPixelFilter > 0)) {
@@ -1554,15 +1739,38 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
             plistener->setProgressStr ("PROGRESSBAR_RAWCACORR");
             plistener->setProgress (0.0);
         }
+        // reuse the auto CA fit if the data didn't change, only the correction has to be applied then
+        std::vector<double>* fit = nullptr;
+        bool fitValid = false;
+        std::uint64_t fitKey = 0;
+
+        if (raw.ca_autocorrect) {
+            fit = &caFit;
+            fitKey = getCAFitKey(numFrames == 4 ? *rawDataFrames[0] : rawData, W, H, raw.caautoiterations, raw.ca_avoidcolourshift);
+            fitValid = !caFit.empty() && fitKey == caFitKey;
+
+            if (!fitValid && settings->cacheCAFit && !settings->cacheDirectory.empty() && loadCAFit(fitKey, caFit)) {
+                caFitKey = fitKey;
+                fitValid = true;
+            }
+        }
+
         if(numFrames == 4) {
-            double fitParams[64];
-            float *buffer = CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, *rawDataFrames[0], fitParams, false, true, nullptr, false, options.chunkSizeCA, options.measure);
+            float *buffer = CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, *rawDataFrames[0], fit, fitValid, !fitValid, nullptr, false, options.chunkSizeCA, options.measure);
             for(int i = 1; i < 3; ++i) {
-                CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, *rawDataFrames[i], fitParams, true, false, buffer, false, options.chunkSizeCA, options.measure);
+                CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, *rawDataFrames[i], fit, true, false, buffer, false, options.chunkSizeCA, options.measure);
             }
-            CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, *rawDataFrames[3], fitParams, true, false, buffer, true, options.chunkSizeCA, options.measure);
+            CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, *rawDataFrames[3], fit, true, false, buffer, true, options.chunkSizeCA, options.measure);
         } else {
-            CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, rawData, nullptr, false, false, nullptr, true, options.chunkSizeCA, options.measure);
+            CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue, raw.ca_avoidcolourshift, rawData, fit, fitValid, !fitValid, nullptr, true, options.chunkSizeCA, options.measure);
+        }
+
+        if (raw.ca_autocorrect && !fitValid) {
+            caFitKey = fitKey;
+
+            if (settings->cacheCAFit && !settings->cacheDirectory.empty()) {
+                saveCAFit(fitKey, caFit);
+            }
         }
     }
 
@@ -1591,6 +1799,23 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
     MyTime t1, t2;
     t1.set();
 
+    rgbBinned = false;
+    demosaicedBlocks.clear();
+
+    const bool dualDemosaic =
+        ri->getSensorType() == ST_BAYER
+            ? raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::AMAZEVNG4)
+              || raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::DCBVNG4)
+              || raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::RCDVNG4)
+            : ri->getSensorType() == ST_FUJI_XTRANS
+              && (raw.xtranssensor.method == RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::FOUR_PASS)
+                  || raw.xtranssensor.method == RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::TWO_PASS));
+
+    if (!dualDemosaicCaching || !dualDemosaic) {
+        // the results of the last dual demosaic are of no use anymore, don't keep six frames around
+        dualDemosaicCache.reset();
+    }
+
     if (ri->getSensorType() == ST_BAYER) {
         if ( raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::HPHD) ) {
             hphd_demosaic ();
@@ -1605,9 +1830,9 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
                    || raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::RCDVNG4)) {
             if (!autoContrast) {
                 double threshold = raw.bayersensor.dualDemosaicContrast;
-                dual_demosaic_RT (true, raw, W, H, rawData, red, green, blue, threshold, false);
+                dual_demosaic_RT (true, raw, W, H, rawData, red, green, blue, threshold, false, dualDemosaicCaching);
             } else {
-                dual_demosaic_RT (true, raw, W, H, rawData, red, green, blue, contrastThreshold, true);
+                dual_demosaic_RT (true, raw, W, H, rawData, red, green, blue, contrastThreshold, true, dualDemosaicCaching);
             }
         } else if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::PIXELSHIFT) ) {
             pixelshift(0, 0, W, H, raw, currFrame, ri->get_maker(), ri->get_model(), raw.expos);
@@ -1624,7 +1849,7 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
         } else if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::MONO) ) {
             nodemosaic(true);
         } else if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::RCD) ) {
-            rcd_demosaic(options.chunkSizeRCD, options.measure);
+            rcd_demosaic(0, 0, W, H, options.chunkSizeRCD, options.measure);
         } else {
             nodemosaic(false);
         }
@@ -1638,9 +1863,9 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
         } else if (raw.xtranssensor.method == RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::FOUR_PASS) || raw.xtranssensor.method == RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::TWO_PASS)) {
             if (!autoContrast) {
                 double threshold = raw.xtranssensor.dualDemosaicContrast;
-                dual_demosaic_RT (false, raw, W, H, rawData, red, green, blue, threshold, false);
+                dual_demosaic_RT (false, raw, W, H, rawData, red, green, blue, threshold, false, dualDemosaicCaching);
             } else {
-                dual_demosaic_RT (false, raw, W, H, rawData, red, green, blue, contrastThreshold, true);
+                dual_demosaic_RT (false, raw, W, H, rawData, red, green, blue, contrastThreshold, true, dualDemosaicCaching);
             }
         } else if(raw.xtranssensor.method == RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::MONO) ) {
             nodemosaic(true);
@@ -1709,6 +1934,117 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
     }
 }
 
+bool RawImageSource::deferDemosaic(const RAWParams &raw)
+{
+    // each 2x2 box of a 3 colour bayer pattern has all colours, that's not the case for X-Trans
+    if (ri->getSensorType() != ST_BAYER || ri->get_colors() != 3 || fuji || d1x) {
+        return false;
+    }
+
+    if (raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::FAST)
+            && raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::AMAZE)
+            && raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::RCD)) {
+        return false;
+    }
+
+    rgbBinned = true;
+    rgbSourceModified = false;
+    deferredMethod = raw.bayersensor.method;
+    demosaicedBlocks.assign(((W + demosaicBlockSize - 1) / demosaicBlockSize) * ((H + demosaicBlockSize - 1) / demosaicBlockSize), false);
+    return true;
+}
+
+void RawImageSource::demosaicRegion(int x, int y, int w, int h)
+{
+    const int blocksW = (W + demosaicBlockSize - 1) / demosaicBlockSize;
+    const int bx0 = std::max(x, 0) / demosaicBlockSize;
+    const int by0 = std::max(y, 0) / demosaicBlockSize;
+    const int bx1 = (std::min(x + w, W) - 1) / demosaicBlockSize;
+    const int by1 = (std::min(y + h, H) - 1) / demosaicBlockSize;
+
+    // bounding box of the blocks of the region which are not demosaiced yet
+    int mx0 = bx1 + 1, my0 = by1 + 1, mx1 = -1, my1 = -1;
+
+    for (int by = by0; by <= by1; ++by) {
+        for (int bx = bx0; bx <= bx1; ++bx) {
+            if (!demosaicedBlocks[by * blocksW + bx]) {
+                mx0 = std::min(mx0, bx);
+                my0 = std::min(my0, by);
+                mx1 = std::max(mx1, bx);
+                my1 = std::max(my1, by);
+            }
+        }
+    }
+
+    if (mx1 < 0) {
+        return;
+    }
+
+    if (deferredMethod == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::FAST)) {
+        // fast demosaic only works on the whole image
+        fast_demosaic();
+        demosaicedBlocks.assign(demosaicedBlocks.size(), true);
+        return;
+    }
+
+    const int x0 = mx0 * demosaicBlockSize;
+    const int y0 = my0 * demosaicBlockSize;
+    const int x1 = std::min((mx1 + 1) * demosaicBlockSize, W);
+    const int y1 = std::min((my1 + 1) * demosaicBlockSize, H);
+
+    if (deferredMethod == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::RCD)) {
+        rcd_demosaic(x0, y0, x1 - x0, y1 - y0, options.chunkSizeRCD, options.measure);
+    } else {
+        // AMaZE mirrors the data at the borders of its window, so the window gets a margin of real data.
+        // The margin is demosaiced with border artifacts, its pixels which were demosaiced before are kept.
+        constexpr int margin = 32;
+        const int px0 = std::max(x0 - margin, 0);
+        const int py0 = std::max(y0 - margin, 0);
+        const int px1 = std::min(x1 + margin, W);
+        const int py1 = std::min(y1 + margin, H);
+        std::vector<float> marginData;
+
+        const auto copyMargin =
+            [&](bool restore)
+            {
+                std::size_t index = 0;
+
+                const auto copy =
+                    [&](int row, int col0, int col1)
+                    {
+                        for (array2D<float>* plane : {&red, &green, &blue}) {
+                            for (int col = col0; col < col1; ++col, ++index) {
+                                if (restore) {
+                                    (*plane)[row][col] = marginData[index];
+                                } else {
+                                    marginData.push_back((*plane)[row][col]);
+                                }
+                            }
+                        }
+                    };
+
+                for (int row = py0; row < py1; ++row) {
+                    if (row < y0 || row >= y1) {
+                        copy(row, px0, px1);
+                    } else {
+                        copy(row, px0, x0);
+                        copy(row, x1, px1);
+                    }
+                }
+            };
+
+        copyMargin(false);
+        amaze_demosaic_RT(px0, py0, px1 - px0, py1 - py0, rawData, red, green, blue, options.chunkSizeAMAZE, options.measure);
+        copyMargin(true);
+    }
+
+    for (int by = my0; by <= my1; ++by) {
+        for (int bx = mx0; bx <= mx1; ++bx) {
+            demosaicedBlocks[by * blocksW + bx] = true;
+        }
+    }
+}
+
 
 //void RawImageSource::retinexPrepareBuffers(ColorManagementParams cmp, RetinexParams retinexParams, multi_array2D<float, 3> &conversionBuffer, LUTu &lhist16RETI)
 void RawImageSource::retinexPrepareBuffers(const ColorManagementParams& cmp, const RetinexParams &retinexParams, multi_array2D<float, 4> &conversionBuffer, LUTu &lhist16RETI)
@@ -2411,10 +2747,11 @@ void RawImageSource::HLRecovery_Global(const ToneCurveParams &hrp)
 
 }
 
-/* Copy original pixel data and
- * subtract dark frame (if present) from current image and apply flat field correction (if present)
+/* copyOriginalPixels() runs the pointwise part of the raw preprocessing in a single pass over the rows:
+ * dark frame subtraction, flat field, averaging with a second frame, scaling into the range 0 65535 and lens vignetting.
+ * Each row goes through all steps while it is in the cache. scaleColors() has to be called before, unless scale is false.
  */
-void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, RawImage *riDark, RawImage *riFlatFile, array2D<float> &rawData )
+void RawImageSource::copyOriginalPixels(const RawImage *src, const RawImage *riDark, const float *flatFieldGain, const LensCorrection *vignetting, array2D<float> &rawData, const array2D<float> *averageWith, bool scale)
 {
     // TODO: Change type of black[] to float to avoid conversions
     unsigned short black[4] = {
@@ -2422,90 +2759,136 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src, Raw
         (unsigned short)ri->get_cblack(2), (unsigned short)ri->get_cblack(3)
     };
 
-    if (ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS) {
-        if (!rawData) {
-            rawData(W, H);
-        }
+    if (riDark && (W != riDark->get_width() || H != riDark->get_height())) {
+        riDark = nullptr;
+    }
 
-        if (riDark && W == riDark->get_width() && H == riDark->get_height()) { // This works also for xtrans-sensors, because black[0] to black[4] are equal for these
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    int c  = FC(row, col);
-                    int c4 = ( c == 1 && !(row & 1) ) ? 3 : c;
-                    rawData[row][col] = max(src->data[row][col] + black[c4] - riDark->data[row][col], 0.0f);
-                }
+    const bool isXtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+    const bool isMono = !isXtrans && ri->getSensorType() != ST_BAYER && ri->get_colors() == 1;
+    // No bayer pattern
+    // TODO: Is there a flat field correction possible?
+    const bool isCfa = ri->getSensorType() == ST_BAYER || isXtrans || isMono;
+
+    if (!rawData) {
+        rawData(isCfa ? W : 3 * W, H);
+    }
+
+    // four colors,  0=R, 1=G1, 2=B, 3=G2, by row and column parity. This works also for xtrans-sensors, because black[0] to black[4] are equal for these
+    int c4[2][2] {};
+
+    if (!isMono) {
+        for (int i = 0; i < 2; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                const int c = FC(i, j);
+                c4[i][j] = (c == 1 && !(i & 1)) ? 3 : c;
             }
-        } else {
+        }
+    }
+
+    if (scale) {
+        chmax[0] = chmax[1] = chmax[2] = chmax[3] = 0; //channel maxima
+    }
+
 #ifdef _OPENMP
-            #pragma omp parallel for
+    #pragma omp parallel
+#endif
+    {
+        float rowMax[3] = {};
+        // compact frames are converted to float row by row
+        std::vector<float> rowBuffer(src->is_compact() ? (isCfa ? W : 3 * W) : 0);
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic,16) nowait
 #endif
 
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    rawData[row][col] = src->data[row][col];
+        for (int row = 0; row < H; ++row) {
+            float* const out = rawData[row];
+            const float* const in = src->get_data_row(row, rowBuffer.data());
+
+            if (isCfa) {
+                if (riDark) {
+                    const float* const dark = riDark->data[row];
+
+                    for (int col = 0; col < W; ++col) {
+                        out[col] = max(in[col] + black[c4[row & 1][col & 1]] - dark[col], 0.0f);
+                    }
+                } else {
+                    std::copy(in, in + W, out);
                 }
-            }
-        }
 
+                if (flatFieldGain) {
+                    const float* const gain = flatFieldGain + static_cast<std::size_t>(row) * W;
 
-        if (riFlatFile && W == riFlatFile->get_width() && H == riFlatFile->get_height()) {
-            processFlatField(raw, riFlatFile, black);
-        }  // flatfield
-    } else if (ri->get_colors() == 1) {
-        // Monochrome
-        if (!rawData) {
-            rawData(W, H);
-        }
+                    if (isXtrans) {
+                        for (int col = 0; col < W; ++col) {
+                            const float fblack = black[ri->XTRANSFC(row, col)];
+                            out[col] = (out[col] - fblack) * gain[col] + fblack;
+                        }
+                    } else {
+                        const float fblack[2] = {static_cast<float>(black[c4[row & 1][0]]), static_cast<float>(black[c4[row & 1][1]])};
 
-        if (riDark && W == riDark->get_width() && H == riDark->get_height()) {
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    rawData[row][col] = max(src->data[row][col] + black[0] - riDark->data[row][col], 0.0f);
+                        for (int col = 0; col < W; ++col) {
+                            out[col] = (out[col] - fblack[col & 1]) * gain[col] + fblack[col & 1];
+                        }
+                    }
                 }
-            }
-        } else {
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    rawData[row][col] = src->data[row][col];
+            } else if (riDark) {
+                const float* const dark = riDark->data[row];
+
+                for (int col = 0; col < W; ++col) {
+                    const float fblack = black[c4[row & 1][col & 1]];
+                    out[3 * col + 0] = max(in[3 * col + 0] + fblack - dark[3 * col + 0], 0.0f);
+                    out[3 * col + 1] = max(in[3 * col + 1] + fblack - dark[3 * col + 1], 0.0f);
+                    out[3 * col + 2] = max(in[3 * col + 2] + fblack - dark[3 * col + 2], 0.0f);
                 }
+            } else {
+                std::copy(in, in + 3 * W, out);
             }
-        }
-        if (riFlatFile && W == riFlatFile->get_width() && H == riFlatFile->get_height()) {
-            processFlatField(raw, riFlatFile, black);
-        }  // flatfield
-    } else {
-        // No bayer pattern
-        // TODO: Is there a flat field correction possible?
-        if (!rawData) {
-            rawData(3 * W, H);
-        }
 
-        if (riDark && W == riDark->get_width() && H == riDark->get_height()) {
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    int c  = FC(row, col);
-                    int c4 = ( c == 1 && !(row & 1) ) ? 3 : c;
-                    rawData[row][3 * col + 0] = max(src->data[row][3 * col + 0] + black[c4] - riDark->data[row][3 * col + 0], 0.0f);
-                    rawData[row][3 * col + 1] = max(src->data[row][3 * col + 1] + black[c4] - riDark->data[row][3 * col + 1], 0.0f);
-                    rawData[row][3 * col + 2] = max(src->data[row][3 * col + 2] + black[c4] - riDark->data[row][3 * col + 2], 0.0f);
+            if (averageWith) {
+                const float* const other = (*averageWith)[row];
+
+                for (int col = 0; col < (isCfa ? W : 3 * W); ++col) {
+                    out[col] = (out[col] + other[col]) * 0.5f;
                 }
             }
-        } else {
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    rawData[row][3 * col + 0] = src->data[row][3 * col + 0];
-                    rawData[row][3 * col + 1] = src->data[row][3 * col + 1];
-                    rawData[row][3 * col + 2] = src->data[row][3 * col + 2];
+
+            if (scale) {
+                scaleRow(row, out, rowMax);
+
+                if (vignetting) {
+                    if (isCfa) {
+                        vignetting->processVignetteLine(W, row, out);
+                    } else if (ri->get_colors() == 3) {
+                        vignetting->processVignetteLine3Channels(W, row, out);
+                    }
                 }
             }
         }
+
+        if (scale) {
+#ifdef _OPENMP
+            #pragma omp critical
+#endif
+            {
+                chmax[0] = max(rowMax[0], chmax[0]);
+                chmax[1] = max(rowMax[1], chmax[1]);
+                chmax[2] = max(rowMax[2], chmax[2]);
+            }
+        }
+    }
+
+    if (scale) {
+        if (isMono) {
+            chmax[1] = chmax[2] = chmax[3] = chmax[0];
+        } else if (!isCfa) {
+            chmax[3] = chmax[1];
+        }
     }
 }
 
-// Scale original pixels into the range 0 65535 using black offsets and multipliers
-void RawImageSource::scaleColors(int winx, int winy, int winw, int winh, const RAWParams &raw, array2D<float> &rawData)
+// Calculate the black offsets and multipliers to scale original pixels into the range 0 65535
+void RawImageSource::scaleColors(const RAWParams &raw)
 {
-    chmax[0] = chmax[1] = chmax[2] = chmax[3] = 0; //channel maxima
     float black_lev[4] = {0.f};//black level
 
     //adjust black level  (eg Canon)
@@ -2543,141 +2926,52 @@ void RawImageSource::scaleColors(int winx, int winy, int winw, int winh, const R
     for(int i = 0; i < 4 ; i++) {
         clmax[i] = (c_white[i] - cblacksom[i]) * scale_mul[i];    // raw clip level
     }
+}
 
+// Scale one row of original pixels using the offsets and multipliers of scaleColors(), rowMax gets the channel maxima
+void RawImageSource::scaleRow(int row, float *data, float rowMax[3]) const
+{
     // this seems strange, but it works
 
-    // scale image colors
-
-    if( ri->getSensorType() == ST_BAYER) {
-#ifdef _OPENMP
-        #pragma omp parallel
-#endif
-        {
-            float tmpchmax[3];
-            tmpchmax[0] = tmpchmax[1] = tmpchmax[2] = 0.0f;
-#ifdef _OPENMP
-            #pragma omp for nowait
-#endif
-
-            for (int row = winy; row < winy + winh; row ++)
-            {
-                for (int col = winx; col < winx + winw; col++) {
-                    float val = rawData[row][col];
-                    int c  = FC(row, col);                        // three colors,  0=R, 1=G,  2=B
-                    int c4 = ( c == 1 && !(row & 1) ) ? 3 : c;    // four  colors,  0=R, 1=G1, 2=B, 3=G2
-                    val -= cblacksom[c4];
-                    val *= scale_mul[c4];
-                    rawData[row][col] = (val);
-                    tmpchmax[c] = max(tmpchmax[c], val);
-                }
-            }
-
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            {
-                chmax[0] = max(tmpchmax[0], chmax[0]);
-                chmax[1] = max(tmpchmax[1], chmax[1]);
-                chmax[2] = max(tmpchmax[2], chmax[2]);
-            }
+    if (ri->getSensorType() == ST_BAYER) {
+        for (int col = 0; col < W; col++) {
+            float val = data[col];
+            int c  = FC(row, col);                        // three colors,  0=R, 1=G,  2=B
+            int c4 = ( c == 1 && !(row & 1) ) ? 3 : c;    // four  colors,  0=R, 1=G1, 2=B, 3=G2
+            val -= cblacksom[c4];
+            val *= scale_mul[c4];
+            data[col] = (val);
+            rowMax[c] = max(rowMax[c], val);
         }
-    } else if ( ri->get_colors() == 1 ) {
-#ifdef _OPENMP
-        #pragma omp parallel
-#endif
-        {
-            float tmpchmax = 0.0f;
-#ifdef _OPENMP
-            #pragma omp for nowait
-#endif
-
-            for (int row = winy; row < winy + winh; row ++)
-            {
-                for (int col = winx; col < winx + winw; col++) {
-                    float val = rawData[row][col];
-                    val -= cblacksom[0];
-                    val *= scale_mul[0];
-                    rawData[row][col] = (val);
-                    tmpchmax = max(tmpchmax, val);
-                }
-            }
-
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            {
-                chmax[0] = chmax[1] = chmax[2] = chmax[3] = max(tmpchmax, chmax[0]);
-            }
+    } else if (ri->get_colors() == 1) {
+        for (int col = 0; col < W; col++) {
+            float val = data[col];
+            val -= cblacksom[0];
+            val *= scale_mul[0];
+            data[col] = (val);
+            rowMax[0] = max(rowMax[0], val);
         }
-    } else if(ri->getSensorType() == ST_FUJI_XTRANS) {
-#ifdef _OPENMP
-        #pragma omp parallel
-#endif
-        {
-            float tmpchmax[3];
-            tmpchmax[0] = tmpchmax[1] = tmpchmax[2] = 0.0f;
-#ifdef _OPENMP
-            #pragma omp for nowait
-#endif
-
-            for (int row = winy; row < winy + winh; row ++)
-            {
-                for (int col = winx; col < winx + winw; col++) {
-                    float val = rawData[row][col];
-                    int c = ri->XTRANSFC(row, col);
-                    val -= cblacksom[c];
-                    val *= scale_mul[c];
-
-                    rawData[row][col] = (val);
-                    tmpchmax[c] = max(tmpchmax[c], val);
-                }
-            }
-
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            {
-                chmax[0] = max(tmpchmax[0], chmax[0]);
-                chmax[1] = max(tmpchmax[1], chmax[1]);
-                chmax[2] = max(tmpchmax[2], chmax[2]);
-            }
+    } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+        for (int col = 0; col < W; col++) {
+            float val = data[col];
+            int c = ri->XTRANSFC(row, col);
+            val -= cblacksom[c];
+            val *= scale_mul[c];
+
+            data[col] = (val);
+            rowMax[c] = max(rowMax[c], val);
         }
     } else {
-#ifdef _OPENMP
-        #pragma omp parallel
-#endif
-        {
-            float tmpchmax[3];
-            tmpchmax[0] = tmpchmax[1] = tmpchmax[2] = 0.0f;
-#ifdef _OPENMP
-            #pragma omp for nowait
-#endif
-
-            for (int row = winy; row < winy + winh; row ++)
-            {
-                for (int col = winx; col < winx + winw; col++) {
-                    for (int c = 0; c < 3; c++) {                 // three colors,  0=R, 1=G,  2=B
-                        float val = rawData[row][3 * col + c];
-                        val -= cblacksom[c];
-                        val *= scale_mul[c];
-                        rawData[row][3 * col + c] = (val);
-                        tmpchmax[c] = max(tmpchmax[c], val);
-                    }
-                }
-            }
-
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            {
-                chmax[0] = max(tmpchmax[0], chmax[0]);
-                chmax[1] = max(tmpchmax[1], chmax[1]);
-                chmax[2] = max(tmpchmax[2], chmax[2]);
+        for (int col = 0; col < W; col++) {
+            for (int c = 0; c < 3; c++) {                 // three colors,  0=R, 1=G,  2=B
+                float val = data[3 * col + c];
+                val -= cblacksom[c];
+                val *= scale_mul[c];
+                data[3 * col + c] = (val);
+                rowMax[c] = max(rowMax[c], val);
             }
         }
-        chmax[3] = chmax[1];
     }
-
 }
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -3811,26 +4105,26 @@ void RawImageSource::getRAWHistogram (LUTu & histRedRaw, LUTu & histGreenRaw, LU
                 c2 = ( fourColours && c2 == 1 && !(i & 1) ) ? 3 : c2;
 
                 for (j = start; j < end - 1; j += 2) {
-                    tmphist[c1][(int)(ri->data[i][j] * scale)]++;
-                    tmphist[c2][(int)(ri->data[i][j + 1] * scale)]++;
+                    tmphist[c1][(int)(ri->get_data(i, j) * scale)]++;
+                    tmphist[c2][(int)(ri->get_data(i, j + 1) * scale)]++;
                 }
 
                 if(j < end) { // last pixel of row if width is odd
-                    tmphist[c1][(int)(ri->data[i][j] * scale)]++;
+                    tmphist[c1][(int)(ri->get_data(i, j) * scale)]++;
                 }
             } else if (ri->get_colors() == 1) {
                 for (int j = start; j < end; j++) {
-                    tmphist[0][(int)(ri->data[i][j] * scale)]++;
+                    tmphist[0][(int)(ri->get_data(i, j) * scale)]++;
                 }
             } else if(ri->getSensorType() == ST_FUJI_XTRANS) {
                 for (int j = start; j < end - 1; j += 2) {
                     int c = ri->XTRANSFC(i, j);
-                    tmphist[c][(int)(ri->data[i][j] * scale)]++;
+                    tmphist[c][(int)(ri->get_data(i, j) * scale)]++;
                 }
             } else {
                 for (int j = start; j < end; j++) {
                     for (int c = 0; c < 3; c++) {
-                        tmphist[c][(int)(ri->data[i][3 * j + c] * scale)]++;
+                        tmphist[c][(int)(ri->get_data(i, 3 * j + c) * scale)]++;
                     }
                 }
             }
@@ -19,8 +19,11 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "array2D.h"
 #include "colortemp.h"
@@ -31,6 +34,7 @@
 
 namespace rtengine
 {
+class LensCorrection;
 class PixelsMap;
 class RawImage;
 class DiagonalCurve;
@@ -74,6 +78,14 @@ protected:
     double defGain;
     cmsHPROFILE camProfile;
     bool rgbSourceModified;
+    bool rgbBinned; // red, green and blue are demosaiced on demand, see deferDemosaic()
+    std::string deferredMethod;
+    std::vector<bool> demosaicedBlocks;
+    std::vector<double> caFit; // auto CA fit of the last preprocess, see CA_correct_RT()
+    std::uint64_t caFitKey;
+    bool dualDemosaicCaching;
+    std::unique_ptr<multi_array2D<float, 6>> dualDemosaicCache; // results of both demosaicers of the last dual demosaic, see dual_demosaic_RT()
+    std::string dualDemosaicKey;
 
     RawImage* ri;  // Copy of raw pixels, NOT corrected for initial gain, blackpoint etc.
     RawImage* riFrames[6] = {nullptr};
@@ -123,6 +135,9 @@ public:
     void        filmNegativeProcess (const procparams::FilmNegativeParams &params) override;
     bool        getFilmNegativeExponents (Coord2D spotA, Coord2D spotB, int tran, const procparams::FilmNegativeParams &currentParams, std::array<float, 3>& newExps) override;
     void        demosaic    (const procparams::RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache = false) override;
+    bool        deferDemosaic (const procparams::RAWParams &raw) override;
+    void        setDualDemosaicCaching (bool enable) override { dualDemosaicCaching = enable; }
+    void        demosaicRegion (int x, int y, int w, int h);
     void        retinex       (const procparams::ColorManagementParams& cmp, const procparams::RetinexParams &deh, const procparams::ToneCurveParams& Tc, LUTf & cdcurve, LUTf & mapcurve, const RetinextransmissionCurve & dehatransmissionCurve, const RetinexgaintransmissionCurve & dehagaintransmissionCurve, multi_array2D<float, 4> &conversionBuffer, bool dehacontlutili, bool mapcontlutili, bool useHsl, float &minCD, float &maxCD, float &mini, float &maxi, float &Tmean, float &Tsigma, float &Tmin, float &Tmax, LUTu &histLRETI) override;
     void        retinexPrepareCurves       (const procparams::RetinexParams &retinexParams, LUTf &cdcurve, LUTf &mapcurve, RetinextransmissionCurve &retinextransmissionCurve, RetinexgaintransmissionCurve &retinexgaintransmissionCurve, bool &retinexcontlutili, bool &mapcontlutili, bool &useHsl, LUTu & lhist16RETI, LUTu & histLRETI) override;
     void        retinexPrepareBuffers      (const procparams::ColorManagementParams& cmp, const procparams::RetinexParams &retinexParams, multi_array2D<float, 4> &conversionBuffer, LUTu &lhist16RETI) override;
@@ -137,9 +152,10 @@ public:
         return rgbSourceModified;   // tracks whether cached rgb output of demosaic has been modified
     }
 
-    void        processFlatField(const procparams::RAWParams &raw, const RawImage *riFlatFile, const unsigned short black[4]);
-    void        copyOriginalPixels(const procparams::RAWParams &raw, RawImage *ri, RawImage *riDark, RawImage *riFlatFile, array2D<float> &rawData  );
-    void        scaleColors (int winx, int winy, int winw, int winh, const procparams::RAWParams &raw, array2D<float> &rawData); // raw for cblack
+    std::unique_ptr<float[]> flatFieldGain(const procparams::RAWParams &raw, const RawImage *riFlatFile, const RawImage *src, const RawImage *riDark, const unsigned short black[4]);
+    void        copyOriginalPixels(const RawImage *src, const RawImage *riDark, const float *flatFieldGain, const LensCorrection *vignetting, array2D<float> &rawData, const array2D<float> *averageWith = nullptr, bool scale = true);
+    void        scaleColors (const procparams::RAWParams &raw); // raw for cblack
+    void        scaleRow (int row, float *data, float rowMax[3]) const;
 
     void        getImage    (const ColorTemp &ctemp, int tran, Imagefloat* image, const PreviewProps &pp, const procparams::ToneCurveParams &hrp, const procparams::RAWParams &raw) override;
     eSensorType getSensorType () const override;
@@ -242,7 +258,7 @@ protected:
         double cablue,
         bool avoidColourshift,
         const array2D<float> &rawData,
-        double* fitParamsTransfer,
+        std::vector<double>* fitParamsTransfer,
         bool fitParamsIn,
         bool fitParamsOut,
         float* buffer,
@@ -269,11 +285,11 @@ protected:
     void igv_interpolate(int winw, int winh);
     void lmmse_interpolate_omp(int winw, int winh, array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, int iterations);
     void amaze_demosaic_RT(int winx, int winy, int winw, int winh, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, size_t chunkSize = 1, bool measure = false);//Emil's code for AMaZE
-    void dual_demosaic_RT(bool isBayer, const procparams::RAWParams &raw, int winw, int winh, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, double &contrast, bool autoContrast = false);
+    void dual_demosaic_RT(bool isBayer, const procparams::RAWParams &raw, int winw, int winh, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue, double &contrast, bool autoContrast = false, bool useCache = false);
     void fast_demosaic();//Emil's code for fast demosaicing
     void dcb_demosaic(int iterations, bool dcb_enhance);
     void ahd_demosaic();
-    void rcd_demosaic(size_t chunkSize = 1, bool measure = false);
+    void rcd_demosaic(int winx, int winy, int winw, int winh, size_t chunkSize = 1, bool measure = false);
     void border_interpolate(int winw, int winh, int lborders, const array2D<float> &rawData, array2D<float> &red, array2D<float> &green, array2D<float> &blue);
     void dcb_initTileLimits(int &colMin, int &rowMin, int &colMax, int &rowMax, int x0, int y0, int border);
     void fill_raw( float (*cache )[3], int x0, int y0, float** rawData);
@@ -46,7 +46,9 @@ namespace rtengine
 * Licensed under the GNU GPL version 3
 */
 // Tiled version by Ingo Weyrich (heckflosse67@gmx.de)
-void RawImageSource::rcd_demosaic(size_t chunkSize, bool measure)
+// Tiles which don't overlap the window winx, winy, winw, winh are skipped. The tile grid doesn't depend on the window,
+// so the demosaiced pixels of a window are exactly those of the whole image.
+void RawImageSource::rcd_demosaic(int winx, int winy, int winw, int winh, size_t chunkSize, bool measure)
 {
     std::unique_ptr<StopWatch> stop;
 
@@ -99,6 +101,9 @@ void RawImageSource::rcd_demosaic(size_t chunkSize, bool measure)
             if(colStart + rcdBorder == colEnd - rcdBorder) {
                 continue;
             }
+            if(rowEnd - rcdBorder <= winy || rowStart + rcdBorder >= winy + winh || colEnd - rcdBorder <= winx || colStart + rcdBorder >= winx + winw) {
+                continue;
+            }
 
             const int tileRows = std::min(rowEnd - rowStart, tileSize);
             const int tilecols = std::min(colEnd - colStart, tileSize);
@@ -180,6 +180,13 @@ public:
       * @param firstFrameOnly must be true to get the MetaData of the first frame only, e.g. for a PixelShift file.
       * @return The metadata */
     static FramesMetaData* fromFile (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml, bool firstFrameOnly = false);
+    /** Reads only the metadata shown and filtered in the file browser and matched by the dynamic profiles
+      * (exposure, camera, lens, date, orientation, rating, frame types). Only these tags are read from the main IFDs,
+      * no IPTC data are read: the result is not suitable to copy the metadata to an output file.
+      * @param fname is the name of the file
+      * @param rml same as for fromFile
+      * @return The metadata */
+    static FramesMetaData* summaryFromFile (const Glib::ustring& fname, std::unique_ptr<RawMetaDataLocation> rml);
 };
 
 /** This listener interface is used to indicate the progress of time consuming operations */
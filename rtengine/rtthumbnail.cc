@@ -37,6 +37,8 @@
 #include "jpeg.h"
 #include "labimage.h"
 #include "median.h"
+#include "myfile.h"
+#include "packedcache.h"
 #include "procparams.h"
 #include "rawimage.h"
 #include "rawimagesource.h"
@@ -186,6 +188,63 @@ void scale_colors (rtengine::RawImage *ri, float scale_mul[4], float cblack[4],
     }
 }
 
+void appendBytes (std::vector<char>& buffer, const void* data, std::size_t size)
+{
+    const char* const bytes = static_cast<const char*> (data);
+    buffer.insert (buffer.end(), bytes, bytes + size);
+}
+
+bool readBytes (const std::vector<char>& buffer, std::size_t& pos, void* data, std::size_t size)
+{
+    if (pos + size > buffer.size()) {
+        return false;
+    }
+
+    std::copy (buffer.begin() + pos, buffer.begin() + pos + size, static_cast<char*> (data));
+    pos += size;
+    return true;
+}
+
+// Planar images are stored channel by channel, as done by PlanarRGBData::writeData()
+template<class IC>
+void appendPlanes (std::vector<char>& buffer, const IC* image)
+{
+    const std::size_t rowSize = image->getWidth() * sizeof (image->r (0)[0]);
+
+    for (int i = 0; i < image->getHeight(); ++i) {
+        appendBytes (buffer, image->r (i), rowSize);
+    }
+
+    for (int i = 0; i < image->getHeight(); ++i) {
+        appendBytes (buffer, image->g (i), rowSize);
+    }
+
+    for (int i = 0; i < image->getHeight(); ++i) {
+        appendBytes (buffer, image->b (i), rowSize);
+    }
+}
+
+template<class IC>
+bool readPlanes (const std::vector<char>& buffer, std::size_t& pos, IC* image)
+{
+    const std::size_t rowSize = image->getWidth() * sizeof (image->r (0)[0]);
+    bool ok = true;
+
+    for (int i = 0; ok && i < image->getHeight(); ++i) {
+        ok = readBytes (buffer, pos, image->r (i), rowSize);
+    }
+
+    for (int i = 0; ok && i < image->getHeight(); ++i) {
+        ok = readBytes (buffer, pos, image->g (i), rowSize);
+    }
+
+    for (int i = 0; ok && i < image->getHeight(); ++i) {
+        ok = readBytes (buffer, pos, image->b (i), rowSize);
+    }
+
+    return ok;
+}
+
 }
 
 namespace rtengine
@@ -521,6 +580,31 @@ RawMetaDataLocation Thumbnail::loadMetaDataFromRaw (const Glib::ustring& fname)
     rml.ciffBase = -1;
     rml.ciffLength = -1;
 
+    // Most raw formats are TIFF based and have their Exif data at the start of the file,
+    // spotting them the way DCraw::identify() does avoids identifying the whole file
+    IMFILE* const f = gfopen (fname.c_str());
+
+    if (f) {
+        char head[32];
+        bool tiff = fread (head, 1, 32, f) == 32 && f->size >= 100000 && (!memcmp (head, "II", 2) || !memcmp (head, "MM", 2));
+
+        if (tiff) {
+            // Phase One and CIFF (Canon CRW) files have a different layout
+            for (int i = 0; i <= 28 && tiff; ++i) {
+                tiff = memcmp (head + i, "MMMM", 4) && memcmp (head + i, "IIII", 4);
+            }
+
+            tiff = tiff && memcmp (head + 6, "HEAPCCDR", 8);
+        }
+
+        fclose (f);
+
+        if (tiff) {
+            rml.exifBase = 0;
+            return rml;
+        }
+    }
+
     RawImage ri (fname);
     unsigned int imageNum = 0;
 
@@ -2011,120 +2095,150 @@ bool Thumbnail::readImage (const Glib::ustring& fname)
     return success;
 }
 
-bool Thumbnail::readData  (const Glib::ustring& fname)
+void Thumbnail::readLiveThumbData (Glib::KeyFile& keyFile)
 {
-    setlocale (LC_NUMERIC, "C"); // to set decimal point to "."
-    Glib::KeyFile keyFile;
+    if (keyFile.has_group ("LiveThumbData")) {
+        if (keyFile.has_key ("LiveThumbData", "CamWBRed")) {
+            camwbRed            = keyFile.get_double ("LiveThumbData", "CamWBRed");
+        }
 
-    try {
-        MyMutex::MyLock thmbLock (thumbMutex);
+        if (keyFile.has_key ("LiveThumbData", "CamWBGreen")) {
+            camwbGreen          = keyFile.get_double ("LiveThumbData", "CamWBGreen");
+        }
 
-        try {
-            keyFile.load_from_file (fname);
-        } catch (Glib::Error&) {
-            return false;
+        if (keyFile.has_key ("LiveThumbData", "CamWBBlue")) {
+            camwbBlue           = keyFile.get_double ("LiveThumbData", "CamWBBlue");
         }
 
-        if (keyFile.has_group ("LiveThumbData")) {
-            if (keyFile.has_key ("LiveThumbData", "CamWBRed")) {
-                camwbRed            = keyFile.get_double ("LiveThumbData", "CamWBRed");
-            }
+        if (keyFile.has_key ("LiveThumbData", "RedAWBMul")) {
+            redAWBMul           = keyFile.get_double ("LiveThumbData", "RedAWBMul");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "CamWBGreen")) {
-                camwbGreen          = keyFile.get_double ("LiveThumbData", "CamWBGreen");
-            }
+        if (keyFile.has_key ("LiveThumbData", "GreenAWBMul")) {
+            greenAWBMul         = keyFile.get_double ("LiveThumbData", "GreenAWBMul");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "CamWBBlue")) {
-                camwbBlue           = keyFile.get_double ("LiveThumbData", "CamWBBlue");
-            }
+        if (keyFile.has_key ("LiveThumbData", "BlueAWBMul")) {
+            blueAWBMul          = keyFile.get_double ("LiveThumbData", "BlueAWBMul");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "RedAWBMul")) {
-                redAWBMul           = keyFile.get_double ("LiveThumbData", "RedAWBMul");
-            }
+        if (keyFile.has_key ("LiveThumbData", "AEHistCompression")) {
+            aeHistCompression   = keyFile.get_integer ("LiveThumbData", "AEHistCompression");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "GreenAWBMul")) {
-                greenAWBMul         = keyFile.get_double ("LiveThumbData", "GreenAWBMul");
-            }
+        aeValid = true;
+        if (keyFile.has_key ("LiveThumbData", "AEExposureCompensation")) {
+            aeExposureCompensation = keyFile.get_double ("LiveThumbData", "AEExposureCompensation");
+        } else {
+            aeValid = false;
+        }
+        if (keyFile.has_key ("LiveThumbData", "AELightness")) {
+            aeLightness   = keyFile.get_integer ("LiveThumbData", "AELightness");
+        } else {
+            aeValid = false;
+        }
+        if (keyFile.has_key ("LiveThumbData", "AEContrast")) {
+            aeContrast   = keyFile.get_integer ("LiveThumbData", "AEContrast");
+        } else {
+            aeValid = false;
+        }
+        if (keyFile.has_key ("LiveThumbData", "AEBlack")) {
+            aeBlack   = keyFile.get_integer ("LiveThumbData", "AEBlack");
+        } else {
+            aeValid = false;
+        }
+        if (keyFile.has_key ("LiveThumbData", "AEHighlightCompression")) {
+            aeHighlightCompression   = keyFile.get_integer ("LiveThumbData", "AEHighlightCompression");
+        } else {
+            aeValid = false;
+        }
+        if (keyFile.has_key ("LiveThumbData", "AEHighlightCompressionThreshold")) {
+            aeHighlightCompressionThreshold   = keyFile.get_integer ("LiveThumbData", "AEHighlightCompressionThreshold");
+        } else {
+            aeValid = false;
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "BlueAWBMul")) {
-                blueAWBMul          = keyFile.get_double ("LiveThumbData", "BlueAWBMul");
-            }
+        if (keyFile.has_key ("LiveThumbData", "RedMultiplier")) {
+            redMultiplier       = keyFile.get_double ("LiveThumbData", "RedMultiplier");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "AEHistCompression")) {
-                aeHistCompression   = keyFile.get_integer ("LiveThumbData", "AEHistCompression");
-            }
+        if (keyFile.has_key ("LiveThumbData", "GreenMultiplier")) {
+            greenMultiplier     = keyFile.get_double ("LiveThumbData", "GreenMultiplier");
+        }
 
-            aeValid = true;
-            if (keyFile.has_key ("LiveThumbData", "AEExposureCompensation")) {
-                aeExposureCompensation = keyFile.get_double ("LiveThumbData", "AEExposureCompensation");
-            } else {
-                aeValid = false;
-            }
-            if (keyFile.has_key ("LiveThumbData", "AELightness")) {
-                aeLightness   = keyFile.get_integer ("LiveThumbData", "AELightness");
-            } else {
-                aeValid = false;
-            }
-            if (keyFile.has_key ("LiveThumbData", "AEContrast")) {
-                aeContrast   = keyFile.get_integer ("LiveThumbData", "AEContrast");
-            } else {
-                aeValid = false;
-            }
-            if (keyFile.has_key ("LiveThumbData", "AEBlack")) {
-                aeBlack   = keyFile.get_integer ("LiveThumbData", "AEBlack");
-            } else {
-                aeValid = false;
-            }
-            if (keyFile.has_key ("LiveThumbData", "AEHighlightCompression")) {
-                aeHighlightCompression   = keyFile.get_integer ("LiveThumbData", "AEHighlightCompression");
-            } else {
-                aeValid = false;
-            }
-            if (keyFile.has_key ("LiveThumbData", "AEHighlightCompressionThreshold")) {
-                aeHighlightCompressionThreshold   = keyFile.get_integer ("LiveThumbData", "AEHighlightCompressionThreshold");
-            } else {
-                aeValid = false;
-            }
+        if (keyFile.has_key ("LiveThumbData", "BlueMultiplier")) {
+            blueMultiplier      = keyFile.get_double ("LiveThumbData", "BlueMultiplier");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "RedMultiplier")) {
-                redMultiplier       = keyFile.get_double ("LiveThumbData", "RedMultiplier");
-            }
+        if (keyFile.has_key ("LiveThumbData", "Scale")) {
+            scale               = keyFile.get_double ("LiveThumbData", "Scale");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "GreenMultiplier")) {
-                greenMultiplier     = keyFile.get_double ("LiveThumbData", "GreenMultiplier");
-            }
+        if (keyFile.has_key ("LiveThumbData", "DefaultGain")) {
+            defGain             = keyFile.get_double ("LiveThumbData", "DefaultGain");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "BlueMultiplier")) {
-                blueMultiplier      = keyFile.get_double ("LiveThumbData", "BlueMultiplier");
-            }
+        if (keyFile.has_key ("LiveThumbData", "ScaleForSave")) {
+            scaleForSave        = keyFile.get_integer ("LiveThumbData", "ScaleForSave");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "Scale")) {
-                scale               = keyFile.get_double ("LiveThumbData", "Scale");
-            }
+        if (keyFile.has_key ("LiveThumbData", "GammaCorrected")) {
+            gammaCorrected      = keyFile.get_boolean ("LiveThumbData", "GammaCorrected");
+        }
 
-            if (keyFile.has_key ("LiveThumbData", "DefaultGain")) {
-                defGain             = keyFile.get_double ("LiveThumbData", "DefaultGain");
-            }
+        if (keyFile.has_key ("LiveThumbData", "ColorMatrix")) {
+            std::vector<double> cm = keyFile.get_double_list ("LiveThumbData", "ColorMatrix");
+            int ix = 0;
 
-            if (keyFile.has_key ("LiveThumbData", "ScaleForSave")) {
-                scaleForSave        = keyFile.get_integer ("LiveThumbData", "ScaleForSave");
-            }
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++) {
+                    colorMatrix[i][j] = cm[ix++];
+                }
+        }
+    }
+}
 
-            if (keyFile.has_key ("LiveThumbData", "GammaCorrected")) {
-                gammaCorrected      = keyFile.get_boolean ("LiveThumbData", "GammaCorrected");
-            }
+void Thumbnail::writeLiveThumbData (Glib::KeyFile& keyFile)
+{
+    keyFile.set_double  ("LiveThumbData", "CamWBRed", camwbRed);
+    keyFile.set_double  ("LiveThumbData", "CamWBGreen", camwbGreen);
+    keyFile.set_double  ("LiveThumbData", "CamWBBlue", camwbBlue);
+    keyFile.set_double  ("LiveThumbData", "RedAWBMul", redAWBMul);
+    keyFile.set_double  ("LiveThumbData", "GreenAWBMul", greenAWBMul);
+    keyFile.set_double  ("LiveThumbData", "BlueAWBMul", blueAWBMul);
+    keyFile.set_double  ("LiveThumbData", "AEExposureCompensation", aeExposureCompensation);
+    keyFile.set_integer ("LiveThumbData", "AELightness", aeLightness);
+    keyFile.set_integer ("LiveThumbData", "AEContrast", aeContrast);
+    keyFile.set_integer ("LiveThumbData", "AEBlack", aeBlack);
+    keyFile.set_integer ("LiveThumbData", "AEHighlightCompression", aeHighlightCompression);
+    keyFile.set_integer ("LiveThumbData", "AEHighlightCompressionThreshold", aeHighlightCompressionThreshold);
+    keyFile.set_double  ("LiveThumbData", "RedMultiplier", redMultiplier);
+    keyFile.set_double  ("LiveThumbData", "GreenMultiplier", greenMultiplier);
+    keyFile.set_double  ("LiveThumbData", "BlueMultiplier", blueMultiplier);
+    keyFile.set_double  ("LiveThumbData", "Scale", scale);
+    keyFile.set_double  ("LiveThumbData", "DefaultGain", defGain);
+    keyFile.set_integer ("LiveThumbData", "ScaleForSave", scaleForSave);
+    keyFile.set_boolean ("LiveThumbData", "GammaCorrected", gammaCorrected);
+    Glib::ArrayHandle<double> cm ((double*)colorMatrix, 9, Glib::OWNERSHIP_NONE);
+    keyFile.set_double_list ("LiveThumbData", "ColorMatrix", cm);
+}
 
-            if (keyFile.has_key ("LiveThumbData", "ColorMatrix")) {
-                std::vector<double> cm = keyFile.get_double_list ("LiveThumbData", "ColorMatrix");
-                int ix = 0;
+bool Thumbnail::readData  (const Glib::ustring& fname)
+{
+    setlocale (LC_NUMERIC, "C"); // to set decimal point to "."
+    Glib::KeyFile keyFile;
 
-                for (int i = 0; i < 3; i++)
-                    for (int j = 0; j < 3; j++) {
-                        colorMatrix[i][j] = cm[ix++];
-                    }
-            }
+    try {
+        MyMutex::MyLock thmbLock (thumbMutex);
+
+        try {
+            keyFile.load_from_file (fname);
+        } catch (Glib::Error&) {
+            return false;
         }
 
+        readLiveThumbData (keyFile);
+
         return true;
     } catch (Glib::Error &err) {
         if (settings->verbose) {
@@ -2153,27 +2267,7 @@ bool Thumbnail::writeData  (const Glib::ustring& fname)
             keyFile.load_from_file (fname);
         } catch (Glib::Error&) {}
 
-        keyFile.set_double  ("LiveThumbData", "CamWBRed", camwbRed);
-        keyFile.set_double  ("LiveThumbData", "CamWBGreen", camwbGreen);
-        keyFile.set_double  ("LiveThumbData", "CamWBBlue", camwbBlue);
-        keyFile.set_double  ("LiveThumbData", "RedAWBMul", redAWBMul);
-        keyFile.set_double  ("LiveThumbData", "GreenAWBMul", greenAWBMul);
-        keyFile.set_double  ("LiveThumbData", "BlueAWBMul", blueAWBMul);
-        keyFile.set_double  ("LiveThumbData", "AEExposureCompensation", aeExposureCompensation);
-        keyFile.set_integer ("LiveThumbData", "AELightness", aeLightness);
-        keyFile.set_integer ("LiveThumbData", "AEContrast", aeContrast);
-        keyFile.set_integer ("LiveThumbData", "AEBlack", aeBlack);
-        keyFile.set_integer ("LiveThumbData", "AEHighlightCompression", aeHighlightCompression);
-        keyFile.set_integer ("LiveThumbData", "AEHighlightCompressionThreshold", aeHighlightCompressionThreshold);
-        keyFile.set_double  ("LiveThumbData", "RedMultiplier", redMultiplier);
-        keyFile.set_double  ("LiveThumbData", "GreenMultiplier", greenMultiplier);
-        keyFile.set_double  ("LiveThumbData", "BlueMultiplier", blueMultiplier);
-        keyFile.set_double  ("LiveThumbData", "Scale", scale);
-        keyFile.set_double  ("LiveThumbData", "DefaultGain", defGain);
-        keyFile.set_integer ("LiveThumbData", "ScaleForSave", scaleForSave);
-        keyFile.set_boolean ("LiveThumbData", "GammaCorrected", gammaCorrected);
-        Glib::ArrayHandle<double> cm ((double*)colorMatrix, 9, Glib::OWNERSHIP_NONE);
-        keyFile.set_double_list ("LiveThumbData", "ColorMatrix", cm);
+        writeLiveThumbData (keyFile);
 
         keyData = keyFile.to_data ();
 
@@ -2292,6 +2386,220 @@ bool Thumbnail::writeAEHistogram (const Glib::ustring& fname)
     return false;
 }
 
+bool Thumbnail::writeImage (PackedCache& cache, const std::string& md5)
+{
+
+    if (!thumbImg) {
+        return false;
+    }
+
+    std::vector<char> buffer;
+
+    appendBytes (buffer, thumbImg->getType(), strlen (thumbImg->getType()));
+    buffer.push_back ('\n');
+    const guint32 w = guint32 (thumbImg->getWidth());
+    const guint32 h = guint32 (thumbImg->getHeight());
+    appendBytes (buffer, &w, sizeof (guint32));
+    appendBytes (buffer, &h, sizeof (guint32));
+
+    if (thumbImg->getType() == sImage8) {
+        const Image8 *image = static_cast<Image8*> (thumbImg);
+        buffer.reserve (buffer.size() + 3 * std::size_t (w) * h);
+
+        for (int i = 0; i < image->getHeight(); ++i) {
+            appendBytes (buffer, image->r (i), 3 * std::size_t (w));
+        }
+    } else if (thumbImg->getType() == sImage16) {
+        appendPlanes (buffer, static_cast<Image16*> (thumbImg));
+    } else if (thumbImg->getType() == sImagefloat) {
+        appendPlanes (buffer, static_cast<Imagefloat*> (thumbImg));
+    }
+
+    return cache.put (md5, PackedCache::Record::IMAGE, buffer.data(), buffer.size());
+}
+
+bool Thumbnail::readImage (PackedCache& cache, const std::string& md5)
+{
+
+    if (thumbImg) {
+        delete thumbImg;
+        thumbImg = nullptr;
+    }
+
+    std::vector<char> buffer;
+
+    if (!cache.get (md5, PackedCache::Record::IMAGE, buffer)) {
+        return false;
+    }
+
+    const auto eol = std::find (buffer.begin(), buffer.end(), '\n');
+
+    if (eol == buffer.end()) {
+        return false;
+    }
+
+    const std::string imgType (buffer.begin(), eol);
+    std::size_t pos = eol - buffer.begin() + 1;
+
+    guint32 width, height;
+
+    if (!readBytes (buffer, pos, &width, sizeof (guint32)) || !readBytes (buffer, pos, &height, sizeof (guint32)) || std::min (width, height) == 0) {
+        return false;
+    }
+
+    bool success = false;
+
+    if (imgType == sImage8) {
+        std::unique_ptr<Image8> image (new Image8 (width, height));
+        success = true;
+
+        for (int i = 0; success && i < image->getHeight(); ++i) {
+            success = readBytes (buffer, pos, image->r (i), 3 * std::size_t (width));
+        }
+
+        if (success) {
+            thumbImg = image.release();
+        }
+    } else if (imgType == sImage16) {
+        std::unique_ptr<Image16> image (new Image16 (width, height));
+        success = readPlanes (buffer, pos, image.get());
+
+        if (success) {
+            thumbImg = image.release();
+        }
+    } else if (imgType == sImagefloat) {
+        std::unique_ptr<Imagefloat> image (new Imagefloat (width, height));
+        success = readPlanes (buffer, pos, image.get());
+
+        if (success) {
+            thumbImg = image.release();
+        }
+    } else {
+        printf ("readImage: Unsupported image type \"%s\"!\n", imgType.c_str());
+    }
+
+    return success;
+}
+
+bool Thumbnail::readData (PackedCache& cache, const std::string& md5)
+{
+    setlocale (LC_NUMERIC, "C"); // to set decimal point to "."
+
+    std::vector<char> buffer;
+
+    if (!cache.get (md5, PackedCache::Record::DATA, buffer)) {
+        return false;
+    }
+
+    Glib::KeyFile keyFile;
+
+    try {
+        MyMutex::MyLock thmbLock (thumbMutex);
+
+        try {
+            keyFile.load_from_data (std::string (buffer.begin(), buffer.end()));
+        } catch (Glib::Error&) {
+            return false;
+        }
+
+        readLiveThumbData (keyFile);
+
+        return true;
+    } catch (Glib::Error &err) {
+        if (settings->verbose) {
+            printf ("Thumbnail::readData / Error code %d while reading values of cache entry %s:\n%s\n", err.code(), md5.c_str(), err.what().c_str());
+        }
+    } catch (...) {
+        if (settings->verbose) {
+            printf ("Thumbnail::readData / Unknown exception while trying to load cache entry %s!\n", md5.c_str());
+        }
+    }
+
+    return false;
+}
+
+bool Thumbnail::writeData (PackedCache& cache, const std::string& md5)
+{
+    MyMutex::MyLock thmbLock (thumbMutex);
+
+    Glib::ustring keyData;
+
+    try {
+
+        Glib::KeyFile keyFile;
+        std::vector<char> buffer;
+
+        // the data record is shared with CacheImageData, keep its groups
+        if (cache.get (md5, PackedCache::Record::DATA, buffer)) {
+            try {
+                keyFile.load_from_data (std::string (buffer.begin(), buffer.end()));
+            } catch (Glib::Error&) {}
+        }
+
+        writeLiveThumbData (keyFile);
+
+        keyData = keyFile.to_data ();
+
+    } catch (Glib::Error& err) {
+        if (settings->verbose) {
+            printf ("Thumbnail::writeData / Error code %d while reading values of cache entry %s:\n%s\n", err.code(), md5.c_str(), err.what().c_str());
+        }
+    } catch (...) {
+        if (settings->verbose) {
+            printf ("Thumbnail::writeData / Unknown exception while trying to save cache entry %s!\n", md5.c_str());
+        }
+    }
+
+    return !keyData.empty () && cache.put (md5, PackedCache::Record::DATA, keyData.data (), keyData.bytes ());
+}
+
+bool Thumbnail::readEmbProfile (PackedCache& cache, const std::string& md5)
+{
+
+    embProfileData = nullptr;
+    embProfile = nullptr;
+    embProfileLength = 0;
+
+    std::vector<char> buffer;
+
+    if (cache.get (md5, PackedCache::Record::EMB_PROFILE, buffer) && !buffer.empty ()) {
+        embProfileLength = buffer.size ();
+        embProfileData = new unsigned char[embProfileLength];
+        std::copy (buffer.begin (), buffer.end (), embProfileData);
+        embProfile = cmsOpenProfileFromMem (embProfileData, embProfileLength);
+    }
+
+    return embProfile != nullptr;
+}
+
+bool Thumbnail::writeEmbProfile (PackedCache& cache, const std::string& md5)
+{
+
+    return embProfileData && cache.put (md5, PackedCache::Record::EMB_PROFILE, embProfileData, embProfileLength);
+}
+
+bool Thumbnail::readAEHistogram (PackedCache& cache, const std::string& md5)
+{
+
+    std::vector<char> buffer;
+    const size_t histoBytes = (65536 >> aeHistCompression) * sizeof (aeHistogram[0]);
+
+    if (!cache.get (md5, PackedCache::Record::AE_HISTOGRAM, buffer) || buffer.size () != histoBytes) {
+        aeHistogram.reset ();
+        return false;
+    }
+
+    aeHistogram (65536 >> aeHistCompression);
+    std::copy (buffer.begin (), buffer.end (), reinterpret_cast<char*> (&aeHistogram[0]));
+    return true;
+}
+
+bool Thumbnail::writeAEHistogram (PackedCache& cache, const std::string& md5)
+{
+
+    return aeHistogram && cache.put (md5, PackedCache::Record::AE_HISTOGRAM, &aeHistogram[0], (65536 >> aeHistCompression) * sizeof (aeHistogram[0]));
+}
+
 unsigned char* Thumbnail::getImage8Data()
 {
     if (thumbImg && thumbImg->getType() == rtengine::sImage8) {
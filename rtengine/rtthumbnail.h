@@ -18,6 +18,8 @@
  */
 #pragma once
 
+#include <string>
+
 #include <glibmm/ustring.h>
 
 #include <lcms2.h>
@@ -30,9 +32,18 @@
 
 #include "../rtgui/threadutils.h"
 
+namespace Glib
+{
+
+class KeyFile;
+
+}
+
 namespace rtengine
 {
 
+class PackedCache;
+
 class Thumbnail
 {
 
@@ -71,6 +82,9 @@ class Thumbnail
     bool gammaCorrected;
     double colorMatrix[3][3];
 
+    void readLiveThumbData (Glib::KeyFile& keyFile);
+    void writeLiveThumbData (Glib::KeyFile& keyFile);
+
     void processFilmNegative(const procparams::ProcParams& params, const Imagefloat* baseImg, int rwidth, int rheight, float &rmi, float &gmi, float &bmi);
 
 public:
@@ -111,6 +125,16 @@ public:
     bool readAEHistogram  (const Glib::ustring& fname);
     bool writeAEHistogram (const Glib::ustring& fname);
 
+    // Same as above, but using the single file cache store
+    bool writeImage (PackedCache& cache, const std::string& md5);
+    bool readImage (PackedCache& cache, const std::string& md5);
+    bool readData  (PackedCache& cache, const std::string& md5);
+    bool writeData  (PackedCache& cache, const std::string& md5);
+    bool readEmbProfile  (PackedCache& cache, const std::string& md5);
+    bool writeEmbProfile (PackedCache& cache, const std::string& md5);
+    bool readAEHistogram  (PackedCache& cache, const std::string& md5);
+    bool writeAEHistogram (PackedCache& cache, const std::string& md5);
+
     bool isAeValid() { return aeValid; };
     unsigned char* getImage8Data();  // accessor to the 8bit image if it is one, which should be the case for the "Inspector" mode.
 
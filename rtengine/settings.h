@@ -48,6 +48,7 @@ public:
     bool            verbose;
     Glib::ustring   darkFramesPath;         ///< The default directory for dark frames
     Glib::ustring   flatFieldsPath;         ///< The default directory for flat fields
+    Glib::ustring   cacheDirectory;         ///< Base directory of the cache, the engine keeps e.g. its FFTW wisdom there. Empty to not persist anything
 
     Glib::ustring   adobe;                  // filename of AdobeRGB1998 profile (default to the bundled one)
     Glib::ustring   prophoto;               // filename of Prophoto     profile (default to the bundled one)
@@ -89,6 +90,10 @@ public:
     };
     ThumbnailInspectorMode thumbnail_inspector_mode;
 
+    bool            cacheCAFit;             ///< Keep the auto CA fits in the cache directory, so processing the same raw data again only applies the correction
+    bool            compactRawData;         ///< Keep the original raw frames as 16 bit integers instead of floats when that's lossless, halves their memory
+    bool            cacheDualDemosaic;      ///< Keep the results of both demosaicers of dual demosaic methods in the editor, so changing the contrast threshold only blends again. Costs six float planes
+
     /** Creates a new instance of Settings.
       * @return a pointer to the new Settings instance. */
     static Settings* create();
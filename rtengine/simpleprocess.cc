@@ -1465,7 +1465,7 @@ private:
         }
 
         noiseLCurve.Set (lcurve);
-        const char *medmethods[] = { "soft", "33", "55soft", "55", "77", "99" };
+        const char *medmethods[] = { "soft", "33", "55soft", "55", "77", "99", "1515", "2121" };
 
         if (params.dirpyrDenoise.median) {
             auto &key = params.dirpyrDenoise.methodmed == "RGB" ? params.dirpyrDenoise.rgbmethod : params.dirpyrDenoise.medmethod;
@@ -67,6 +67,7 @@
 
 #include "array2D.h"
 #include "color.h"
+#include "fftwplancache.h"
 #include "iccstore.h"
 #include "imagefloat.h"
 #include "improcfun.h"
@@ -722,6 +723,20 @@ void tmo_fattal02 (size_t width,
 // for both solvers.
 
 
+// Plans are estimated rather than measured, preview and crop sizes change all the
+// time and measuring a full image transform costs more than it saves. The cache
+// still spares planning again for repeated sizes, and measured wisdom is used.
+FFTWPlanCache::Plan getDCTPlan (int height, int width, const float *in, const float *out, bool multithread)
+{
+#ifdef _OPENMP
+    const int threads = multithread ? omp_get_max_threads() : 1;
+#else
+    const int threads = 1;
+#endif
+    return FFTWPlanCache::getInstance()->getR2R2D (height, width, FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE, threads, in, out);
+}
+
+
 // returns T = EVy A EVx^tr
 // note, modifies input data
 void transform_ev2normal (Array2Df *A, Array2Df *T, bool multithread)
@@ -761,11 +776,8 @@ void transform_ev2normal (Array2Df *A, Array2Df *T, bool multithread)
     // fftwf_free(in);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d (height, width, A->data(), T->data(),
-                           FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute (p);
-    fftwf_destroy_plan (p);
+    const FFTWPlanCache::Plan p = getDCTPlan (height, width, A->data(), T->data(), multithread);
+    fftwf_execute_r2r (p.get(), A->data(), T->data());
 }
 
 
@@ -777,11 +789,8 @@ void transform_normal2ev (Array2Df *A, Array2Df *T, bool multithread)
     assert ((int)T->getCols() == width && (int)T->getRows() == height);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d (height, width, A->data(), T->data(),
-                           FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute (p);
-    fftwf_destroy_plan (p);
+    const FFTWPlanCache::Plan p = getDCTPlan (height, width, A->data(), T->data(), multithread);
+    fftwf_execute_r2r (p.get(), A->data(), T->data());
 
     // need to scale the output matrix to get the right transform
     float factor = (1.0f / ((height - 1) * (width - 1)));
@@ -872,17 +881,7 @@ void solve_pde_fft (Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread)/*
     assert ((int)U->getCols() == width && (int)U->getRows() == height);
     assert (buf->getCols() == width && buf->getRows() == height);
 
-    // activate parallel execution of fft routines
-#ifdef RT_FFTW3F_OMP
-
-    if (multithread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads ( omp_get_max_threads() );
-    }
-
-// #else
-//   fftwf_plan_with_nthreads( 2 );
-#endif
+    // parallel execution of fft routines is set up by the plans of transform_normal2ev and transform_ev2normal
 
     // in general there might not be a solution to the Poisson pde
     // with Neumann boundary conditions unless the boundary satisfies
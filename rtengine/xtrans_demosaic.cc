@@ -725,8 +725,26 @@ void RawImageSource::xtrans_interpolate (const int passes, const bool useCieLab,
                         int f = dir[d & 3];
                         f = f == 1 ? 1 : f - 8;
 
-                        for (int row = 5; row < mrow - 5; row++)
-                            for (int col = 5; col < mcol - 5; col++) {
+#ifdef __SSE2__
+                        vfloat twov = F2V(2.f);
+#endif
+
+                        for (int row = 5; row < mrow - 5; row++) {
+                            int col = 5;
+#ifdef __SSE2__
+
+                            for (; col < mcol - 8; col += 4) {
+                                float *y = &yuv[0][row - 4][col - 4];
+                                float *u = &yuv[1][row - 4][col - 4];
+                                float *v = &yuv[2][row - 4][col - 4];
+                                STVFU(drv[d][row - 5][col - 5], SQRV(twov * LVFU(y[0]) - LVFU(y[f]) - LVFU(y[-f]))
+                                                                + SQRV(twov * LVFU(u[0]) - LVFU(u[f]) - LVFU(u[-f]))
+                                                                + SQRV(twov * LVFU(v[0]) - LVFU(v[f]) - LVFU(v[-f])));
+                            }
+
+#endif
+
+                            for (; col < mcol - 5; col++) {
                                 float *y = &yuv[0][row - 4][col - 4];
                                 float *u = &yuv[1][row - 4][col - 4];
                                 float *v = &yuv[2][row - 4][col - 4];
@@ -734,6 +752,7 @@ void RawImageSource::xtrans_interpolate (const int passes, const bool useCieLab,
                                                            + SQR(2 * u[0] - u[f] - u[-f])
                                                            + SQR(2 * v[0] - v[f] - v[-f]);
                             }
+                        }
                     }
                 }
 
@@ -910,8 +929,52 @@ void RawImageSource::xtrans_interpolate (const int passes, const bool useCieLab,
                 /* Average the most homogeneous pixels for the final result: */
                 uint8_t hm[8] = {};
 
-                for (int row = MIN(top, 8); row < mrow - 8; row++)
-                    for (int col = MIN(left, 8); col < mcol - 8; col++) {
+                for (int row = MIN(top, 8); row < mrow - 8; row++) {
+                    int col = MIN(left, 8);
+#ifdef __SSE2__
+                    // load 4 homogeneity values as floats
+                    const auto loadHomo = [](const uint8_t *src) {
+                        int32_t packed;
+                        memcpy(&packed, src, sizeof(packed));
+                        const vint zeroiv = _mm_setzero_si128();
+                        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zeroiv), zeroiv));
+                    };
+
+                    for (; col < mcol - 11; col += 4) {
+                        vfloat hmv[8];
+
+                        for (int d = 0; d < 4; d++) {
+                            hmv[d] = loadHomo(&homosum[d][row][col]);
+                        }
+
+                        for (int d = 4; d < ndir; d++) {
+                            hmv[d] = loadHomo(&homosum[d][row][col]);
+                            const vfloat prevv = hmv[d - 4];
+                            hmv[d - 4] = vself(vmaskf_lt(prevv, hmv[d]), ZEROV, prevv);
+                            hmv[d] = vself(vmaskf_gt(prevv, hmv[d]), ZEROV, hmv[d]);
+                        }
+
+                        const vfloat maxvalv = loadHomo(&homosummax[row][col]);
+                        vfloat avgv[4] = {ZEROV, ZEROV, ZEROV, ZEROV};
+
+                        for (int d = 0; d < ndir; d++) {
+                            const vmask selmask = vmaskf_ge(hmv[d], maxvalv);
+                            vfloat redv, greenv, bluev;
+                            vconvertrgbrgbrgbrgb2rrrrggggbbbb(rgb[d][row][col], redv, greenv, bluev);
+                            avgv[0] += vselfzero(selmask, redv);
+                            avgv[1] += vselfzero(selmask, greenv);
+                            avgv[2] += vselfzero(selmask, bluev);
+                            avgv[3] += vselfzero(selmask, onev);
+                        }
+
+                        STVFU(red[row + top][col + left], avgv[0] / avgv[3]);
+                        STVFU(green[row + top][col + left], avgv[1] / avgv[3]);
+                        STVFU(blue[row + top][col + left], avgv[2] / avgv[3]);
+                    }
+
+#endif
+
+                    for (; col < mcol - 8; col++) {
 
                         for (int d = 0; d < 4; d++) {
                             hm[d] = homosum[d][row][col];
@@ -943,6 +1006,7 @@ void RawImageSource::xtrans_interpolate (const int passes, const bool useCieLab,
                         green[row + top][col + left] = avg[1] / avg[3];
                         blue[row + top][col + left] = avg[2] / avg[3];
                     }
+                }
 
                 if(plistenerActive && ((++progressCounter) % 32 == 0)) {
 #ifdef _OPENMP
@@ -18,6 +18,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
 #include <cmath>
@@ -33,6 +34,7 @@
 
 #include "rtexif.h"
 
+#include "../rtengine/myfile.h"
 #include "../rtengine/procparams.h"
 
 #include "../rtgui/cacheimagedata.h"
@@ -49,6 +51,60 @@ namespace rtexif
 
 Interpreter stdInterpreter;
 
+//--------------- class TagFilter ----------------------------------------------
+
+TagFilter::TagFilter (std::initializer_list<const char*> names)
+{
+    for (const auto name : names) {
+        for (const TagAttrib* attrib = ifdAttribs; attrib->ignore != -1; ++attrib) {
+            if (!strcmp (attrib->name, name)) {
+                ifdIDs.push_back (attrib->ID);
+            }
+        }
+
+        for (const TagAttrib* attrib = exifAttribs; attrib->ignore != -1; ++attrib) {
+            if (!strcmp (attrib->name, name)) {
+                exifIDs.push_back (attrib->ID);
+            }
+        }
+    }
+
+    std::sort (ifdIDs.begin(), ifdIDs.end());
+    std::sort (exifIDs.begin(), exifIDs.end());
+}
+
+bool TagFilter::accepts (const TagAttrib* table, unsigned short ID) const
+{
+    if (ID == 0x002e) {
+        // the Panasonic preview is parsed by the Tag constructor, it may replace the Exif directory
+        return true;
+    }
+
+    if (table == ifdAttribs && ID == TIFFTAG_OSUBFILETYPE) {
+        // SubFileType has no name in the tables, but the frame detection reads it
+        return true;
+    }
+
+    if (table == ifdAttribs) {
+        return std::binary_search (ifdIDs.begin(), ifdIDs.end(), ID);
+    } else if (table == exifAttribs) {
+        return std::binary_search (exifIDs.begin(), exifIDs.end(), ID);
+    }
+
+    return true;
+}
+
+//--------------- class ExifSource ---------------------------------------------
+
+ExifSource::ExifSource (IMFILE* f, const TagFilter* filter) : f (f), filter (filter) {}
+
+ExifSource::~ExifSource ()
+{
+    if (f) {
+        fclose (f);
+    }
+}
+
 //--------------- class TagDirectory ------------------------------------------
 // this class is a collection (an array) of tags
 //-----------------------------------------------------------------------------
@@ -59,8 +115,8 @@ TagDirectory::TagDirectory ()
 TagDirectory::TagDirectory (TagDirectory* p, const TagAttrib* ta, ByteOrder border)
     : attribs (ta), order (border), parent (p) {}
 
-TagDirectory::TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored)
-    : attribs (ta), order (border), parent (p)
+TagDirectory::TagDirectory (TagDirectory* p, IMFILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored, const std::shared_ptr<ExifSource>& src)
+    : attribs (ta), order (border), parent (p), source (src)
 {
 
     int numOfTags = get2 (f, order);
@@ -69,10 +125,23 @@ TagDirectory::TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib*
         return;
     }
 
+    const ExifSource* const rootSource = getRoot()->getSource();
+    const TagFilter* const filter = rootSource ? rootSource->filter : nullptr;
     bool thumbdescr = false;
 
     for (int i = 0; i < numOfTags; i++) {
 
+        if (filter) {
+            // peek at the ID, the entry is skipped without reading its value
+            const unsigned short id = get2 (f, order);
+            fseek (f, -2, SEEK_CUR);
+
+            if (!filter->accepts (attribs, id)) {
+                fseek (f, 12, SEEK_CUR);
+                continue;
+            }
+        }
+
         Tag* newTag = new Tag (this, f, base);
 
         // filter out tags with unknown type
@@ -139,6 +208,11 @@ TagDirectory*  TagDirectory::getRoot()
     }
 }
 
+void TagDirectory::releaseSource ()
+{
+    source.reset ();
+}
+
 const TagAttrib* TagDirectory::getAttrib (int id)
 {
 
@@ -843,7 +917,7 @@ TagDirectoryTable::TagDirectoryTable (TagDirectory* p, unsigned char *v, int mem
     }
 }
 
-TagDirectoryTable::TagDirectoryTable (TagDirectory* p, FILE* f, int memsize, int offs, TagType type, const TagAttrib* ta, ByteOrder border)
+TagDirectoryTable::TagDirectoryTable (TagDirectory* p, IMFILE* f, int memsize, int offs, TagType type, const TagAttrib* ta, ByteOrder border)
     : TagDirectory (p, ta, border), zeroOffset (offs), valuesSize (memsize), defaultType ( type )
 {
     values = new unsigned char[valuesSize];
@@ -890,7 +964,7 @@ int TagDirectoryTable::write (int start, unsigned char* buffer)
 // this class represents a tag stored in the directory
 //-----------------------------------------------------------------------------
 
-Tag::Tag (TagDirectory* p, FILE* f, int base)
+Tag::Tag (TagDirectory* p, IMFILE* f, int base)
     : type (INVALID), count (0), value (nullptr), allocOwnMemory (true), attrib (nullptr), parent (p), directory (nullptr)
 {
 
@@ -1254,7 +1328,7 @@ defsubdirs:
 
 }
 
-bool Tag::parseMakerNote (FILE* f, int base, ByteOrder bom )
+bool Tag::parseMakerNote (IMFILE* f, int base, ByteOrder bom )
 {
     value = nullptr;
     Tag* tmake = parent->getRoot()->findTag ("Make");
@@ -2806,7 +2880,7 @@ void ExifManager::parse (bool isRaw, bool skipIgnored)
         fseek (f, rml->exifBase + ifdOffset, SEEK_SET);
 
         // first read the IFD directory
-        TagDirectory* root =  new TagDirectory (nullptr, f, rml->exifBase, ifdAttribs, order, skipIgnored);
+        TagDirectory* root =  new TagDirectory (nullptr, f, rml->exifBase, ifdAttribs, order, skipIgnored, source);
 
         // fix ISO issue with nikon and panasonic cameras
         Tag* make = root->getTag ("Make");
@@ -3370,7 +3444,7 @@ int sget4 (unsigned char *s, rtexif::ByteOrder order)
     }
 }
 
-inline unsigned short get2 (FILE* f, rtexif::ByteOrder order)
+inline unsigned short get2 (IMFILE* f, rtexif::ByteOrder order)
 {
 
     unsigned char str[2] = { 0xff, 0xff };
@@ -3378,7 +3452,7 @@ inline unsigned short get2 (FILE* f, rtexif::ByteOrder order)
     return rtexif::sget2 (str, order);
 }
 
-int get4 (FILE* f, rtexif::ByteOrder order)
+int get4 (IMFILE* f, rtexif::ByteOrder order)
 {
 
     unsigned char str[4] = { 0xff, 0xff, 0xff, 0xff };
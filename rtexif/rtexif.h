@@ -22,6 +22,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <initializer_list>
 #include <iomanip>
 #include <map>
 #include <memory>
@@ -49,6 +50,7 @@ namespace procparams
 }
 
 class CacheImageData;
+struct IMFILE;
 
 namespace rtexif
 {
@@ -74,8 +76,8 @@ bool extractLensInfo (const std::string &fullname, double &minFocal, double &max
 
 unsigned short sget2 (unsigned char *s, ByteOrder order);
 int sget4 (unsigned char *s, ByteOrder order);
-unsigned short get2 (FILE* f, ByteOrder order);
-int get4 (FILE* f, ByteOrder order);
+unsigned short get2 (IMFILE* f, ByteOrder order);
+int get4 (IMFILE* f, ByteOrder order);
 void sset2 (unsigned short v, unsigned char *s, ByteOrder order);
 void sset4 (int v, unsigned char *s, ByteOrder order);
 float int_to_float (int i);
@@ -110,6 +112,31 @@ struct TagAttrib {
 
 const TagAttrib* lookupAttrib (const TagAttrib* dir, const char* field);
 
+/// Selection of the tags read from IFD0 and the Exif directory, all other directories (maker notes...) are read completely
+class TagFilter
+{
+public:
+    explicit TagFilter (std::initializer_list<const char*> names);
+
+    bool accepts (const TagAttrib* table, unsigned short ID) const;
+
+private:
+    std::vector<unsigned short> ifdIDs;   // sorted
+    std::vector<unsigned short> exifIDs;  // sorted
+};
+
+/// The file a tag tree is read from, with the selection of tags to read; the maker notes are decoded while parsing
+class ExifSource :
+    public rtengine::NonCopyable
+{
+public:
+    explicit ExifSource (IMFILE* f, const TagFilter* filter = nullptr);
+    ~ExifSource ();
+
+    IMFILE* const          f;
+    const TagFilter* const filter; // tags to skip while parsing, NULL to read everything
+};
+
 /// A directory of tags
 class TagDirectory
 {
@@ -119,11 +146,12 @@ protected:
     const TagAttrib*  attribs;      // descriptor table to decode the tags
     ByteOrder         order;        // byte order
     TagDirectory*     parent;       // parent directory (NULL if root)
+    std::shared_ptr<ExifSource> source; // file the tree is being read from (root only, may be NULL)
     static Glib::ustring getDumpKey (int tagID, const Glib::ustring &tagName);
 
 public:
     TagDirectory ();
-    TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored = true);
+    TagDirectory (TagDirectory* p, IMFILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored = true, const std::shared_ptr<ExifSource>& src = nullptr);
     TagDirectory (TagDirectory* p, const TagAttrib* ta, ByteOrder border);
     virtual ~TagDirectory ();
 
@@ -136,6 +164,12 @@ public:
         return parent;
     }
     TagDirectory*    getRoot       ();
+    ExifSource*      getSource     () const
+    {
+        return source.get ();
+    }
+    // Drops the reference to the file once the tree is complete (root only)
+    void             releaseSource ();
     inline int       getCount      () const
     {
         return tags.size ();
@@ -203,7 +237,7 @@ protected:
 public:
     TagDirectoryTable();
     TagDirectoryTable (TagDirectory* p, unsigned char *v, int memsize, int offs, TagType type, const TagAttrib* ta, ByteOrder border);
-    TagDirectoryTable (TagDirectory* p, FILE* f, int memsize, int offset, TagType type, const TagAttrib* ta, ByteOrder border);
+    TagDirectoryTable (TagDirectory* p, IMFILE* f, int memsize, int offset, TagType type, const TagAttrib* ta, ByteOrder border);
     ~TagDirectoryTable() override;
     int calculateSize () override;
     int write (int start, unsigned char* buffer) override;
@@ -228,10 +262,10 @@ protected:
     TagDirectory*    parent;
     TagDirectory**   directory;
     MNKind           makerNoteKind;
-    bool             parseMakerNote (FILE* f, int base, ByteOrder bom );
+    bool             parseMakerNote (IMFILE* f, int base, ByteOrder bom );
 
 public:
-    Tag (TagDirectory* parent, FILE* f, int base);                          // parse next tag from the file
+    Tag (TagDirectory* parent, IMFILE* f, int base);                        // parse next tag from the file
     Tag (TagDirectory* parent, const TagAttrib* attr);
     Tag (TagDirectory* parent, const TagAttrib* attr, unsigned char *data, TagType t);
     Tag (TagDirectory* parent, const TagAttrib* attr, int data, TagType t);  // create a new tag from array (used
@@ -349,7 +383,8 @@ class ExifManager
     void parse (bool isRaw, bool skipIgnored = true);
 
 public:
-    FILE* f;
+    IMFILE* f;
+    std::shared_ptr<ExifSource> source; // if set, handed to the parsed trees
     std::unique_ptr<rtengine::RawMetaDataLocation> rml;
     ByteOrder order;
     bool onlyFirst;  // Only first IFD
@@ -357,9 +392,13 @@ public:
     std::vector<TagDirectory*> roots;
     std::vector<TagDirectory*> frames;
 
-    ExifManager (FILE* fHandle, std::unique_ptr<rtengine::RawMetaDataLocation> _rml, bool onlyFirstIFD)
+    ExifManager (IMFILE* fHandle, std::unique_ptr<rtengine::RawMetaDataLocation> _rml, bool onlyFirstIFD)
         : f(fHandle), rml(std::move(_rml)), order(UNKNOWN), onlyFirst(onlyFirstIFD),
           IFDOffset(0) {}
+    // the parsed trees keep the source (and thus the file) alive until their releaseSource()
+    ExifManager (const std::shared_ptr<ExifSource>& src, std::unique_ptr<rtengine::RawMetaDataLocation> _rml, bool onlyFirstIFD)
+        : f(src ? src->f : nullptr), source(src), rml(std::move(_rml)), order(UNKNOWN), onlyFirst(onlyFirstIFD),
+          IFDOffset(0) {}
 
     void setIFDOffset(unsigned int offset);
 
@@ -18,11 +18,17 @@
  */
 #include "cacheimagedata.h"
 #include <vector>
+#include <giomm.h>
 #include <glib/gstdio.h>
 #include <glibmm/keyfile.h>
 #include "version.h"
 #include <locale.h>
 
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "../rtengine/packedcache.h"
 #include "../rtengine/procparams.h"
 #include "../rtengine/settings.h"
 
@@ -61,198 +67,166 @@ CacheImageData::CacheImageData() :
 }
 
 /*
- * Load the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data file
+ * Read the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data
  */
-int CacheImageData::load (const Glib::ustring& fname)
+void CacheImageData::readKeyFile (Glib::KeyFile& keyFile)
 {
-    setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
-
-    Glib::KeyFile keyFile;
-
-    try {
-        if (keyFile.load_from_file (fname)) {
-
-            if (keyFile.has_group ("General")) {
-                if (keyFile.has_key ("General", "MD5")) {
-                    md5         = keyFile.get_string ("General", "MD5");
-                }
-
-                if (keyFile.has_key ("General", "Version")) {
-                    version     = keyFile.get_string ("General", "Version");
-                }
-
-                if (keyFile.has_key ("General", "Supported")) {
-                    supported   = keyFile.get_boolean ("General", "Supported");
-                }
-
-                if (keyFile.has_key ("General", "Format")) {
-                    format      = (ThFileType)keyFile.get_integer ("General", "Format");
-                }
-
-                if (keyFile.has_key ("General", "Rank")) {
-                    rankOld     = keyFile.get_integer ("General", "Rank");
-                }
-
-                if (keyFile.has_key ("General", "Rating")) {
-                    rating     = keyFile.get_integer ("General", "Rating");
-                }
+    if (keyFile.has_group ("General")) {
+        if (keyFile.has_key ("General", "MD5")) {
+            md5         = keyFile.get_string ("General", "MD5");
+        }
 
-                if (keyFile.has_key ("General", "InTrash")) {
-                    inTrashOld  = keyFile.get_boolean ("General", "InTrash");
-                }
+        if (keyFile.has_key ("General", "Version")) {
+            version     = keyFile.get_string ("General", "Version");
+        }
 
-                if (keyFile.has_key ("General", "RecentlySaved")) {
-                    recentlySaved = keyFile.get_boolean ("General", "RecentlySaved");
-                }
-            }
+        if (keyFile.has_key ("General", "Supported")) {
+            supported   = keyFile.get_boolean ("General", "Supported");
+        }
 
-            timeValid = keyFile.has_group ("DateTime");
+        if (keyFile.has_key ("General", "Format")) {
+            format      = (ThFileType)keyFile.get_integer ("General", "Format");
+        }
 
-            if (timeValid) {
-                if (keyFile.has_key ("DateTime", "Year")) {
-                    year    = keyFile.get_integer ("DateTime", "Year");
-                }
+        if (keyFile.has_key ("General", "Rank")) {
+            rankOld     = keyFile.get_integer ("General", "Rank");
+        }
 
-                if (keyFile.has_key ("DateTime", "Month")) {
-                    month   = keyFile.get_integer ("DateTime", "Month");
-                }
+        if (keyFile.has_key ("General", "Rating")) {
+            rating     = keyFile.get_integer ("General", "Rating");
+        }
 
-                if (keyFile.has_key ("DateTime", "Day")) {
-                    day     = keyFile.get_integer ("DateTime", "Day");
-                }
+        if (keyFile.has_key ("General", "InTrash")) {
+            inTrashOld  = keyFile.get_boolean ("General", "InTrash");
+        }
 
-                if (keyFile.has_key ("DateTime", "Hour")) {
-                    hour    = keyFile.get_integer ("DateTime", "Hour");
-                }
+        if (keyFile.has_key ("General", "RecentlySaved")) {
+            recentlySaved = keyFile.get_boolean ("General", "RecentlySaved");
+        }
+    }
 
-                if (keyFile.has_key ("DateTime", "Min")) {
-                    min     = keyFile.get_integer ("DateTime", "Min");
-                }
+    timeValid = keyFile.has_group ("DateTime");
 
-                if (keyFile.has_key ("DateTime", "Sec")) {
-                    sec     = keyFile.get_integer ("DateTime", "Sec");
-                }
-            }
+    if (timeValid) {
+        if (keyFile.has_key ("DateTime", "Year")) {
+            year    = keyFile.get_integer ("DateTime", "Year");
+        }
 
-            exifValid = false;
+        if (keyFile.has_key ("DateTime", "Month")) {
+            month   = keyFile.get_integer ("DateTime", "Month");
+        }
 
-            if (keyFile.has_group ("ExifInfo")) {
-                exifValid = true;
+        if (keyFile.has_key ("DateTime", "Day")) {
+            day     = keyFile.get_integer ("DateTime", "Day");
+        }
 
-                if (keyFile.has_key ("ExifInfo", "Valid")) {
-                    exifValid = keyFile.get_boolean ("ExifInfo", "Valid");
-                }
+        if (keyFile.has_key ("DateTime", "Hour")) {
+            hour    = keyFile.get_integer ("DateTime", "Hour");
+        }
 
-                if (exifValid) {
-                    if (keyFile.has_key ("ExifInfo", "FNumber")) {
-                        fnumber     = keyFile.get_double ("ExifInfo", "FNumber");
-                    }
+        if (keyFile.has_key ("DateTime", "Min")) {
+            min     = keyFile.get_integer ("DateTime", "Min");
+        }
 
-                    if (keyFile.has_key ("ExifInfo", "Shutter")) {
-                        shutter     = keyFile.get_double ("ExifInfo", "Shutter");
-                    }
+        if (keyFile.has_key ("DateTime", "Sec")) {
+            sec     = keyFile.get_integer ("DateTime", "Sec");
+        }
+    }
 
-                    if (keyFile.has_key ("ExifInfo", "FocalLen")) {
-                        focalLen    = keyFile.get_double ("ExifInfo", "FocalLen");
-                    }
+    exifValid = false;
 
-                    if (keyFile.has_key ("ExifInfo", "FocalLen35mm")) {
-                        focalLen35mm = keyFile.get_double ("ExifInfo", "FocalLen35mm");
-                    } else {
-                        focalLen35mm = focalLen;    // prevent crashes on old files
-                    }
+    if (keyFile.has_group ("ExifInfo")) {
+        exifValid = true;
 
-                    if (keyFile.has_key ("ExifInfo", "FocusDist")) {
-                        focusDist = keyFile.get_double ("ExifInfo", "FocusDist");
-                    } else {
-                        focusDist = 0;
-                    }
+        if (keyFile.has_key ("ExifInfo", "Valid")) {
+            exifValid = keyFile.get_boolean ("ExifInfo", "Valid");
+        }
 
-                    if (keyFile.has_key ("ExifInfo", "ISO")) {
-                        iso         = keyFile.get_integer ("ExifInfo", "ISO");
-                    }
+        if (exifValid) {
+            if (keyFile.has_key ("ExifInfo", "FNumber")) {
+                fnumber     = keyFile.get_double ("ExifInfo", "FNumber");
+            }
 
-                    if (keyFile.has_key ("ExifInfo", "IsHDR")) {
-                        isHDR = keyFile.get_boolean ("ExifInfo", "IsHDR");
-                    }
+            if (keyFile.has_key ("ExifInfo", "Shutter")) {
+                shutter     = keyFile.get_double ("ExifInfo", "Shutter");
+            }
 
-                    if (keyFile.has_key ("ExifInfo", "IsPixelShift")) {
-                        isPixelShift = keyFile.get_boolean ("ExifInfo", "IsPixelShift");
-                    }
+            if (keyFile.has_key ("ExifInfo", "FocalLen")) {
+                focalLen    = keyFile.get_double ("ExifInfo", "FocalLen");
+            }
 
-                    if (keyFile.has_key ("ExifInfo", "ExpComp")) {
-                        expcomp     = keyFile.get_string ("ExifInfo", "ExpComp");
-                    }
-                }
+            if (keyFile.has_key ("ExifInfo", "FocalLen35mm")) {
+                focalLen35mm = keyFile.get_double ("ExifInfo", "FocalLen35mm");
+            } else {
+                focalLen35mm = focalLen;    // prevent crashes on old files
+            }
 
-                if (keyFile.has_key ("ExifInfo", "Lens")) {
-                    lens        = keyFile.get_string ("ExifInfo", "Lens");
-                }
+            if (keyFile.has_key ("ExifInfo", "FocusDist")) {
+                focusDist = keyFile.get_double ("ExifInfo", "FocusDist");
+            } else {
+                focusDist = 0;
+            }
 
-                if (keyFile.has_key ("ExifInfo", "CameraMake")) {
-                    camMake     = keyFile.get_string ("ExifInfo", "CameraMake");
-                }
+            if (keyFile.has_key ("ExifInfo", "ISO")) {
+                iso         = keyFile.get_integer ("ExifInfo", "ISO");
+            }
 
-                if (keyFile.has_key ("ExifInfo", "CameraModel")) {
-                    camModel    = keyFile.get_string ("ExifInfo", "CameraModel");
-                }
+            if (keyFile.has_key ("ExifInfo", "IsHDR")) {
+                isHDR = keyFile.get_boolean ("ExifInfo", "IsHDR");
             }
 
-            if (keyFile.has_group ("FileInfo")) {
-                if (keyFile.has_key ("FileInfo", "Filetype")) {
-                    filetype    = keyFile.get_string ("FileInfo", "Filetype");
-                }
-                if (keyFile.has_key ("FileInfo", "FrameCount")) {
-                    frameCount  = static_cast<unsigned int>(keyFile.get_integer ("FileInfo", "FrameCount"));
-                }
-                if (keyFile.has_key ("FileInfo", "SampleFormat")) {
-                    sampleFormat = (rtengine::IIO_Sample_Format)keyFile.get_integer ("FileInfo", "SampleFormat");
-                }
+            if (keyFile.has_key ("ExifInfo", "IsPixelShift")) {
+                isPixelShift = keyFile.get_boolean ("ExifInfo", "IsPixelShift");
             }
 
-            if (format == FT_Raw && keyFile.has_group ("ExtraRawInfo")) {
-                if (keyFile.has_key ("ExtraRawInfo", "ThumbImageType")) {
-                    thumbImgType    = keyFile.get_integer ("ExtraRawInfo", "ThumbImageType");
-                }
-                if (keyFile.has_key ("ExtraRawInfo", "SensorType")) {
-                    sensortype  = keyFile.get_integer ("ExtraRawInfo", "SensorType");
-                }
-            } else {
-                rotate = 0;
-                thumbImgType = 0;
+            if (keyFile.has_key ("ExifInfo", "ExpComp")) {
+                expcomp     = keyFile.get_string ("ExifInfo", "ExpComp");
             }
+        }
 
-            return 0;
+        if (keyFile.has_key ("ExifInfo", "Lens")) {
+            lens        = keyFile.get_string ("ExifInfo", "Lens");
         }
-    } catch (Glib::Error &err) {
-        if (rtengine::settings->verbose) {
-            printf("CacheImageData::load / Error code %d while reading values from \"%s\":\n%s\n", err.code(), fname.c_str(), err.what().c_str());
+
+        if (keyFile.has_key ("ExifInfo", "CameraMake")) {
+            camMake     = keyFile.get_string ("ExifInfo", "CameraMake");
         }
-    } catch (...) {
-        if (rtengine::settings->verbose) {
-            printf("CacheImageData::load / Unknown exception while trying to load \"%s\"!\n", fname.c_str());
+
+        if (keyFile.has_key ("ExifInfo", "CameraModel")) {
+            camModel    = keyFile.get_string ("ExifInfo", "CameraModel");
         }
     }
 
-    return 1;
+    if (keyFile.has_group ("FileInfo")) {
+        if (keyFile.has_key ("FileInfo", "Filetype")) {
+            filetype    = keyFile.get_string ("FileInfo", "Filetype");
+        }
+        if (keyFile.has_key ("FileInfo", "FrameCount")) {
+            frameCount  = static_cast<unsigned int>(keyFile.get_integer ("FileInfo", "FrameCount"));
+        }
+        if (keyFile.has_key ("FileInfo", "SampleFormat")) {
+            sampleFormat = (rtengine::IIO_Sample_Format)keyFile.get_integer ("FileInfo", "SampleFormat");
+        }
+    }
+
+    if (format == FT_Raw && keyFile.has_group ("ExtraRawInfo")) {
+        if (keyFile.has_key ("ExtraRawInfo", "ThumbImageType")) {
+            thumbImgType    = keyFile.get_integer ("ExtraRawInfo", "ThumbImageType");
+        }
+        if (keyFile.has_key ("ExtraRawInfo", "SensorType")) {
+            sensortype  = keyFile.get_integer ("ExtraRawInfo", "SensorType");
+        }
+    } else {
+        rotate = 0;
+        thumbImgType = 0;
+    }
 }
 
 /*
- * Save the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data file
+ * Set the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data
  */
-int CacheImageData::save (const Glib::ustring& fname)
+void CacheImageData::writeKeyFile (Glib::KeyFile& keyFile) const
 {
-
-    Glib::ustring keyData;
-
-    try {
-
-    Glib::KeyFile keyFile;
-
-    try {
-        keyFile.load_from_file (fname);
-    } catch (Glib::Error&) {}
-
     keyFile.set_string  ("General", "MD5", md5);
     keyFile.set_string  ("General", "Version", RTVERSION);
     keyFile.set_boolean ("General", "Supported", supported);
@@ -303,6 +277,85 @@ int CacheImageData::save (const Glib::ustring& fname)
         keyFile.set_integer ("ExtraRawInfo", "ThumbImageType", thumbImgType);
         keyFile.set_integer ("ExtraRawInfo", "SensorType", sensortype);
     }
+}
+
+/*
+ * Load the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data file
+ */
+int CacheImageData::load (const Glib::ustring& fname)
+{
+    setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
+
+    Glib::KeyFile keyFile;
+
+    try {
+        if (keyFile.load_from_file (fname)) {
+            readKeyFile (keyFile);
+            return 0;
+        }
+    } catch (Glib::Error &err) {
+        if (rtengine::settings->verbose) {
+            printf("CacheImageData::load / Error code %d while reading values from \"%s\":\n%s\n", err.code(), fname.c_str(), err.what().c_str());
+        }
+    } catch (...) {
+        if (rtengine::settings->verbose) {
+            printf("CacheImageData::load / Unknown exception while trying to load \"%s\"!\n", fname.c_str());
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Load the General, DateTime, ExifInfo, File info and ExtraRawInfo sections from the single file cache store
+ */
+int CacheImageData::load (rtengine::PackedCache& cache, const std::string& md5)
+{
+    setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
+
+    std::vector<char> buffer;
+
+    if (!cache.get (md5, rtengine::PackedCache::Record::DATA, buffer)) {
+        return 1;
+    }
+
+    Glib::KeyFile keyFile;
+
+    try {
+        if (keyFile.load_from_data (std::string (buffer.begin (), buffer.end ()))) {
+            readKeyFile (keyFile);
+            return 0;
+        }
+    } catch (Glib::Error &err) {
+        if (rtengine::settings->verbose) {
+            printf("CacheImageData::load / Error code %d while reading values of cache entry %s:\n%s\n", err.code(), md5.c_str(), err.what().c_str());
+        }
+    } catch (...) {
+        if (rtengine::settings->verbose) {
+            printf("CacheImageData::load / Unknown exception while trying to load cache entry %s!\n", md5.c_str());
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Save the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data file
+ */
+int CacheImageData::save (const Glib::ustring& fname)
+{
+
+    Glib::ustring keyData;
+
+    try {
+
+    Glib::KeyFile keyFile;
+
+    try {
+        keyFile.load_from_file (fname);
+    } catch (Glib::Error&) {}
+
+    writeKeyFile (keyFile);
 
     keyData = keyFile.to_data ();
 
@@ -335,6 +388,145 @@ int CacheImageData::save (const Glib::ustring& fname)
     }
 }
 
+/*
+ * Save the General, DateTime, ExifInfo, File info and ExtraRawInfo sections to the single file cache store
+ */
+int CacheImageData::save (rtengine::PackedCache& cache, const std::string& md5)
+{
+
+    Glib::ustring keyData;
+
+    try {
+        Glib::KeyFile keyFile;
+        std::vector<char> buffer;
+
+        // the data record is shared with rtengine::Thumbnail, keep its groups
+        if (cache.get (md5, rtengine::PackedCache::Record::DATA, buffer)) {
+            try {
+                keyFile.load_from_data (std::string (buffer.begin (), buffer.end ()));
+            } catch (Glib::Error&) {}
+        }
+
+        writeKeyFile (keyFile);
+
+        keyData = keyFile.to_data ();
+    } catch (Glib::Error &err) {
+        if (rtengine::settings->verbose) {
+            printf("CacheImageData::save / Error code %d while reading values of cache entry %s:\n%s\n", err.code(), md5.c_str(), err.what().c_str());
+        }
+    } catch (...) {
+        if (rtengine::settings->verbose) {
+            printf("CacheImageData::save / Unknown exception while trying to save cache entry %s!\n", md5.c_str());
+        }
+    }
+
+    if (keyData.empty () || !cache.put (md5, rtengine::PackedCache::Record::DATA, keyData.data (), keyData.bytes ())) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int CacheImageData::readMetaData (const Glib::ustring& fname, std::unique_ptr<rtengine::RawMetaDataLocation> rml)
+{
+    rtengine::FramesMetaData* idata = rtengine::FramesMetaData::summaryFromFile (fname, std::move(rml));
+
+    if (!idata) {
+        return 0;
+    }
+
+    int deg = 0;
+    timeValid = false;
+    exifValid = false;
+
+    if (idata->hasExif()) {
+        shutter      = idata->getShutterSpeed ();
+        fnumber      = idata->getFNumber ();
+        focalLen     = idata->getFocalLen ();
+        focalLen35mm = idata->getFocalLen35mm ();
+        focusDist    = idata->getFocusDist ();
+        iso          = idata->getISOSpeed ();
+        expcomp      = idata->expcompToString (idata->getExpComp(), false); // do not mask Zero expcomp
+        isHDR        = idata->getHDR ();
+        isPixelShift = idata->getPixelShift ();
+        frameCount   = idata->getFrameCount ();
+        sampleFormat = idata->getSampleFormat ();
+        year         = 1900 + idata->getDateTime().tm_year;
+        month        = idata->getDateTime().tm_mon + 1;
+        day          = idata->getDateTime().tm_mday;
+        hour         = idata->getDateTime().tm_hour;
+        min          = idata->getDateTime().tm_min;
+        sec          = idata->getDateTime().tm_sec;
+        timeValid    = true;
+        exifValid    = true;
+        lens         = idata->getLens();
+        camMake      = idata->getMake();
+        camModel     = idata->getModel();
+        rating       = idata->getRating();
+
+        if (idata->getOrientation() == "Rotate 90 CW") {
+            deg = 90;
+        } else if (idata->getOrientation() == "Rotate 180") {
+            deg = 180;
+        } else if (idata->getOrientation() == "Rotate 270 CW") {
+            deg = 270;
+        }
+    } else {
+        lens     = "Unknown";
+        camMake  = "Unknown";
+        camModel = "Unknown";
+    }
+
+    // get image filetype
+    std::string::size_type idx;
+    idx = fname.rfind('.');
+
+    if(idx != std::string::npos) {
+        filetype = fname.substr(idx + 1);
+    } else {
+        filetype = "";
+    }
+
+    delete idata;
+    return deg;
+}
+
+std::string CacheImageData::computeMD5 (const Glib::ustring& fname)
+{
+
+#ifdef WIN32
+
+    std::unique_ptr<wchar_t, GFreeFunc> wfname(reinterpret_cast<wchar_t*>(g_utf8_to_utf16 (fname.c_str (), -1, NULL, NULL, NULL)), g_free);
+
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr;
+    if (GetFileAttributesExW(wfname.get(), GetFileExInfoStandard, &fileAttr)) {
+        // We use name, size and creation time to identify a file.
+        const auto identifier = Glib::ustring::compose("%1-%2-%3-%4", fileAttr.nFileSizeLow, fileAttr.ftCreationTime.dwHighDateTime, fileAttr.ftCreationTime.dwLowDateTime, fname);
+        return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, identifier);
+    }
+
+#else
+
+    const auto file = Gio::File::create_for_path(fname);
+    if (file) {
+
+        try
+        {
+            const auto info = file->query_info("standard::*");
+            if (info) {
+                // We only use name and size to identify a file.
+                const auto identifier = Glib::ustring::compose("%1%2", fname, info->get_size());
+                return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, identifier);
+            }
+
+        } catch(Gio::Error&) {}
+    }
+
+#endif
+
+    return {};
+}
+
 rtengine::procparams::IPTCPairs CacheImageData::getIPTCData(unsigned int frame) const
 {
     return {};
@@ -18,6 +18,9 @@
  */
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include <glibmm/ustring.h>
 
 #include "options.h"
@@ -25,6 +28,20 @@
 #include "../rtengine/imageformat.h"
 #include "../rtengine/rtengine.h"
 
+namespace Glib
+{
+
+class KeyFile;
+
+}
+
+namespace rtengine
+{
+
+class PackedCache;
+
+}
+
 class CacheImageData :
     public rtengine::FramesMetaData
 {
@@ -85,6 +102,15 @@ public:
     int load (const Glib::ustring& fname);
     int save (const Glib::ustring& fname);
 
+    int load (rtengine::PackedCache& cache, const std::string& md5);
+    int save (rtengine::PackedCache& cache, const std::string& md5);
+
+    // Fill the date/time, exif and file type fields from the image's metadata, returns the rotation in degrees
+    int readMetaData (const Glib::ustring& fname, std::unique_ptr<rtengine::RawMetaDataLocation> rml = nullptr);
+
+    // The cache key of fname
+    static std::string computeMD5 (const Glib::ustring& fname);
+
     //-------------------------------------------------------------------------
     // FramesMetaData interface
     //-------------------------------------------------------------------------
@@ -115,4 +141,8 @@ public:
     bool getHDR (unsigned int frame = 0) const override { return isHDR; }
     std::string getImageType (unsigned int frame) const override { return isPixelShift ? "PS" : isHDR ? "HDR" : "STD"; }
     rtengine::IIOSampleFormat getSampleFormat (unsigned int frame = 0) const override { return sampleFormat; }
+
+private:
+    void readKeyFile (Glib::KeyFile& keyFile);
+    void writeKeyFile (Glib::KeyFile& keyFile) const;
 };
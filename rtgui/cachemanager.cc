@@ -30,19 +30,26 @@
 
 #include "cachemanager.h"
 
+#include "dirindex.h"
 #include "guiutils.h"
 #include "options.h"
 #include "thumbnail.h"
 #include "procparamchangers.h"
 
+#include "../rtengine/packedcache.h"
+
 namespace
 {
 
 constexpr int cacheDirMode = 0777;
-constexpr const char* cacheDirs[] = { "profiles", "images", "aehistograms", "embprofiles", "data" };
+constexpr const char* cacheDirs[] = { "profiles", "images", "aehistograms", "embprofiles", "data", "dirindex", "masterframes", "cafits" };
 
 }
 
+CacheManager::CacheManager () = default;
+
+CacheManager::~CacheManager () = default;
+
 CacheManager* CacheManager::getInstance ()
 {
     static CacheManager instance;
@@ -67,9 +74,20 @@ void CacheManager::init ()
     if (error != 0 && rtengine::settings->verbose) {
         std::cerr << "Failed to create all cache directories: " << g_strerror(errno) << std::endl;
     }
+
+    packedCache.reset ();
+
+    if (options.packedCache) {
+        packedCache.reset (new rtengine::PackedCache (Glib::build_filename (baseDir, "thumbcache"), std::uint64_t (options.maxPackedCacheSize) << 20));
+
+        if (!packedCache->isOpen ()) {
+            // in use by another process or not accessible, fall back to the folder based cache
+            packedCache.reset ();
+        }
+    }
 }
 
-Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
+Thumbnail* CacheManager::getEntry (const Glib::ustring& fname, const CacheImageData* indexed)
 {
     std::unique_ptr<Thumbnail> thumbnail;
 
@@ -90,20 +108,28 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
         }
     }
 
+    // the directory index already knows the cache key and data of unchanged files
+    if (indexed && indexed->supported && !indexed->md5.empty ()) {
+        CacheImageData imageData (*indexed);
+
+        thumbnail.reset (new Thumbnail (this, fname, &imageData));
+        if (!thumbnail->isSupported ()) {
+            thumbnail.reset ();
+        }
+    }
+
     // build path name
-    const auto md5 = getMD5 (fname);
+    const auto md5 = thumbnail ? std::string () : getMD5 (fname);
 
-    if (md5.empty ()) {
+    if (!thumbnail && md5.empty ()) {
         return nullptr;
     }
 
-    const auto cacheName = getCacheFileName ("data", fname, ".txt", md5);
-
     // let's see if we have it in the cache
-    {
+    if (!thumbnail) {
         CacheImageData imageData;
 
-        const auto error = imageData.load (cacheName);
+        const auto error = packedCache ? imageData.load (*packedCache, md5) : imageData.load (getCacheFileName ("data", fname, ".txt", md5));
         if (error == 0 && imageData.supported) {
 
             thumbnail.reset (new Thumbnail (this, fname, &imageData));
@@ -140,6 +166,10 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
         openEntries.emplace (fname, thumbnail.get ());
     }
 
+    if (thumbnail) {
+        updateDirIndex (fname, *thumbnail->getCacheImageData ());
+    }
+
     return thumbnail.release ();
 }
 
@@ -186,10 +216,15 @@ void CacheManager::renameEntry (const std::string& oldfilename, const std::strin
     const auto newmd5 = getMD5 (newfilename);
 
     auto error = g_rename (getCacheFileName ("profiles", oldfilename, paramFileExtension, oldmd5).c_str (), getCacheFileName ("profiles", newfilename, paramFileExtension, newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("images", oldfilename, ".rtti", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".rtti", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("aehistograms", oldfilename, "", oldmd5).c_str (), getCacheFileName ("aehistograms", newfilename, "", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("embprofiles", oldfilename, ".icc", oldmd5).c_str (), getCacheFileName ("embprofiles", newfilename, ".icc", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("data", oldfilename, ".txt", oldmd5).c_str (), getCacheFileName ("data", newfilename, ".txt", newmd5).c_str ());
+
+    if (packedCache) {
+        packedCache->rename (oldmd5, newmd5);
+    } else {
+        error |= g_rename (getCacheFileName ("images", oldfilename, ".rtti", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".rtti", newmd5).c_str ());
+        error |= g_rename (getCacheFileName ("aehistograms", oldfilename, "", oldmd5).c_str (), getCacheFileName ("aehistograms", newfilename, "", newmd5).c_str ());
+        error |= g_rename (getCacheFileName ("embprofiles", oldfilename, ".icc", oldmd5).c_str (), getCacheFileName ("embprofiles", newfilename, ".icc", newmd5).c_str ());
+        error |= g_rename (getCacheFileName ("data", oldfilename, ".txt", oldmd5).c_str (), getCacheFileName ("data", newfilename, ".txt", newmd5).c_str ());
+    }
 
     if (error != 0 && rtengine::settings->verbose) {
         std::cerr << "Failed to rename all files for cache entry '" << oldfilename << "': " << g_strerror(errno) << std::endl;
@@ -233,6 +268,10 @@ void CacheManager::clearAll () const
     for (const auto& cacheDir : cacheDirs) {
         deleteDir (cacheDir);
     }
+
+    if (packedCache) {
+        packedCache->clear ();
+    }
 }
 
 void CacheManager::clearImages () const
@@ -243,6 +282,11 @@ void CacheManager::clearImages () const
     deleteDir ("images");
     deleteDir ("aehistograms");
     deleteDir ("embprofiles");
+    deleteDir ("dirindex");
+
+    if (packedCache) {
+        packedCache->clear ();
+    }
 }
 
 void CacheManager::clearProfiles () const
@@ -276,6 +320,22 @@ void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& m
         return;
     }
 
+    if (packedCache) {
+        packedCache->remove (md5, rtengine::PackedCache::Record::IMAGE);
+        packedCache->remove (md5, rtengine::PackedCache::Record::AE_HISTOGRAM);
+        packedCache->remove (md5, rtengine::PackedCache::Record::EMB_PROFILE);
+
+        if (purgeData) {
+            packedCache->remove (md5, rtengine::PackedCache::Record::DATA);
+        }
+
+        if (purgeProfile && g_remove (getCacheFileName ("profiles", fname, paramFileExtension, md5).c_str ()) != 0 && rtengine::settings->verbose) {
+            std::cerr << "Failed to delete all files for cache entry '" << fname << "': " << g_strerror(errno) << std::endl;
+        }
+
+        return;
+    }
+
     auto error = g_remove (getCacheFileName ("images", fname, ".rtti", md5).c_str ());
     error |= g_remove (getCacheFileName ("aehistograms", fname, "", md5).c_str ());
     error |= g_remove (getCacheFileName ("embprofiles", fname, ".icc", md5).c_str ());
@@ -295,52 +355,68 @@ void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& m
 
 std::string CacheManager::getMD5 (const Glib::ustring& fname)
 {
+    return CacheImageData::computeMD5 (fname);
+}
 
-#ifdef WIN32
+Glib::ustring CacheManager::getCacheFileName (const Glib::ustring& subDir,
+                                              const Glib::ustring& fname,
+                                              const Glib::ustring& fext,
+                                              const Glib::ustring& md5) const
+{
+    const auto dirName = Glib::build_filename (baseDir, subDir);
+    const auto baseName = Glib::path_get_basename (fname) + "." + md5;
+    return Glib::build_filename (dirName, baseName + fext);
+}
+
+std::shared_ptr<DirIndex> CacheManager::openDirIndex (const Glib::ustring& dirName)
+{
+    MyMutex::MyLock lock (dirIndexMutex);
 
-    std::unique_ptr<wchar_t, GFreeFunc> wfname(reinterpret_cast<wchar_t*>(g_utf8_to_utf16 (fname.c_str (), -1, NULL, NULL, NULL)), g_free);
+    std::shared_ptr<DirIndex> dirIndex = dirIndexes[dirName].lock ();
 
-    WIN32_FILE_ATTRIBUTE_DATA fileAttr;
-    if (GetFileAttributesExW(wfname.get(), GetFileExInfoStandard, &fileAttr)) {
-        // We use name, size and creation time to identify a file.
-        const auto identifier = Glib::ustring::compose("%1-%2-%3-%4", fileAttr.nFileSizeLow, fileAttr.ftCreationTime.dwHighDateTime, fileAttr.ftCreationTime.dwLowDateTime, fname);
-        return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, identifier);
+    if (!dirIndex) {
+        const auto indexName = Glib::Checksum::compute_checksum (Glib::Checksum::CHECKSUM_MD5, dirName) + ".idx";
+        dirIndex = std::make_shared<DirIndex> (dirName, Glib::build_filename (baseDir, "dirindex", indexName));
+        dirIndexes[dirName] = dirIndex;
     }
 
-#else
+    return dirIndex;
+}
 
-    const auto file = Gio::File::create_for_path(fname);
-    if (file) {
+void CacheManager::updateDirIndex (const Glib::ustring& fname, const CacheImageData& imageData)
+{
+    std::shared_ptr<DirIndex> dirIndex;
 
-        try
-        {
-            const auto info = file->query_info("standard::*");
-            if (info) {
-                // We only use name and size to identify a file.
-                const auto identifier = Glib::ustring::compose("%1%2", fname, info->get_size());
-                return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, identifier);
-            }
+    {
+        MyMutex::MyLock lock (dirIndexMutex);
 
-        } catch(Gio::Error&) {}
-    }
+        const auto iterator = dirIndexes.find (Glib::path_get_dirname (fname));
+        if (iterator == dirIndexes.end ()) {
+            return;
+        }
 
-#endif
+        dirIndex = iterator->second.lock ();
+        if (!dirIndex) {
+            dirIndexes.erase (iterator);
+            return;
+        }
+    }
 
-    return {};
+    dirIndex->update (fname, imageData);
 }
 
-Glib::ustring CacheManager::getCacheFileName (const Glib::ustring& subDir,
-                                              const Glib::ustring& fname,
-                                              const Glib::ustring& fext,
-                                              const Glib::ustring& md5) const
+rtengine::PackedCache* CacheManager::getPackedCache () const
 {
-    const auto dirName = Glib::build_filename (baseDir, subDir);
-    const auto baseName = Glib::path_get_basename (fname) + "." + md5;
-    return Glib::build_filename (dirName, baseName + fext);
+    return packedCache.get ();
 }
 
 void CacheManager::applyCacheSizeLimitation () const
 {
+    if (packedCache) {
+        packedCache->applySizeLimitation ();
+        return;
+    }
+
     // first count files without fetching file name and timestamp.
     auto cachedir = opendir(Glib::build_filename(baseDir, "data").c_str());
     if (!cachedir) {
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
 
 #include <glibmm/ustring.h>
@@ -27,6 +28,15 @@
 
 #include "../rtengine/noncopyable.h"
 
+namespace rtengine
+{
+
+class PackedCache;
+
+}
+
+class CacheImageData;
+class DirIndex;
 class Thumbnail;
 
 class CacheManager :
@@ -36,19 +46,27 @@ private:
     using Entries = std::map<std::string, Thumbnail*>;
     Entries openEntries;
     Glib::ustring    baseDir;
+    std::unique_ptr<rtengine::PackedCache> packedCache;
     mutable MyMutex  mutex;
 
+    std::map<Glib::ustring, std::weak_ptr<DirIndex>> dirIndexes;
+    MyMutex dirIndexMutex;
+
     void deleteDir   (const Glib::ustring& dirName) const;
     void deleteFiles (const Glib::ustring& fname, const std::string& md5, bool purgeData, bool purgeProfile) const;
 
     void applyCacheSizeLimitation () const;
 
 public:
+    CacheManager ();
+    ~CacheManager ();
+
     static CacheManager* getInstance ();
 
     void        init        ();
 
-    Thumbnail*  getEntry    (const Glib::ustring& fname);
+    // indexed: image data from the directory index, saves hashing the file and loading its cache data
+    Thumbnail*  getEntry    (const Glib::ustring& fname, const CacheImageData* indexed = nullptr);
     void        deleteEntry (const Glib::ustring& fname);
     void        renameEntry (const std::string& oldfilename, const std::string& oldmd5, const std::string& newfilename);
 
@@ -66,6 +84,13 @@ public:
                                        const Glib::ustring& fname,
                                        const Glib::ustring& fext,
                                        const Glib::ustring& md5) const;
+
+    // Shared by everyone browsing dirName, stored in the dirindex folder
+    std::shared_ptr<DirIndex> openDirIndex (const Glib::ustring& dirName);
+    void updateDirIndex (const Glib::ustring& fname, const CacheImageData& imageData);
+
+    // Single file store used instead of the images, aehistograms, embprofiles and data folders, nullptr if disabled
+    rtengine::PackedCache* getPackedCache () const;
 };
 
 #define cacheMgr CacheManager::getInstance()
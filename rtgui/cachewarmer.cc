@@ -0,0 +1,278 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+
+#include <giomm.h>
+#include <glib/gstdio.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "cachewarmer.h"
+
+#include "cacheimagedata.h"
+#include "options.h"
+#include "pathutils.h"
+
+#include "../rtengine/packedcache.h"
+#include "../rtengine/procparams.h"
+#include "../rtengine/profilestore.h"
+#include "../rtengine/rtthumbnail.h"
+
+namespace
+{
+
+constexpr int cacheDirMode = 0777;
+
+}
+
+CacheWarmer::CacheWarmer(int threads, bool allExtensions) :
+    threads(threads),
+    allExtensions(allExtensions),
+    baseDir(options.cacheBaseDir),
+    packedCacheLocked(false)
+{
+    // same layout as CacheManager::init(), the aehistograms folder is created on demand
+    for (const auto& cacheDir : {"images", "embprofiles", "data"}) {
+        if (g_mkdir_with_parents(Glib::build_filename(baseDir, cacheDir).c_str(), cacheDirMode) != 0) {
+            std::cerr << "Failed to create cache directory \"" << Glib::build_filename(baseDir, cacheDir) << "\": " << g_strerror(errno) << std::endl;
+        }
+    }
+
+    if (options.packedCache) {
+        packedCache.reset(new rtengine::PackedCache(Glib::build_filename(baseDir, "thumbcache"), std::uint64_t(options.maxPackedCacheSize) << 20));
+
+        if (!packedCache->isOpen()) {
+            // filling the folder based cache instead would be of no use for the process holding the packed cache
+            packedCacheLocked = packedCache->isLockedElsewhere();
+            packedCache.reset();
+        }
+    }
+}
+
+CacheWarmer::~CacheWarmer() = default;
+
+unsigned int CacheWarmer::run(const std::vector<Glib::ustring>& inputs)
+{
+    std::vector<Glib::ustring> files;
+
+    for (const auto& input : inputs) {
+        // the cache key depends on the full path, so it has to be spelled like the file browser does
+        collect(Gio::File::create_for_path(input)->get_parse_name(), files);
+    }
+
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+
+    if (packedCacheLocked) {
+        std::cerr << "Error: the cache \"" << Glib::build_filename(baseDir, "thumbcache") << "\" is in use by another process, " << files.size() << " files not cached." << std::endl;
+        return files.size();
+    }
+
+    // the thumbnails are generated with the white balance equalizer of the default profiles, as in Thumbnail::_generateThumbnailImage
+    const double rawWBEqual = ProfileStore::getInstance()->getDefaultProcParams(true)->wb.equal;
+    const double imgWBEqual = ProfileStore::getInstance()->getDefaultProcParams(false)->wb.equal;
+
+#ifdef _OPENMP
+    const int numThreads = threads > 0 ? threads : omp_get_max_threads();
+#endif
+
+    std::cout << "Caching " << files.size() << " files into \"" << baseDir << "\"." << std::endl;
+
+    const int count = files.size();
+    int done = 0;
+    unsigned int cached = 0;
+    unsigned int upToDate = 0;
+    unsigned int errors = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+#endif
+
+    for (int i = 0; i < count; ++i) {
+        const Result result = generate(files[i], rawWBEqual, imgWBEqual);
+
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        {
+            ++done;
+
+            switch (result) {
+                case Result::CACHED: {
+                    ++cached;
+                    std::cout << "[" << done << "/" << count << "] Cached: " << files[i] << std::endl;
+                    break;
+                }
+
+                case Result::UP_TO_DATE: {
+                    ++upToDate;
+                    std::cout << "[" << done << "/" << count << "] Up to date: " << files[i] << std::endl;
+                    break;
+                }
+
+                case Result::FAILED: {
+                    ++errors;
+                    std::cerr << "[" << done << "/" << count << "] Error caching: " << files[i] << std::endl;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (packedCache) {
+        packedCache->flush();
+    }
+
+    std::cout << cached << " files cached, " << upToDate << " already up to date, " << errors << " failed." << std::endl;
+
+    return errors;
+}
+
+void CacheWarmer::collect(const Glib::ustring& path, std::vector<Glib::ustring>& files) const
+{
+    if (Glib::file_test(path, Glib::FILE_TEST_IS_REGULAR)) {
+        if (allExtensions ? options.is_parse_extention(path) : options.has_retained_extention(path)) {
+            files.push_back(path);
+        }
+
+        return;
+    }
+
+    try {
+        const auto dir = Gio::File::create_for_path(path);
+        const auto enumerator = dir->enumerate_children("standard::name,standard::type,standard::is-hidden");
+
+        while (const auto file = enumerator->next_file()) {
+            if (!options.fbShowHidden && file->is_hidden()) {
+                continue;
+            }
+
+            const auto fileName = Glib::build_filename(path, file->get_name());
+
+            if (file->get_file_type() == Gio::FILE_TYPE_DIRECTORY) {
+                collect(fileName, files);
+            } else if (allExtensions ? options.is_parse_extention(fileName) : options.has_retained_extention(fileName)) {
+                files.push_back(fileName);
+            }
+        }
+    } catch (Glib::Exception& exception) {
+        std::cerr << "Failed to list directory \"" << path << "\": " << exception.what() << std::endl;
+    }
+}
+
+CacheWarmer::Result CacheWarmer::generate(const Glib::ustring& fname, double rawWBEqual, double imgWBEqual)
+{
+    const std::string md5 = CacheImageData::computeMD5(fname);
+
+    if (md5.empty()) {
+        return Result::FAILED;
+    }
+
+    {
+        CacheImageData cached;
+        const int error = packedCache ? cached.load(*packedCache, md5) : cached.load(getCacheFileName("data", fname, ".txt", md5));
+
+        if (error == 0 && cached.supported) {
+            return Result::UP_TO_DATE;
+        }
+    }
+
+    CacheImageData cfs;
+    cfs.md5 = md5;
+
+    const Glib::ustring ext = getExtension(fname).lowercase();
+
+    if (ext.empty()) {
+        return Result::FAILED;
+    }
+
+    int tw = -1;
+    int th = options.maxThumbnailHeight;
+    std::unique_ptr<rtengine::Thumbnail> tpp;
+
+    if (ext == "jpg" || ext == "jpeg" || ext == "tif" || ext == "tiff") {
+        cfs.readMetaData(fname);
+        tpp.reset(rtengine::Thumbnail::loadFromImage(fname, tw, th, 1, imgWBEqual));
+        cfs.format = ext[0] == 'j' ? FT_Jpeg : FT_Tiff;
+    } else if (ext == "png") {
+        tpp.reset(rtengine::Thumbnail::loadFromImage(fname, tw, th, 1, imgWBEqual));
+        cfs.format = FT_Png;
+    } else {
+        // same choice as for a file which is shown for the first time
+        bool quick = false;
+        rtengine::RawMetaDataLocation ri;
+        rtengine::eSensorType sensorType = rtengine::ST_NONE;
+
+        if (options.internalThumbIfUntouched) {
+            quick = true;
+            tpp.reset(rtengine::Thumbnail::loadQuickFromRaw(fname, ri, sensorType, tw, th, 1, TRUE));
+        }
+
+        if (!tpp) {
+            quick = false;
+            tpp.reset(rtengine::Thumbnail::loadFromRaw(fname, ri, sensorType, tw, th, 1, rawWBEqual, TRUE));
+        }
+
+        cfs.sensortype = sensorType;
+        cfs.format = FT_Raw;
+        cfs.thumbImgType = quick ? CacheImageData::QUICK_THUMBNAIL : CacheImageData::FULL_THUMBNAIL;
+
+        if (tpp) {
+            cfs.readMetaData(fname, std::unique_ptr<rtengine::RawMetaDataLocation>(new rtengine::RawMetaDataLocation(ri)));
+        }
+    }
+
+    if (!tpp) {
+        return Result::FAILED;
+    }
+
+    cfs.supported = true;
+
+    if (packedCache) {
+        tpp->writeImage(*packedCache, md5);
+
+        if (!tpp->isAeValid()) {
+            tpp->writeAEHistogram(*packedCache, md5);
+        }
+
+        tpp->writeEmbProfile(*packedCache, md5);
+        tpp->writeData(*packedCache, md5);
+
+        return cfs.save(*packedCache, md5) == 0 ? Result::CACHED : Result::FAILED;
+    }
+
+    tpp->writeImage(getCacheFileName("images", fname, "", md5));
+
+    if (!tpp->isAeValid()) {
+        tpp->writeAEHistogram(getCacheFileName("aehistograms", fname, "", md5));
+    }
+
+    tpp->writeEmbProfile(getCacheFileName("embprofiles", fname, ".icc", md5));
+    tpp->writeData(getCacheFileName("data", fname, ".txt", md5));
+
+    return cfs.save(getCacheFileName("data", fname, ".txt", md5)) == 0 ? Result::CACHED : Result::FAILED;
+}
+
+Glib::ustring CacheWarmer::getCacheFileName(const Glib::ustring& subDir, const Glib::ustring& fname, const Glib::ustring& fext, const Glib::ustring& md5) const
+{
+    // must match CacheManager::getCacheFileName()
+    return Glib::build_filename(baseDir, subDir, Glib::path_get_basename(fname) + "." + md5 + fext);
+}
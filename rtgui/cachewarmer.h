@@ -0,0 +1,75 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+#include "../rtengine/noncopyable.h"
+
+namespace rtengine
+{
+
+class PackedCache;
+
+}
+
+/**
+ * @brief Headless generation of the file browser cache
+ *
+ * Writes the thumbnail image, AE histogram, embedded profile and image data of every input file
+ * to the cache exactly as the file browser would, so that browsing these folders later doesn't
+ * have to decode anything. Files are processed in parallel, one file per thread.
+ */
+class CacheWarmer :
+    public rtengine::NonCopyable
+{
+public:
+    /**
+     * @param threads number of files processed in parallel, 0 to use all cores
+     * @param allExtensions process all parsed extensions, not only the retained ones
+     */
+    CacheWarmer(int threads, bool allExtensions);
+    ~CacheWarmer();
+
+    /**
+     * @brief Cache the given files and the supported files of the given folders and their subfolders
+     *
+     * @return number of files which could not be cached, all of them if the packed cache is in use by another process
+     */
+    unsigned int run(const std::vector<Glib::ustring>& inputs);
+
+private:
+    enum class Result {
+        CACHED,
+        UP_TO_DATE,
+        FAILED
+    };
+
+    void collect(const Glib::ustring& path, std::vector<Glib::ustring>& files) const;
+    Result generate(const Glib::ustring& fname, double rawWBEqual, double imgWBEqual);
+
+    Glib::ustring getCacheFileName(const Glib::ustring& subDir, const Glib::ustring& fname, const Glib::ustring& fext, const Glib::ustring& md5) const;
+
+    const int threads;
+    const bool allExtensions;
+    const Glib::ustring baseDir;
+    std::unique_ptr<rtengine::PackedCache> packedCache;
+    bool packedCacheLocked;
+};
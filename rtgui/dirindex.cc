@@ -0,0 +1,360 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <glib.h>
+#include <glibmm/miscutils.h>
+
+#include "dirindex.h"
+
+#include "cacheimagedata.h"
+
+#include "../rtengine/settings.h"
+
+namespace
+{
+
+constexpr char indexMagic[8] = {'R', 'T', 'D', 'I', 'R', 'I', 'D', 'X'};
+constexpr std::uint32_t indexVersion = 1;
+
+class Writer
+{
+public:
+    template<typename T>
+    void put(T value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void putString(const Glib::ustring& value)
+    {
+        put<std::uint32_t>(value.bytes());
+        buffer.append(value.raw());
+    }
+
+    const std::string& data() const
+    {
+        return buffer;
+    }
+
+private:
+    std::string buffer;
+};
+
+class Reader
+{
+public:
+    Reader(const char* data, std::size_t size) :
+        pos(data),
+        end(data + size),
+        ok(true)
+    {
+    }
+
+    template<typename T>
+    T get()
+    {
+        T value = T();
+
+        if (ok && static_cast<std::size_t>(end - pos) >= sizeof(T)) {
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+        } else {
+            ok = false;
+        }
+
+        return value;
+    }
+
+    Glib::ustring getString()
+    {
+        const std::uint32_t length = get<std::uint32_t>();
+
+        if (!ok || static_cast<std::size_t>(end - pos) < length) {
+            ok = false;
+            return {};
+        }
+
+        const std::string value(pos, length);
+        pos += length;
+        return value;
+    }
+
+    bool good() const
+    {
+        return ok;
+    }
+
+private:
+    const char* pos;
+    const char* const end;
+    bool ok;
+};
+
+void writeImageData(Writer& writer, const CacheImageData& data)
+{
+    writer.putString(data.md5);
+    writer.putString(data.version);
+    writer.put<std::uint8_t>(data.supported);
+    writer.put<std::int32_t>(data.format);
+    writer.put<std::int8_t>(data.rankOld);
+    writer.put<std::uint8_t>(data.inTrashOld);
+    writer.put<std::uint8_t>(data.recentlySaved);
+
+    writer.put<std::uint8_t>(data.timeValid);
+    writer.put<std::int16_t>(data.year);
+    writer.put<std::int8_t>(data.month);
+    writer.put<std::int8_t>(data.day);
+    writer.put<std::int8_t>(data.hour);
+    writer.put<std::int8_t>(data.min);
+    writer.put<std::int8_t>(data.sec);
+
+    writer.put<std::uint8_t>(data.exifValid);
+    writer.put<std::uint16_t>(data.frameCount);
+    writer.put<double>(data.fnumber);
+    writer.put<double>(data.shutter);
+    writer.put<double>(data.focalLen);
+    writer.put<double>(data.focalLen35mm);
+    writer.put<float>(data.focusDist);
+    writer.put<std::uint32_t>(data.iso);
+    writer.put<std::int32_t>(data.rating);
+    writer.put<std::uint8_t>(data.isHDR);
+    writer.put<std::uint8_t>(data.isPixelShift);
+    writer.put<std::int32_t>(data.sensortype);
+    writer.put<std::int32_t>(data.sampleFormat);
+    writer.putString(data.lens);
+    writer.putString(data.camMake);
+    writer.putString(data.camModel);
+    writer.putString(data.filetype);
+    writer.putString(data.expcomp);
+
+    writer.put<std::int32_t>(data.rotate);
+    writer.put<std::int32_t>(data.thumbImgType);
+}
+
+void readImageData(Reader& reader, CacheImageData& data)
+{
+    data.md5 = reader.getString();
+    data.version = reader.getString();
+    data.supported = reader.get<std::uint8_t>();
+    data.format = static_cast<ThFileType>(reader.get<std::int32_t>());
+    data.rankOld = reader.get<std::int8_t>();
+    data.inTrashOld = reader.get<std::uint8_t>();
+    data.recentlySaved = reader.get<std::uint8_t>();
+
+    data.timeValid = reader.get<std::uint8_t>();
+    data.year = reader.get<std::int16_t>();
+    data.month = reader.get<std::int8_t>();
+    data.day = reader.get<std::int8_t>();
+    data.hour = reader.get<std::int8_t>();
+    data.min = reader.get<std::int8_t>();
+    data.sec = reader.get<std::int8_t>();
+
+    data.exifValid = reader.get<std::uint8_t>();
+    data.frameCount = reader.get<std::uint16_t>();
+    data.fnumber = reader.get<double>();
+    data.shutter = reader.get<double>();
+    data.focalLen = reader.get<double>();
+    data.focalLen35mm = reader.get<double>();
+    data.focusDist = reader.get<float>();
+    data.iso = reader.get<std::uint32_t>();
+    data.rating = reader.get<std::int32_t>();
+    data.isHDR = reader.get<std::uint8_t>();
+    data.isPixelShift = reader.get<std::uint8_t>();
+    data.sensortype = reader.get<std::int32_t>();
+    data.sampleFormat = static_cast<rtengine::IIO_Sample_Format>(reader.get<std::int32_t>());
+    data.lens = reader.getString();
+    data.camMake = reader.getString();
+    data.camModel = reader.getString();
+    data.filetype = reader.getString();
+    data.expcomp = reader.getString();
+
+    data.rotate = reader.get<std::int32_t>();
+    data.thumbImgType = reader.get<std::int32_t>();
+}
+
+bool operator ==(const DirIndex::FileInfo& lhs, const DirIndex::FileInfo& rhs)
+{
+    return lhs.size == rhs.size && lhs.mtime == rhs.mtime && lhs.inode == rhs.inode;
+}
+
+}
+
+DirIndex::DirIndex(const Glib::ustring& dirName, const Glib::ustring& indexFileName) :
+    dirName(dirName),
+    indexFileName(indexFileName),
+    dirty(false)
+{
+    load();
+}
+
+DirIndex::~DirIndex() = default;
+
+void DirIndex::scanned(const Glib::ustring& fname, const FileInfo& info)
+{
+    MyMutex::MyLock lock(mutex);
+
+    Entry& entry = entries[Glib::path_get_basename(fname)];
+
+    if (entry.data && !(entry.indexed == info)) {
+        // the file changed since it was indexed
+        entry.data.reset();
+        dirty = true;
+    }
+
+    entry.current = info;
+    entry.seen = true;
+}
+
+std::shared_ptr<const CacheImageData> DirIndex::lookup(const Glib::ustring& fname) const
+{
+    MyMutex::MyLock lock(mutex);
+
+    const auto entry = entries.find(Glib::path_get_basename(fname));
+
+    if (entry == entries.end() || !entry->second.seen || !(entry->second.indexed == entry->second.current)) {
+        return nullptr;
+    }
+
+    return entry->second.data;
+}
+
+void DirIndex::update(const Glib::ustring& fname, const CacheImageData& data)
+{
+    MyMutex::MyLock lock(mutex);
+
+    const auto entry = entries.find(Glib::path_get_basename(fname));
+
+    if (entry == entries.end() || !entry->second.seen) {
+        return;
+    }
+
+    entry->second.indexed = entry->second.current;
+    entry->second.data = std::make_shared<const CacheImageData>(data);
+    dirty = true;
+}
+
+bool DirIndex::save()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (!dirty) {
+        return true;
+    }
+
+    std::uint32_t count = 0;
+
+    for (const auto& entry : entries) {
+        if (entry.second.seen && entry.second.data) {
+            ++count;
+        }
+    }
+
+    Writer writer;
+
+    for (char c : indexMagic) {
+        writer.put<char>(c);
+    }
+
+    writer.put<std::uint32_t>(indexVersion);
+    writer.putString(dirName);
+    writer.put<std::uint32_t>(count);
+
+    for (const auto& entry : entries) {
+        if (entry.second.seen && entry.second.data) {
+            writer.putString(entry.first);
+            writer.put<std::uint64_t>(entry.second.indexed.size);
+            writer.put<std::int64_t>(entry.second.indexed.mtime);
+            writer.put<std::uint64_t>(entry.second.indexed.inode);
+            writeImageData(writer, *entry.second.data);
+        }
+    }
+
+    GError* error = nullptr;
+
+    if (!g_file_set_contents(indexFileName.c_str(), writer.data().data(), writer.data().size(), &error)) {
+        if (error) {
+            if (rtengine::settings->verbose) {
+                std::cerr << "Failed to write directory index \"" << indexFileName << "\": " << error->message << std::endl;
+            }
+
+            g_error_free(error);
+        }
+
+        return false;
+    }
+
+    dirty = false;
+    return true;
+}
+
+const Glib::ustring& DirIndex::getDirName() const
+{
+    return dirName;
+}
+
+bool DirIndex::load()
+{
+    gchar* contents = nullptr;
+    gsize length = 0;
+
+    if (!g_file_get_contents(indexFileName.c_str(), &contents, &length, nullptr)) {
+        return false;
+    }
+
+    Reader reader(contents, length);
+    bool valid = true;
+
+    for (char c : indexMagic) {
+        valid = valid && reader.get<char>() == c;
+    }
+
+    valid = valid && reader.get<std::uint32_t>() == indexVersion && reader.getString() == dirName;
+
+    const std::uint32_t count = valid ? reader.get<std::uint32_t>() : 0;
+
+    for (std::uint32_t i = 0; valid && i < count; ++i) {
+        const Glib::ustring name = reader.getString();
+
+        Entry entry;
+        entry.indexed.size = reader.get<std::uint64_t>();
+        entry.indexed.mtime = reader.get<std::int64_t>();
+        entry.indexed.inode = reader.get<std::uint64_t>();
+        entry.current = entry.indexed;
+        entry.seen = false;
+
+        const auto data = std::make_shared<CacheImageData>();
+        readImageData(reader, *data);
+        entry.data = data;
+
+        valid = reader.good();
+
+        if (valid) {
+            entries.emplace(name, entry);
+        }
+    }
+
+    g_free(contents);
+
+    if (!valid) {
+        entries.clear();
+    }
+
+    return valid;
+}
@@ -0,0 +1,91 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include <glibmm/ustring.h>
+
+#include "threadutils.h"
+
+#include "../rtengine/noncopyable.h"
+
+class CacheImageData;
+
+/**
+ * @brief Persistent index of the cache entries of one directory
+ *
+ * Maps the file name, size, modification time and inode of every image in the directory to its
+ * CacheImageData (which also holds the cache key), so that reopening the directory needs a single
+ * read of the index instead of hashing each file and loading its image data from the cache.
+ * Entries are only trusted if the file still matches what the directory scan reported.
+ */
+class DirIndex :
+    public rtengine::NonCopyable
+{
+public:
+    struct FileInfo {
+        std::uint64_t size;
+        std::int64_t mtime; // in microseconds
+        std::uint64_t inode; // 0 where not available
+    };
+
+    DirIndex(const Glib::ustring& dirName, const Glib::ustring& indexFileName);
+    ~DirIndex();
+
+    /**
+     * @brief Record the state of a file as seen by the directory scan
+     */
+    void scanned(const Glib::ustring& fname, const FileInfo& info);
+
+    /**
+     * @brief Get the indexed image data of a file
+     *
+     * @return nullptr if the file is not indexed or changed since it was indexed
+     */
+    std::shared_ptr<const CacheImageData> lookup(const Glib::ustring& fname) const;
+
+    /**
+     * @brief Store the image data of a scanned file
+     */
+    void update(const Glib::ustring& fname, const CacheImageData& data);
+
+    /**
+     * @brief Write the index, dropping files which were not seen by the last scan
+     */
+    bool save();
+
+    const Glib::ustring& getDirName() const;
+
+private:
+    struct Entry {
+        FileInfo indexed;
+        FileInfo current;
+        bool seen;
+        std::shared_ptr<const CacheImageData> data;
+    };
+
+    bool load();
+
+    const Glib::ustring dirName;
+    const Glib::ustring indexFileName;
+    std::map<Glib::ustring, Entry> entries; // by base name
+    bool dirty;
+    mutable MyMutex mutex;
+};
@@ -198,6 +198,8 @@ DirPyrDenoise::DirPyrDenoise () : FoldableToolPanel(this, "dirpyrdenoise", M("TP
     medmethod->append (M("TP_DIRPYRDENOISE_TYPE_5X5"));
     medmethod->append (M("TP_DIRPYRDENOISE_TYPE_7X7"));
     medmethod->append (M("TP_DIRPYRDENOISE_TYPE_9X9"));
+    medmethod->append (M("TP_DIRPYRDENOISE_TYPE_15X15"));
+    medmethod->append (M("TP_DIRPYRDENOISE_TYPE_21X21"));
     medmethod->set_active (0);
     medmethod->set_tooltip_text (M("TP_DIRPYRDENOISE_MEDIAN_TYPE_TOOLTIP"));
     medmethodconn = medmethod->signal_changed().connect ( sigc::mem_fun(*this, &DirPyrDenoise::medmethodChanged) );
@@ -509,6 +511,10 @@ void DirPyrDenoise::read (const ProcParams* pp, const ParamsEdited* pedited)
         medmethod->set_active (4);
     } else if (pp->dirpyrDenoise.medmethod == "99") {
         medmethod->set_active (5);
+    } else if (pp->dirpyrDenoise.medmethod == "1515") {
+        medmethod->set_active (6);
+    } else if (pp->dirpyrDenoise.medmethod == "2121") {
+        medmethod->set_active (7);
     }
 
     medmethodChanged();
@@ -542,7 +548,7 @@ void DirPyrDenoise::read (const ProcParams* pp, const ParamsEdited* pedited)
         }
 
         if (!pedited->dirpyrDenoise.medmethod) {
-            medmethod->set_active (6);
+            medmethod->set_active (8);
         }
 
         if (!pedited->dirpyrDenoise.methodmed) {
@@ -642,7 +648,7 @@ void DirPyrDenoise::write (ProcParams* pp, ParamsEdited* pedited)
         pedited->dirpyrDenoise.Cmethod  = Cmethod->get_active_row_number() != 4;
         pedited->dirpyrDenoise.C2method  = C2method->get_active_row_number() != 3;
         pedited->dirpyrDenoise.smethod  = smethod->get_active_row_number() != 2;
-        pedited->dirpyrDenoise.medmethod  = medmethod->get_active_row_number() != 6;
+        pedited->dirpyrDenoise.medmethod  = medmethod->get_active_row_number() != 8;
         pedited->dirpyrDenoise.rgbmethod  = rgbmethod->get_active_row_number() != 2;
         pedited->dirpyrDenoise.methodmed  = methodmed->get_active_row_number() != 5;
         pedited->dirpyrDenoise.luma     = luma->getEditedState ();
@@ -736,6 +742,10 @@ void DirPyrDenoise::write (ProcParams* pp, ParamsEdited* pedited)
         pp->dirpyrDenoise.medmethod = "77";
     } else if (medmethod->get_active_row_number() == 5) {
         pp->dirpyrDenoise.medmethod = "99";
+    } else if (medmethod->get_active_row_number() == 6) {
+        pp->dirpyrDenoise.medmethod = "1515";
+    } else if (medmethod->get_active_row_number() == 7) {
+        pp->dirpyrDenoise.medmethod = "2121";
     }
 
     if (rgbmethod->get_active_row_number() == 0) {
@@ -31,6 +31,7 @@
 #include "options.h"
 #include "rtimage.h"
 #include "cachemanager.h"
+#include "dirindex.h"
 #include "multilangmgr.h"
 #include "filepanel.h"
 #include "renamedlg.h"
@@ -548,6 +549,11 @@ void FileCatalog::closeDir ()
     // terminate thumbnail preview loading
     previewLoader->removeAllJobs ();
 
+    if (dirIndex) {
+        dirIndex->save ();
+        dirIndex.reset ();
+    }
+
     // terminate thumbnail updater
     thumbImageUpdater->removeAllJobs ();
 
@@ -575,7 +581,7 @@ std::vector<Glib::ustring> FileCatalog::getFileList()
 
         const auto dir = Gio::File::create_for_path(selectedDirectory);
 
-        auto enumerator = dir->enumerate_children("standard::name,standard::type,standard::is-hidden");
+        auto enumerator = dir->enumerate_children("standard::name,standard::type,standard::is-hidden,standard::size,time::modified,time::modified-usec,unix::inode");
 
         while (true) {
             try {
@@ -604,6 +610,11 @@ std::vector<Glib::ustring> FileCatalog::getFileList()
                 }
 
                 names.push_back(Glib::build_filename(selectedDirectory, fname));
+
+                if (dirIndex) {
+                    const Glib::TimeVal mtime = file->modification_time();
+                    dirIndex->scanned(fname, {static_cast<std::uint64_t>(file->get_size()), std::int64_t(mtime.tv_sec) * 1000000 + mtime.tv_usec, file->get_attribute_uint64("unix::inode")});
+                }
             } catch (Glib::Exception& exception) {
                 if (rtengine::settings->verbose) {
                     std::cerr << exception.what() << std::endl;
@@ -645,6 +656,7 @@ void FileCatalog::dirSelected (const Glib::ustring& dirname, const Glib::ustring
 
         BrowsePath->set_text(selectedDirectory);
         buttonBrowsePath->set_image(*iRefreshWhite);
+        dirIndex = cacheMgr->openDirIndex(selectedDirectory);
         fileNameList = getFileList();
 
         for (unsigned int i = 0; i < fileNameList.size(); i++) {
@@ -858,6 +870,10 @@ void FileCatalog::previewsFinished (int dir_id)
         currentEFS = dirEFS;
     }
 
+    if (const auto index = dirIndex) {
+        index->save();
+    }
+
     idle_register.add(
         [this]() -> bool
         {
@@ -1755,7 +1771,7 @@ void FileCatalog::on_dir_changed (const Glib::RefPtr<Gio::File>& file, const Gli
 void FileCatalog::addFile (const Glib::ustring& fName)
 {
     if (!fName.empty()) {
-        previewLoader->add(selectedDirectoryId, fName, this);
+        previewLoader->add(selectedDirectoryId, fName, this, dirIndex ? dirIndex->lookup(fName) : nullptr);
         previewsToLoad++;
     }
 }
@@ -18,6 +18,7 @@
  */
 #pragma once
 
+#include <memory>
 #include <set>
 
 #include <giomm.h>
@@ -36,6 +37,7 @@
 
 #include "../rtengine/noncopyable.h"
 
+class DirIndex;
 class FilePanel;
 /*
  * Class:
@@ -58,6 +60,7 @@ private:
     Gtk::HBox* hBox;
     Glib::ustring selectedDirectory;
     int selectedDirectoryId;
+    std::shared_ptr<DirIndex> dirIndex;
     bool enabled;
     bool inTabMode;  // Tab mode has e.g. different progress bar handling
     Glib::ustring imageToSelect_fname;
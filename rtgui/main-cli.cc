@@ -34,6 +34,7 @@
 #include "../rtengine/procparams.h"
 #include "../rtengine/profilestore.h"
 #include "../rtengine/rtengine.h"
+#include "cachewarmer.h"
 #include "options.h"
 #include "soundman.h"
 #include "rtimage.h"
@@ -255,6 +256,7 @@ int processLineParams ( int argc, char **argv )
 {
     rtengine::procparams::PartialProfile *rawParams = nullptr, *imgParams = nullptr;
     std::vector<Glib::ustring> inputFiles;
+    std::vector<Glib::ustring> cacheInputs;
     Glib::ustring outputPath;
     std::vector<rtengine::procparams::PartialProfile*> processingParams;
     bool outputDirectory = false;
@@ -270,6 +272,7 @@ int processLineParams ( int argc, char **argv )
     int subsampling = 3;
     int bits = -1;
     bool isFloat = false;
+    int cacheThreads = -1;
     std::string outputType;
     unsigned errors = 0;
 
@@ -432,6 +435,17 @@ int processLineParams ( int argc, char **argv )
                     fast_export = true;
                     break;
 
+                case 'T':
+                    cacheThreads = currParam.size() > 2 ? atoi (currParam.substr (2).c_str()) : 0;
+
+                    if (cacheThreads < 0 || (cacheThreads == 0 && currParam.size() > 2)) {
+                        std::cerr << "Error: the value accompanying the -T switch has to be a number of threads greater than 0!" << std::endl;
+                        deleteProcParams (processingParams);
+                        return -3;
+                    }
+
+                    break;
+
                 case 'c': // MUST be last option
                     while (iArg + 1 < argc) {
                         iArg++;
@@ -445,6 +459,12 @@ int processLineParams ( int argc, char **argv )
                             continue;
                         }
 
+                        if (cacheThreads >= 0) {
+                            // folders are walked by the cache warmer
+                            cacheInputs.emplace_back (argument);
+                            continue;
+                        }
+
                         if (Glib::file_test (argument, Glib::FILE_TEST_IS_REGULAR)) {
                             bool notAll = allExtensions && !options.is_parse_extention (argument);
                             bool notRetained = !allExtensions && !options.has_retained_extention (argument);
@@ -539,6 +559,7 @@ int processLineParams ( int argc, char **argv )
                     std::cout << std::endl;
                     std::cout << "Options:" << std::endl;
                     std::cout << "  " << Glib::path_get_basename (argv[0]) << "[-o <output>|-O <output>] [-q] [-a] [-s|-S] [-p <one.pp3> [-p <two.pp3> ...] ] [-d] [ -j[1-100] -js<1-3> | -t[z] -b<8|16|16f|32> | -n -b<8|16> ] [-Y] [-f] -c <input>" << std::endl;
+                    std::cout << "  " << Glib::path_get_basename (argv[0]) << " -T[<threads>] [-a] -c <input>" << std::endl;
                     std::cout << std::endl;
                     std::cout << "  -c <files>       Specify one or more input files or folders." << std::endl;
                     std::cout << "                   When specifying folders, Rawtherapee will look for image file types which comply" << std::endl;
@@ -580,6 +601,9 @@ int processLineParams ( int argc, char **argv )
                     std::cout << "                   Compression is hard-coded to PNG_FILTER_PAETH, Z_RLE." << std::endl;
                     std::cout << "  -Y               Overwrite output if present." << std::endl;
                     std::cout << "  -f               Use the custom fast-export processing pipeline." << std::endl;
+                    std::cout << "  -T[<threads>]    Don't convert, fill the file browser's thumbnail cache for the input files" << std::endl;
+                    std::cout << "                   and folders (including subfolders) instead. Images are processed in parallel" << std::endl;
+                    std::cout << "                   using the given number of threads, or all cores by default." << std::endl;
                     std::cout << std::endl;
                     std::cout << "Your " << pparamsExt << " files can be incomplete, RawTherapee will build the final values as follows:" << std::endl;
                     std::cout << "  1- A new processing profile is created using neutral values," << std::endl;
@@ -642,6 +666,16 @@ int processLineParams ( int argc, char **argv )
         return 1;
     }
 
+    if (cacheThreads >= 0) {
+        deleteProcParams (processingParams);
+
+        if (cacheInputs.empty()) {
+            return 2;
+        }
+
+        return CacheWarmer (cacheThreads, allExtensions).run (cacheInputs) > 0 ? -2 : 0;
+    }
+
     if ( inputFiles.empty() ) {
         return 2;
     }
@@ -397,6 +397,8 @@ void Options::setDefaults()
     theme = "RawTherapee";
     maxThumbnailHeight = 250;
     maxCacheEntries = 20000;
+    packedCache = false;
+    maxPackedCacheSize = 4096;
     thumbInterp = 1;
     autoSuffix = true;
     forceFormatOpts = true;
@@ -549,6 +551,7 @@ void Options::setDefaults()
 
     rtSettings.darkFramesPath = "";
     rtSettings.flatFieldsPath = "";
+    rtSettings.cacheDirectory = "";
 #ifdef WIN32
     const gchar* sysRoot = g_getenv("SystemRoot");  // Returns e.g. "c:\Windows"
 
@@ -644,6 +647,9 @@ void Options::setDefaults()
     cropAutoFit = false;
 
     rtSettings.thumbnail_inspector_mode = rtengine::Settings::ThumbnailInspectorMode::JPEG;
+    rtSettings.cacheCAFit = true;
+    rtSettings.compactRawData = false;
+    rtSettings.cacheDualDemosaic = false;
 }
 
 Options* Options::copyFrom(Options* other)
@@ -968,6 +974,14 @@ void Options::readFromFile(Glib::ustring fname)
                     maxCacheEntries = keyFile.get_integer("File Browser", "MaxCacheEntries");
                 }
 
+                if (keyFile.has_key("File Browser", "PackedCache")) {
+                    packedCache = keyFile.get_boolean("File Browser", "PackedCache");
+                }
+
+                if (keyFile.has_key("File Browser", "MaxPackedCacheSize")) {
+                    maxPackedCacheSize = keyFile.get_integer("File Browser", "MaxPackedCacheSize");
+                }
+
                 if (keyFile.has_key("File Browser", "ParseExtensions")) {
                     auto l = keyFile.get_string_list("File Browser", "ParseExtensions");
                     if (!l.empty()) {
@@ -1123,6 +1137,18 @@ void Options::readFromFile(Glib::ustring fname)
                 if (keyFile.has_key("Performance", "ThumbnailInspectorMode")) {
                     rtSettings.thumbnail_inspector_mode = static_cast<rtengine::Settings::ThumbnailInspectorMode>(keyFile.get_integer("Performance", "ThumbnailInspectorMode"));
                 }
+
+                if (keyFile.has_key("Performance", "CacheCAFit")) {
+                    rtSettings.cacheCAFit = keyFile.get_boolean("Performance", "CacheCAFit");
+                }
+
+                if (keyFile.has_key("Performance", "CompactRawData")) {
+                    rtSettings.compactRawData = keyFile.get_boolean("Performance", "CompactRawData");
+                }
+
+                if (keyFile.has_key("Performance", "CacheDualDemosaic")) {
+                    rtSettings.cacheDualDemosaic = keyFile.get_boolean("Performance", "CacheDualDemosaic");
+                }
             }
 
             if (keyFile.has_group("GUI")) {
@@ -1951,6 +1977,8 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("File Browser", "SameThumbSize", sameThumbSize);
         keyFile.set_integer("File Browser", "MaxPreviewHeight", maxThumbnailHeight);
         keyFile.set_integer("File Browser", "MaxCacheEntries", maxCacheEntries);
+        keyFile.set_boolean("File Browser", "PackedCache", packedCache);
+        keyFile.set_integer("File Browser", "MaxPackedCacheSize", maxPackedCacheSize);
         Glib::ArrayHandle<Glib::ustring> pext = parseExtensions;
         keyFile.set_string_list("File Browser", "ParseExtensions", pext);
         Glib::ArrayHandle<int> pextena = parseExtensionsEnabled;
@@ -2002,6 +2030,9 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("Performance", "ChunkSizeXT", chunkSizeXT);
         keyFile.set_integer("Performance", "ChunkSizeCA", chunkSizeCA);
         keyFile.set_integer("Performance", "ThumbnailInspectorMode", int(rtSettings.thumbnail_inspector_mode));
+        keyFile.set_boolean("Performance", "CacheCAFit", rtSettings.cacheCAFit);
+        keyFile.set_boolean("Performance", "CompactRawData", rtSettings.compactRawData);
+        keyFile.set_boolean("Performance", "CacheDualDemosaic", rtSettings.cacheDualDemosaic);
 
         keyFile.set_string("Output", "Format", saveFormat.format);
         keyFile.set_integer("Output", "JpegQuality", saveFormat.jpegQuality);
@@ -2442,6 +2473,8 @@ void Options::load(bool lightweight)
 
     langMgr.load(options.language, {localeTranslation, languageTranslation, defaultTranslation});
 
+    options.rtSettings.cacheDirectory = cacheBaseDir;
+
     rtengine::init(&options.rtSettings, argv0, rtdir, !lightweight);
 }
 
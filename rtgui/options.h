@@ -264,6 +264,8 @@ public:
     int editorToSendTo;
     int maxThumbnailHeight;
     std::size_t maxCacheEntries;
+    bool packedCache;                   // store thumbnails, histograms, embedded profiles and image data in a single file
+    std::size_t maxPackedCacheSize;     // in MiB
     int thumbInterp; // 0: nearest, 1: bilinear
     std::vector<Glib::ustring> parseExtensions;   // List containing all extensions type
     std::vector<int> parseExtensionsEnabled;      // List of bool to retain extension or not
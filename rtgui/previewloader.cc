@@ -36,10 +36,11 @@ class PreviewLoader::Impl :
 {
 public:
     struct Job {
-        Job(int dir_id, const Glib::ustring& dir_entry, PreviewLoaderListener* listener):
+        Job(int dir_id, const Glib::ustring& dir_entry, PreviewLoaderListener* listener, const std::shared_ptr<const CacheImageData>& imageData):
             dir_id_(dir_id),
             dir_entry_(dir_entry),
-            listener_(listener)
+            listener_(listener),
+            imageData_(imageData)
         {}
 
         Job():
@@ -50,6 +51,7 @@ public:
         int dir_id_;
         Glib::ustring dir_entry_;
         PreviewLoaderListener* listener_;
+        std::shared_ptr<const CacheImageData> imageData_;
     };
     /* Issue 2406
         struct OutputJob
@@ -127,7 +129,7 @@ public:
             Thumbnail* tmb = nullptr;
             {
                 if (Glib::file_test(j.dir_entry_, Glib::FILE_TEST_EXISTS)) {
-                    tmb = cacheMgr->getEntry(j.dir_entry_);
+                    tmb = cacheMgr->getEntry(j.dir_entry_, j.imageData_.get());
                 }
             }
 
@@ -180,7 +182,7 @@ PreviewLoader* PreviewLoader::getInstance()
     return &instance_;
 }
 
-void PreviewLoader::add(int dir_id, const Glib::ustring& dir_entry, PreviewLoaderListener* l)
+void PreviewLoader::add(int dir_id, const Glib::ustring& dir_entry, PreviewLoaderListener* l, const std::shared_ptr<const CacheImageData>& imageData)
 {
     // somebody listening?
     if ( l != nullptr ) {
@@ -189,7 +191,7 @@ void PreviewLoader::add(int dir_id, const Glib::ustring& dir_entry, PreviewLoade
 
             // create a new job and append to queue
             DEBUG("saving job %s", dir_entry.c_str());
-            impl_->jobs_.insert(Impl::Job(dir_id, dir_entry, l));
+            impl_->jobs_.insert(Impl::Job(dir_id, dir_entry, l, imageData));
         }
 
         // queue a run request
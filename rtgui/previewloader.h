@@ -18,12 +18,14 @@
  */
 #pragma once
 
+#include <memory>
 #include <set>
 
 #include <glibmm/ustring.h>
 
 #include "../rtengine/noncopyable.h"
 
+class CacheImageData;
 class FileBrowserEntry;
 
 class PreviewLoaderListener
@@ -67,8 +69,9 @@ public:
      * @param dir_id directory we're looking at
      * @param dir_entry entry in it
      * @param l listener
+     * @param imageData cache data from the directory index, if the entry is indexed
      */
-    void add(int dir_id, const Glib::ustring& dir_entry, PreviewLoaderListener* l);
+    void add(int dir_id, const Glib::ustring& dir_entry, PreviewLoaderListener* l, const std::shared_ptr<const CacheImageData>& imageData = nullptr);
 
     /**
      * @brief Stop processing and remove all jobs.
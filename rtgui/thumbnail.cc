@@ -28,6 +28,7 @@
 #include <cstdlib>
 #include "../rtengine/colortemp.h"
 #include "../rtengine/imagedata.h"
+#include "../rtengine/packedcache.h"
 #include "../rtengine/procparams.h"
 #include "../rtengine/rtthumbnail.h"
 #include <glib/gstdio.h>
@@ -187,7 +188,7 @@ void Thumbnail::_generateThumbnailImage ()
         _saveThumbnail ();
         cfs.supported = true;
 
-        cfs.save (getCacheFileName ("data", ".txt"));
+        saveCacheImageData ();
 
         generateExifDateTimeStrings ();
     }
@@ -259,11 +260,9 @@ rtengine::procparams::ProcParams* Thumbnail::createProcParamsForUpdate(bool retu
         if (defProf == DEFPROFILE_DYNAMIC && create && cfs && cfs->exifValid) {
             rtengine::FramesMetaData* imageMetaData;
             if (getType() == FT_Raw) {
-                // Should we ask all frame's MetaData ?
-                imageMetaData = rtengine::FramesMetaData::fromFile (fname, std::unique_ptr<rtengine::RawMetaDataLocation>(new rtengine::RawMetaDataLocation(rtengine::Thumbnail::loadMetaDataFromRaw(fname))), true);
+                imageMetaData = rtengine::FramesMetaData::summaryFromFile (fname, std::unique_ptr<rtengine::RawMetaDataLocation>(new rtengine::RawMetaDataLocation(rtengine::Thumbnail::loadMetaDataFromRaw(fname))));
             } else {
-                // Should we ask all frame's MetaData ?
-                imageMetaData = rtengine::FramesMetaData::fromFile (fname, nullptr, true);
+                imageMetaData = rtengine::FramesMetaData::summaryFromFile (fname, nullptr);
             }
             PartialProfile *pp = ProfileStore::getInstance()->loadDynamicProfile(imageMetaData);
             delete imageMetaData;
@@ -534,7 +533,7 @@ void Thumbnail::imageDeveloped ()
 {
 
     cfs.recentlySaved = true;
-    cfs.save (getCacheFileName ("data", ".txt"));
+    saveCacheImageData ();
 
     if (options.saveParamsCache) {
         pparams->save (getCacheFileName ("profiles", paramFileExtension));
@@ -789,66 +788,7 @@ ThFileType Thumbnail::getType ()
 
 int Thumbnail::infoFromImage (const Glib::ustring& fname, std::unique_ptr<rtengine::RawMetaDataLocation> rml)
 {
-    rtengine::FramesMetaData* idata = rtengine::FramesMetaData::fromFile (fname, std::move(rml));
-
-    if (!idata) {
-        return 0;
-    }
-
-    int deg = 0;
-    cfs.timeValid = false;
-    cfs.exifValid = false;
-
-    if (idata->hasExif()) {
-        cfs.shutter      = idata->getShutterSpeed ();
-        cfs.fnumber      = idata->getFNumber ();
-        cfs.focalLen     = idata->getFocalLen ();
-        cfs.focalLen35mm = idata->getFocalLen35mm ();
-        cfs.focusDist    = idata->getFocusDist ();
-        cfs.iso          = idata->getISOSpeed ();
-        cfs.expcomp      = idata->expcompToString (idata->getExpComp(), false); // do not mask Zero expcomp
-        cfs.isHDR        = idata->getHDR ();
-        cfs.isPixelShift = idata->getPixelShift ();
-        cfs.frameCount   = idata->getFrameCount ();
-        cfs.sampleFormat = idata->getSampleFormat ();
-        cfs.year         = 1900 + idata->getDateTime().tm_year;
-        cfs.month        = idata->getDateTime().tm_mon + 1;
-        cfs.day          = idata->getDateTime().tm_mday;
-        cfs.hour         = idata->getDateTime().tm_hour;
-        cfs.min          = idata->getDateTime().tm_min;
-        cfs.sec          = idata->getDateTime().tm_sec;
-        cfs.timeValid    = true;
-        cfs.exifValid    = true;
-        cfs.lens         = idata->getLens();
-        cfs.camMake      = idata->getMake();
-        cfs.camModel     = idata->getModel();
-        cfs.rating       = idata->getRating();
-
-        if (idata->getOrientation() == "Rotate 90 CW") {
-            deg = 90;
-        } else if (idata->getOrientation() == "Rotate 180") {
-            deg = 180;
-        } else if (idata->getOrientation() == "Rotate 270 CW") {
-            deg = 270;
-        }
-    } else {
-        cfs.lens     = "Unknown";
-        cfs.camMake  = "Unknown";
-        cfs.camModel = "Unknown";
-    }
-
-    // get image filetype
-    std::string::size_type idx;
-    idx = fname.rfind('.');
-
-    if(idx != std::string::npos) {
-        cfs.filetype = fname.substr(idx + 1);
-    } else {
-        cfs.filetype = "";
-    }
-
-    delete idata;
-    return deg;
+    return cfs.readMetaData (fname, std::move(rml));
 }
 
 /*
@@ -868,15 +808,17 @@ void Thumbnail::_loadThumbnail(bool firstTrial)
     tpp = new rtengine::Thumbnail ();
     tpp->isRaw = (cfs.format == (int) FT_Raw);
 
+    rtengine::PackedCache* const packedCache = cachemgr->getPackedCache ();
+
     // load supplementary data
-    bool succ = tpp->readData (getCacheFileName ("data", ".txt"));
+    bool succ = packedCache ? tpp->readData (*packedCache, cfs.md5) : tpp->readData (getCacheFileName ("data", ".txt"));
 
     if (succ) {
         tpp->getAutoWBMultipliers(cfs.redAWBMul, cfs.greenAWBMul, cfs.blueAWBMul);
     }
 
     // thumbnail image
-    succ = succ && tpp->readImage (getCacheFileName ("images", ""));
+    succ = succ && (packedCache ? tpp->readImage (*packedCache, cfs.md5) : tpp->readImage (getCacheFileName ("images", "")));
 
     if (!succ && firstTrial) {
         _generateThumbnailImage ();
@@ -895,13 +837,23 @@ void Thumbnail::_loadThumbnail(bool firstTrial)
     }
 
     if ( cfs.thumbImgType == CacheImageData::FULL_THUMBNAIL ) {
-        if(!tpp->isAeValid()) {
-            // load aehistogram
-            tpp->readAEHistogram (getCacheFileName ("aehistograms", ""));
-        }
+        if (packedCache) {
+            if(!tpp->isAeValid()) {
+                // load aehistogram
+                tpp->readAEHistogram (*packedCache, cfs.md5);
+            }
 
-        // load embedded profile
-        tpp->readEmbProfile (getCacheFileName ("embprofiles", ".icc"));
+            // load embedded profile
+            tpp->readEmbProfile (*packedCache, cfs.md5);
+        } else {
+            if(!tpp->isAeValid()) {
+                // load aehistogram
+                tpp->readAEHistogram (getCacheFileName ("aehistograms", ""));
+            }
+
+            // load embedded profile
+            tpp->readEmbProfile (getCacheFileName ("embprofiles", ".icc"));
+        }
 
         tpp->init ();
     }
@@ -940,6 +892,18 @@ void Thumbnail::_saveThumbnail ()
         return;
     }
 
+    if (rtengine::PackedCache* const packedCache = cachemgr->getPackedCache ()) {
+        tpp->writeImage (*packedCache, cfs.md5);
+
+        if(!tpp->isAeValid()) {
+            tpp->writeAEHistogram (*packedCache, cfs.md5);
+        }
+
+        tpp->writeEmbProfile (*packedCache, cfs.md5);
+        tpp->writeData (*packedCache, cfs.md5);
+        return;
+    }
+
     g_remove (getCacheFileName ("images", ".rtti").c_str ());
 
     // save thumbnail image
@@ -988,7 +952,7 @@ void Thumbnail::updateCache (bool updatePParams, bool updateCacheImageData)
     }
 
     if (updateCacheImageData) {
-        cfs.save (getCacheFileName ("data", ".txt"));
+        saveCacheImageData ();
     }
 }
 
@@ -1001,6 +965,17 @@ Thumbnail::~Thumbnail ()
     mutex.unlock();
 }
 
+void Thumbnail::saveCacheImageData ()
+{
+    if (rtengine::PackedCache* const packedCache = cachemgr->getPackedCache ()) {
+        cfs.save (*packedCache, cfs.md5);
+    } else {
+        cfs.save (getCacheFileName ("data", ".txt"));
+    }
+
+    cachemgr->updateDirIndex (fname, cfs);
+}
+
 Glib::ustring Thumbnail::getCacheFileName (const Glib::ustring& subdir, const Glib::ustring& fext) const
 {
     return cachemgr->getCacheFileName (subdir, fname, fext, cfs.md5);
@@ -81,6 +81,7 @@ class Thumbnail
 
     void            _loadThumbnail (bool firstTrial = true);
     void            _saveThumbnail ();
+    void            saveCacheImageData ();
     void            _generateThumbnailImage ();
     int             infoFromImage (const Glib::ustring& fname, std::unique_ptr<rtengine::RawMetaDataLocation> rml = nullptr);
     void            loadThumbnail (bool firstTrial = true);